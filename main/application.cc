@@ -2,15 +2,21 @@
 #include "board.h"
 #include "display.h"
 #include "system_info.h"
-#include "ml307_ssl_transport.h"
 #include "audio_codec.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "mqtt_protocol.h"
 #include "websocket_protocol.h"
+#else
+#include "loopback_protocol.h"
+#endif
 #include "font_awesome_symbols.h"
 #include "iot/thing_manager.h"
 #include "assets/lang_config.h"
 #include "mcp_server.h"
+#include "latency_tracer.h"
 #include "audio_debugger.h"
+#include "pcm_convert.h"
+#include "settings.h"
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "afe_audio_processor.h"
@@ -27,13 +33,25 @@
 #endif
 
 #include <cstring>
+#include <algorithm>
 #include <esp_log.h>
 #include <cJSON.h>
-#include <driver/gpio.h>
 #include <arpa/inet.h>
 
 #define TAG "Application"
 
+#if defined(CONFIG_AUDIO_INPUT_TASK_CORE) && CONFIG_AUDIO_INPUT_TASK_CORE >= 0
+#define AUDIO_INPUT_TASK_CORE CONFIG_AUDIO_INPUT_TASK_CORE
+#else
+#define AUDIO_INPUT_TASK_CORE tskNO_AFFINITY
+#endif
+
+#if defined(CONFIG_AUDIO_OUTPUT_TASK_CORE) && CONFIG_AUDIO_OUTPUT_TASK_CORE >= 0
+#define AUDIO_OUTPUT_TASK_CORE CONFIG_AUDIO_OUTPUT_TASK_CORE
+#else
+#define AUDIO_OUTPUT_TASK_CORE tskNO_AFFINITY
+#endif
+
 
 static const char* const STATE_STRINGS[] = {
     "unknown",
@@ -54,6 +72,11 @@ Application::Application() {
     event_group_ = xEventGroupCreate();
     background_task_ = new BackgroundTask(4096 * 7);
 
+    // Reserve the reusable packets once so popping from the rings never allocates
+    send_packet_.payload.reserve(AUDIO_PACKET_MAX_PAYLOAD_SIZE);
+    jitter_packet_.payload.reserve(AUDIO_PACKET_MAX_PAYLOAD_SIZE);
+    decode_packet_.payload.reserve(AUDIO_PACKET_MAX_PAYLOAD_SIZE);
+
 #if CONFIG_USE_DEVICE_AEC
     aec_mode_ = kAecOnDeviceSide;
 #elif CONFIG_USE_SERVER_AEC
@@ -100,6 +123,7 @@ Application::~Application() {
     vEventGroupDelete(event_group_);
 }
 
+#if !CONFIG_IDF_TARGET_LINUX
 void Application::CheckNewVersion(Ota& ota) {
     const int MAX_RETRY = 10;
     int retry_count = 0;
@@ -152,10 +176,7 @@ void Application::CheckNewVersion(Ota& ota) {
             auto codec = board.GetAudioCodec();
             codec->EnableInput(false);
             codec->EnableOutput(false);
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-                audio_decode_queue_.clear();
-            }
+            audio_decode_queue_.Clear();
             background_task_->WaitForCompletion();
             delete background_task_;
             background_task_ = nullptr;
@@ -207,6 +228,7 @@ void Application::CheckNewVersion(Ota& ota) {
         }
     }
 }
+#endif
 
 void Application::ShowActivationCode(const std::string& code, const std::string& message) {
     struct digit_sound {
@@ -226,7 +248,7 @@ void Application::ShowActivationCode(const std::string& code, const std::string&
         digit_sound{'9', Lang::Sounds::P3_9}
     }};
 
-    // This sentence uses 9KB of SRAM, so we need to wait for it to finish
+    // The digits queue behind the activation sentence and play after it, nothing waits here
     Alert(Lang::Strings::ACTIVATION, message.c_str(), "happy", Lang::Sounds::P3_ACTIVATION);
 
     for (const auto& digit : code) {
@@ -245,7 +267,8 @@ void Application::Alert(const char* status, const char* message, const char* emo
     display->SetEmotion(emotion);
     display->SetChatMessage("system", message);
     if (!sound.empty()) {
-        ResetDecoder();
+        // The alert is mixed over the ducked stream, neither the speech nor the prompts queued before it are dropped
+        Board::GetInstance().GetAudioCodec()->EnableOutput(true);
         PlaySound(sound);
     }
 }
@@ -259,48 +282,33 @@ void Application::DismissAlert() {
     }
 }
 
-void Application::PlaySound(const std::string_view& sound) {
-    // Wait for the previous sound to finish
+void Application::PlaySound(const std::string_view& sound, std::function<void()> on_done) {
+    // Sounds are queued in order and decoded straight from the asset, the caller never waits
     {
-        std::unique_lock<std::mutex> lock(mutex_);
-        audio_decode_cv_.wait(lock, [this]() {
-            return audio_decode_queue_.empty();
+        std::lock_guard<std::mutex> lock(prompt_mutex_);
+        auto cached = prompt_cache_ ? prompt_cache_->Find(sound) : nullptr;
+        pending_prompts_.push_back(PromptPlayback{
+            .source = cached ? nullptr : std::make_unique<P3PacketSource>(sound),
+            .cached = cached,
+            .on_done = std::move(on_done),
         });
     }
-    background_task_->WaitForCompletion();
-
-    const char* data = sound.data();
-    size_t size = sound.size();
-    for (const char* p = data; p < data + size; ) {
-        auto p3 = (BinaryProtocol3*)p;
-        p += sizeof(BinaryProtocol3);
-
-        auto payload_size = ntohs(p3->payload_size);
-        AudioStreamPacket packet;
-        packet.sample_rate = 16000;
-        packet.frame_duration = 60;
-        packet.payload.resize(payload_size);
-        memcpy(packet.payload.data(), p3->payload, payload_size);
-        p += payload_size;
-
-        std::lock_guard<std::mutex> lock(mutex_);
-        audio_decode_queue_.emplace_back(std::move(packet));
+    if (audio_decode_task_handle_ != nullptr) {
+        xTaskNotifyGive(audio_decode_task_handle_);
     }
 }
 
 void Application::EnterAudioTestingMode() {
     ESP_LOGI(TAG, "Entering audio testing mode");
     ResetDecoder();
+    audio_testing_queue_->Clear();
     SetDeviceState(kDeviceStateAudioTesting);
 }
 
 void Application::ExitAudioTestingMode() {
     ESP_LOGI(TAG, "Exiting audio testing mode");
+    // Leaving the testing state lets the audio loop play back the recorded packets
     SetDeviceState(kDeviceStateWifiConfiguring);
-    // Copy audio_testing_queue_ to audio_decode_queue_
-    std::lock_guard<std::mutex> lock(mutex_);
-    audio_decode_queue_ = std::move(audio_testing_queue_);
-    audio_decode_cv_.notify_all();
 }
 
 void Application::ToggleChatState() {
@@ -408,18 +416,33 @@ void Application::Start() {
 
     /* Setup the audio codec */
     auto codec = board.GetAudioCodec();
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-    if (aec_mode_ != kAecOff) {
-        ESP_LOGI(TAG, "AEC mode: %d, setting opus encoder complexity to 0", aec_mode_);
-        opus_encoder_->SetComplexity(0);
-    } else if (board.GetBoardType() == "ml307") {
-        ESP_LOGI(TAG, "ML307 board detected, setting opus encoder complexity to 5");
-        opus_encoder_->SetComplexity(5);
-    } else {
-        ESP_LOGI(TAG, "WiFi board detected, setting opus encoder complexity to 0");
-        opus_encoder_->SetComplexity(0);
+    decoder_cache_ = std::make_unique<OpusDecoderCache>(codec->output_sample_rate());
+    SetDecodeSampleRate(kAudioMixerStream, codec->output_sample_rate(), OPUS_FRAME_DURATION_MS);
+    // One block holds a frame at the output sample rate, longer frames span several blocks
+    audio_mixer_ = std::make_unique<AudioMixer>(codec->output_sample_rate(), AUDIO_PLAYBACK_AHEAD_FRAMES,
+        codec->output_sample_rate() * OPUS_FRAME_DURATION_MS / 1000 + DRIFT_COMPENSATOR_MAX_EXTRA_SAMPLES,
+        CONFIG_AUDIO_MIXER_DUCK_DB);
+    mix_pcm_.resize(codec->output_sample_rate() * AUDIO_MIXER_PERIOD_MS / 1000);
+    {
+        Settings audio_settings("audio", false);
+        audio_mixer_->SetGain(kAudioMixerStream, audio_settings.GetInt("stream_gain", 100));
+        audio_mixer_->SetGain(kAudioMixerPrompt, audio_settings.GetInt("prompt_gain", 100));
+    }
+#ifdef CONFIG_USE_SERVER_AEC
+    playout_timestamps_ = std::make_unique<AudioTimestampMap>(codec->output_sample_rate());
+#endif
+
+    // Shorter uplink frames lower the turn latency at the cost of CPU and packet overhead
+    Settings settings("audio", false);
+    int uplink_frame_duration = settings.GetInt("frame_duration", CONFIG_AUDIO_UPLINK_FRAME_DURATION);
+    if (uplink_frame_duration != 20 && uplink_frame_duration != 40 && uplink_frame_duration != 60) {
+        ESP_LOGW(TAG, "Invalid uplink frame duration %d, using %dms", uplink_frame_duration, OPUS_FRAME_DURATION_MS);
+        uplink_frame_duration = OPUS_FRAME_DURATION_MS;
     }
+    audio_send_queue_ = std::make_unique<AudioPacketRing>(AUDIO_QUEUE_DURATION_MS / uplink_frame_duration);
+    // Created before the decode task reads it, the server may only lengthen the frames later
+    audio_testing_queue_ = std::make_unique<AudioPacketRing>(AUDIO_TESTING_MAX_DURATION_MS / uplink_frame_duration);
+    CreateEncoder(uplink_frame_duration);
 
     if (codec->input_sample_rate() != 16000) {
         input_resampler_.Configure(codec->input_sample_rate(), 16000);
@@ -427,19 +450,35 @@ void Application::Start() {
     }
     codec->Start();
 
-#if CONFIG_USE_AUDIO_PROCESSOR
+#if CONFIG_AUDIO_PROMPT_CACHE_SIZE > 0
+    // Keep the prompts on the wake word and alert paths as PCM, decoded once in the background
+    prompt_cache_ = std::make_unique<AudioPromptCache>(CONFIG_AUDIO_PROMPT_CACHE_SIZE * 1024, codec->output_sample_rate());
+    prompt_cache_->Register(Lang::Sounds::P3_POPUP);
+    prompt_cache_->Register(Lang::Sounds::P3_SUCCESS);
+    prompt_cache_->Register(Lang::Sounds::P3_EXCLAMATION);
+    background_task_->Schedule([this]() {
+        prompt_cache_->LoadRegistered();
+    });
+#endif
+
+    // Capture and playback run in their own tasks and block on the I2S DMA, so neither delays the other
     xTaskCreatePinnedToCore([](void* arg) {
         Application* app = (Application*)arg;
-        app->AudioLoop();
+        app->AudioInputLoop();
         vTaskDelete(NULL);
-    }, "audio_loop", 4096 * 2, this, 8, &audio_loop_task_handle_, 1);
-#else
+    }, "audio_input", 4096 * 2, this, 8, &audio_input_task_handle_, AUDIO_INPUT_TASK_CORE);
+    xTaskCreatePinnedToCore([](void* arg) {
+        Application* app = (Application*)arg;
+        app->AudioOutputLoop();
+        vTaskDelete(NULL);
+    }, "audio_output", 4096, this, 9, &audio_output_task_handle_, AUDIO_OUTPUT_TASK_CORE);
+
+    // Opus decoding runs ahead of the output task, so an I2S write never waits for the decoder
     xTaskCreate([](void* arg) {
         Application* app = (Application*)arg;
-        app->AudioLoop();
+        app->AudioDecodeLoop();
         vTaskDelete(NULL);
-    }, "audio_loop", 4096 * 2, this, 8, &audio_loop_task_handle_);
-#endif
+    }, "audio_decode", 4096 * 6, this, 7, &audio_decode_task_handle_);
 
     /* Start the clock timer to update the status bar */
     esp_timer_start_periodic(clock_timer_handle_, 1000000);
@@ -451,8 +490,13 @@ void Application::Start() {
     display->UpdateStatusBar(true);
 
     // Check for new firmware version or get the MQTT broker address
+#if CONFIG_BOARD_TYPE_LINUX_SIM
+    // The simulator has no OTA server to ask
+    xEventGroupSetBits(event_group_, CHECK_NEW_VERSION_DONE_EVENT);
+#else
     Ota ota;
     CheckNewVersion(ota);
+#endif
 
     // Initialize the protocol
     display->SetStatus(Lang::Strings::LOADING_PROTOCOL);
@@ -462,6 +506,10 @@ void Application::Start() {
     McpServer::GetInstance().AddCommonTools();
 #endif
 
+#if CONFIG_BOARD_TYPE_LINUX_SIM
+    // The simulator answers from an in-process server, there is no OTA config to choose a protocol
+    protocol_ = std::make_unique<LoopbackProtocol>();
+#else
     if (ota.HasMqttConfig()) {
         protocol_ = std::make_unique<MqttProtocol>();
     } else if (ota.HasWebsocketConfig()) {
@@ -470,19 +518,37 @@ void Application::Start() {
         ESP_LOGW(TAG, "No protocol specified in the OTA config, using MQTT");
         protocol_ = std::make_unique<MqttProtocol>();
     }
+#endif
 
+    protocol_->SetPreferredUplinkFrameDuration(uplink_frame_duration_);
     protocol_->OnNetworkError([this](const std::string& message) {
         SetDeviceState(kDeviceStateIdle);
         Alert(Lang::Strings::ERROR, message.c_str(), "sad", Lang::Sounds::P3_EXCLAMATION);
     });
     protocol_->OnIncomingAudio([this](AudioStreamPacket&& packet) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (device_state_ == kDeviceStateSpeaking && audio_decode_queue_.size() < MAX_AUDIO_PACKETS_IN_QUEUE) {
-            audio_decode_queue_.emplace_back(std::move(packet));
+        // Packets are dropped by the ring if the queue is full, the decode task moves them into the jitter buffer
+        if (device_state_ == kDeviceStateSpeaking) {
+            LatencyTracer::GetInstance().Mark(kLatencyFirstAudioReceived);
+            if (audio_decode_queue_.Push(packet)) {
+                xTaskNotifyGive(audio_decode_task_handle_);
+            }
         }
     });
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
         board.SetPowerSaveMode(false);
+        if (protocol_->uplink_frame_duration() != uplink_frame_duration_) {
+            // The encoder runs on the background task, let it finish before replacing it
+            background_task_->WaitForCompletion();
+            CreateEncoder(protocol_->uplink_frame_duration());
+        }
+#if CONFIG_AUDIO_ENCODER_ADAPTIVE
+        // The bitrate backoff of the last channel says nothing about this one,
+        // the encoder is only touched on the background task
+        background_task_->Schedule([this]() {
+            encoder_controller_.ResetBitrate();
+            opus_encoder_->SetBitrate(encoder_controller_.bitrate());
+        });
+#endif
         if (protocol_->server_sample_rate() != codec->output_sample_rate()) {
             ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
                 protocol_->server_sample_rate(), codec->output_sample_rate());
@@ -498,6 +564,7 @@ void Application::Start() {
 #endif
     });
     protocol_->OnAudioChannelClosed([this, &board]() {
+        LatencyTracer::GetInstance().EndTurn();
         board.SetPowerSaveMode(true);
         Schedule([this]() {
             auto display = Board::GetInstance().GetDisplay();
@@ -511,6 +578,7 @@ void Application::Start() {
         if (strcmp(type->valuestring, "tts") == 0) {
             auto state = cJSON_GetObjectItem(root, "state");
             if (strcmp(state->valuestring, "start") == 0) {
+                LatencyTracer::GetInstance().Mark(kLatencyTtsStart);
                 Schedule([this]() {
                     aborted_ = false;
                     if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
@@ -518,8 +586,17 @@ void Application::Start() {
                     }
                 });
             } else if (strcmp(state->valuestring, "stop") == 0) {
+                LatencyTracer::GetInstance().Mark(kLatencyTtsStop);
                 Schedule([this]() {
                     background_task_->WaitForCompletion();
+                    auto stats = jitter_buffer_.GetStats();
+                    ESP_LOGI(TAG, "Jitter buffer: depth %u/%d, jitter %dms, received %lu, late %lu, duplicated %lu, concealed %lu, recovered %lu, skipped %lu, overflowed %lu, rebuffered %lu",
+                        stats.depth, stats.target_depth, stats.jitter_ms, stats.received, stats.late, stats.duplicated,
+                        stats.concealed, stats.recovered, stats.skipped, stats.overflowed, stats.rebuffered);
+                    ESP_LOGI(TAG, "Drift compensation: %d ppm", drift_compensator_.ppm());
+                    auto cache_stats = decoder_cache_->GetStats();
+                    ESP_LOGI(TAG, "Decoder cache: hits %lu, misses %lu, evictions %lu, last allocation %u bytes",
+                        cache_stats.hits, cache_stats.misses, cache_stats.evictions, cache_stats.allocated_bytes);
                     if (device_state_ == kDeviceStateSpeaking) {
                         if (listening_mode_ == kListeningModeManualStop) {
                             SetDeviceState(kDeviceStateIdle);
@@ -538,6 +615,7 @@ void Application::Start() {
                 }
             }
         } else if (strcmp(type->valuestring, "stt") == 0) {
+            LatencyTracer::GetInstance().Mark(kLatencySttReceived);
             auto text = cJSON_GetObjectItem(root, "text");
             if (cJSON_IsString(text)) {
                 ESP_LOGI(TAG, ">> %s", text->valuestring);
@@ -600,46 +678,57 @@ void Application::Start() {
 
     audio_debugger_ = std::make_unique<AudioDebugger>();
     audio_processor_->Initialize(codec);
+#if CONFIG_AUDIO_UPLINK_DTX
+    silence_gate_.OnDiscard([this](std::vector<int16_t>&& data) {
+        audio_processor_->output_pool().Release(std::move(data));
+    });
+#endif
     audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            if (audio_send_queue_.size() >= MAX_AUDIO_PACKETS_IN_QUEUE) {
-                ESP_LOGW(TAG, "Too many audio packets in queue, drop the newest packet");
+        uint32_t timestamp = 0;
+#ifdef CONFIG_USE_SERVER_AEC
+        // The processor returns as many frames as it is fed, so its output lines up with the capture
+        timestamp = capture_timestamps_.Lookup(processed_position_);
+        processed_position_ += data.size();
+#endif
+#if CONFIG_AUDIO_ENDPOINTER
+        if (endpointer_active_) {
+            auto event = endpointer_.Process(data.data(), data.size());
+            if (event != kEndpointerNone) {
+                Schedule([this]() {
+                    if (device_state_ == kDeviceStateListening && listening_mode_ == kListeningModeAutoStop) {
+                        protocol_->SendStopListening();
+                        SetDeviceState(kDeviceStateIdle);
+                    }
+                });
+            }
+            // The utterance is over, nothing more is encoded until the listening state ends
+            if (endpointer_.ended()) {
+                audio_processor_->output_pool().Release(std::move(data));
                 return;
             }
         }
-        background_task_->Schedule([this, data = std::move(data)]() mutable {
-            opus_encoder_->Encode(std::move(data), [this](std::vector<uint8_t>&& opus) {
-                AudioStreamPacket packet;
-                packet.payload = std::move(opus);
-#ifdef CONFIG_USE_SERVER_AEC
-                {
-                    std::lock_guard<std::mutex> lock(timestamp_mutex_);
-                    if (!timestamp_queue_.empty()) {
-                        packet.timestamp = timestamp_queue_.front();
-                        timestamp_queue_.pop_front();
-                    } else {
-                        packet.timestamp = 0;
-                    }
-
-                    if (timestamp_queue_.size() > 3) { // 限制队列长度3
-                        timestamp_queue_.pop_front(); // 该包发送前先出队保持队列长度
-                        return;
-                    }
-                }
 #endif
-                std::lock_guard<std::mutex> lock(mutex_);
-                if (audio_send_queue_.size() >= MAX_AUDIO_PACKETS_IN_QUEUE) {
-                    ESP_LOGW(TAG, "Too many audio packets in queue, drop the oldest packet");
-                    audio_send_queue_.pop_front();
-                }
-                audio_send_queue_.emplace_back(std::move(packet));
-                xEventGroupSetBits(event_group_, SEND_AUDIO_EVENT);
+#if CONFIG_AUDIO_UPLINK_DTX
+        if (silence_gate_active_) {
+            silence_gate_.Process(std::move(data), timestamp, [this](std::vector<int16_t>&& data, uint32_t timestamp, bool resumed) {
+                EncodeUplinkAudio(std::move(data), timestamp, resumed);
             });
-        });
+            return;
+        }
+#endif
+        EncodeUplinkAudio(std::move(data), timestamp);
     });
     audio_processor_->OnVadStateChange([this](bool speaking) {
+#if CONFIG_AUDIO_UPLINK_DTX
+        silence_gate_.SetSpeaking(speaking);
+#endif
+#if CONFIG_AUDIO_ENDPOINTER
+        endpointer_.SetSpeaking(speaking);
+#endif
         if (device_state_ == kDeviceStateListening) {
+            if (!speaking) {
+                LatencyTracer::GetInstance().Mark(kLatencyListenStop);
+            }
             Schedule([this, speaking]() {
                 if (speaking) {
                     voice_detected_ = true;
@@ -660,7 +749,7 @@ void Application::Start() {
             }
 
             if (device_state_ == kDeviceStateIdle) {
-                wake_word_->EncodeWakeWordData();
+                wake_word_->EncodeWakeWordData(uplink_frame_duration_);
 
                 if (!protocol_->IsAudioChannelOpened()) {
                     SetDeviceState(kDeviceStateConnecting);
@@ -675,7 +764,9 @@ void Application::Start() {
                 AudioStreamPacket packet;
                 // Encode and send the wake word data to the server
                 while (wake_word_->GetWakeWordOpus(packet.payload)) {
-                    protocol_->SendAudio(packet);
+                    if (protocol_->SendAudio(packet)) {
+                        LatencyTracer::GetInstance().Mark(kLatencyFirstAudioSent);
+                    }
                 }
                 // Set the chat state to wake word detected
                 protocol_->SendWakeWordDetected(wake_word);
@@ -683,6 +774,7 @@ void Application::Start() {
                 // Play the pop up sound to indicate the wake word is detected
                 // And wait 60ms to make sure the queue has been processed by audio task
                 ResetDecoder();
+                wake_beep_pending_ = true;
                 PlaySound(Lang::Sounds::P3_POPUP);
                 vTaskDelay(pdMS_TO_TICKS(60));
 #endif
@@ -700,10 +792,14 @@ void Application::Start() {
     xEventGroupWaitBits(event_group_, CHECK_NEW_VERSION_DONE_EVENT, pdTRUE, pdFALSE, portMAX_DELAY);
     SetDeviceState(kDeviceStateIdle);
 
+#if !CONFIG_BOARD_TYPE_LINUX_SIM
     has_server_time_ = ota.HasServerTime();
+#endif
     if (protocol_started) {
+#if !CONFIG_BOARD_TYPE_LINUX_SIM
         std::string message = std::string(Lang::Strings::VERSION) + ota.GetCurrentVersion();
         display->ShowNotification(message.c_str());
+#endif
         display->SetChatMessage("system", "");
         // Play the success sound to indicate the device is ready
         ResetDecoder();
@@ -728,6 +824,9 @@ void Application::OnClockTimer() {
         // SystemInfo::PrintTaskCpuUsage(pdMS_TO_TICKS(1000));
         // SystemInfo::PrintTaskList();
         SystemInfo::PrintHeapStats();
+        if (input_deadline_misses_ > 0 || output_deadline_misses_ > 0) {
+            ESP_LOGW(TAG, "Audio deadline misses: input %lu, output %lu", input_deadline_misses_, output_deadline_misses_);
+        }
 
         // If we have synchronized server time, set the status to clock "HH:MM" if the device is idle
         if (has_server_time_) {
@@ -764,13 +863,14 @@ void Application::MainEventLoop() {
         auto bits = xEventGroupWaitBits(event_group_, SCHEDULE_EVENT | SEND_AUDIO_EVENT, pdTRUE, pdFALSE, portMAX_DELAY);
 
         if (bits & SEND_AUDIO_EVENT) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            auto packets = std::move(audio_send_queue_);
-            lock.unlock();
-            for (auto& packet : packets) {
-                if (!protocol_->SendAudio(packet)) {
+            while (audio_send_queue_->Pop(send_packet_)) {
+                if (!protocol_->SendAudio(send_packet_)) {
+                    encoder_controller_.OnPacketSent(false, audio_send_queue_->size());
+                    audio_send_queue_->Clear();
                     break;
                 }
+                encoder_controller_.OnPacketSent(true, audio_send_queue_->size());
+                LatencyTracer::GetInstance().Mark(kLatencyFirstAudioSent);
             }
         }
 
@@ -785,119 +885,458 @@ void Application::MainEventLoop() {
     }
 }
 
-// The Audio Loop is used to input and output audio data
-void Application::AudioLoop() {
+// Encodes processed microphone audio on the background task and queues the packets for sending.
+// data is borrowed from the processor output pool and goes back to it once encoded.
+// restart drops the samples the encoder holds, data starts a new run of audio after a gap
+void Application::EncodeUplinkAudio(std::vector<int16_t>&& data, uint32_t timestamp, bool restart) {
+    if (audio_send_queue_->full()) {
+        ESP_LOGW(TAG, "Too many audio packets in queue, drop the newest packet");
+        audio_processor_->output_pool().Release(std::move(data));
+        return;
+    }
+    background_task_->Schedule([this, data = std::move(data), timestamp, restart]() mutable {
+        if (restart) {
+            // The partial frame left from before the gap would be spliced onto this audio with a click
+            opus_encoder_->ResetState();
+        }
+#if CONFIG_AUDIO_UPLINK_FEC
+        // Nothing reports the uplink loss back, the downlink loss of the same path stands in for it
+        int loss_percent = protocol_->packet_loss_percent();
+        if (loss_percent != uplink_loss_percent_) {
+            ESP_LOGI(TAG, "Uplink FEC expected loss: %d%% -> %d%%", uplink_loss_percent_, loss_percent);
+            uplink_loss_percent_ = loss_percent;
+            opus_encoder_->SetPacketLossPercent(loss_percent);
+        }
+#endif
+        // The first frame starts with the samples left in the encoder by the previous chunk
+        uint32_t frame_timestamp = 0;
+        if (timestamp != 0) {
+            frame_timestamp = timestamp - opus_encoder_->buffered_samples() * 1000 / opus_encoder_->sample_rate();
+        }
+        int frames = 0;
+        auto start_time = esp_timer_get_time();
+        opus_encoder_->Encode(data, [this, &frames, &frame_timestamp](const uint8_t* opus, size_t size) {
+            frames++;
+            uint32_t timestamp = frame_timestamp;
+            if (frame_timestamp != 0) {
+                frame_timestamp += uplink_frame_duration_;
+            }
+#if CONFIG_AUDIO_UPLINK_DTX
+            // Opus marks the frames of a silence it does not need to transmit with 2 bytes or less
+            if (uplink_dtx_active_ && size <= 2) {
+                return;
+            }
+#endif
+            if (!audio_send_queue_->Push(16000, uplink_frame_duration_, timestamp, opus, size)) {
+                ESP_LOGW(TAG, "Too many audio packets in queue, drop the newest packet");
+            }
+            xEventGroupSetBits(event_group_, SEND_AUDIO_EVENT);
+        });
+        // Encode() copies the samples into the encoder input, the buffer goes back to the pool
+        audio_processor_->output_pool().Release(std::move(data));
+#if CONFIG_AUDIO_ENCODER_ADAPTIVE
+        if (frames > 0 && encoder_controller_.OnFramesEncoded(frames, esp_timer_get_time() - start_time,
+                background_task_->pending_tasks(), input_deadline_misses_)) {
+            opus_encoder_->SetComplexity(encoder_controller_.complexity());
+            opus_encoder_->SetBitrate(encoder_controller_.bitrate());
+        }
+#endif
+    });
+}
+
+std::string Application::GetEncoderStatsJson() {
+    auto root = cJSON_Parse(encoder_controller_.GetMetricsJson().c_str());
+    // Frames waiting for the encoder, exhausted counts the frames dropped because it fell behind
+    auto& pool = audio_processor_->output_pool();
+    auto frame_pool = cJSON_CreateObject();
+    cJSON_AddNumberToObject(frame_pool, "frames", pool.frames());
+    cJSON_AddNumberToObject(frame_pool, "in_use", pool.in_use());
+    cJSON_AddNumberToObject(frame_pool, "peak_in_use", pool.peak_in_use());
+    cJSON_AddNumberToObject(frame_pool, "acquired", pool.acquired());
+    cJSON_AddNumberToObject(frame_pool, "exhausted", pool.exhausted());
+    cJSON_AddItemToObject(root, "frame_pool", frame_pool);
+    char* json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
+void Application::CreateEncoder(int frame_duration) {
+    opus_encoder_ = std::make_unique<OpusStreamEncoder>(16000, 1, frame_duration);
+    uplink_frame_duration_ = frame_duration;
+    int complexity;
+    if (aec_mode_ != kAecOff) {
+        ESP_LOGI(TAG, "AEC mode: %d, setting opus encoder complexity to 0", aec_mode_);
+        complexity = 0;
+    } else if (Board::GetInstance().GetBoardType() == "ml307") {
+        ESP_LOGI(TAG, "ML307 board detected, setting opus encoder complexity to 5");
+        complexity = 5;
+    } else {
+        ESP_LOGI(TAG, "WiFi board detected, setting opus encoder complexity to 0");
+        complexity = 0;
+    }
+    opus_encoder_->SetComplexity(complexity);
+#if CONFIG_AUDIO_UPLINK_FEC
+    opus_encoder_->SetInbandFec(true);
+    uplink_loss_percent_ = 0;
+#endif
+#if CONFIG_AUDIO_ENCODER_ADAPTIVE
+    // The static choice is only the starting point, the controller moves it with the CPU and network load
+    encoder_controller_.Reset(frame_duration, complexity, CONFIG_AUDIO_ENCODER_MAX_COMPLEXITY);
+    opus_encoder_->SetComplexity(encoder_controller_.complexity());
+    opus_encoder_->SetBitrate(encoder_controller_.bitrate());
+#endif
+    ESP_LOGI(TAG, "Uplink frame duration: %dms", frame_duration);
+}
+
+// The Audio Input Loop reads the microphone and feeds the wake word and audio processor
+void Application::AudioInputLoop() {
     auto codec = Board::GetInstance().GetAudioCodec();
+    bool capturing = false;
+    uint32_t overflows = 0;
     while (true) {
-        OnAudioInput();
-        if (codec->output_enabled()) {
-            OnAudioOutput();
+        if (!OnAudioInput()) {
+            // Nothing consumes the microphone, sleep until the device state changes
+            capturing = false;
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OPUS_FRAME_DURATION_MS));
+            continue;
+        }
+        // The RX DMA overwrote samples that were not read in time
+        if (capturing && codec->input_overflows() != overflows) {
+            input_deadline_misses_++;
         }
+        overflows = codec->input_overflows();
+        capturing = true;
     }
 }
 
-void Application::OnAudioOutput() {
-    if (busy_decoding_audio_) {
-        return;
+bool Application::TakePrompt() {
+    if (current_prompt_.source || current_prompt_.cached) {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(prompt_mutex_);
+        if (pending_prompts_.empty()) {
+            return false;
+        }
+        current_prompt_ = std::move(pending_prompts_.front());
+        pending_prompts_.pop_front();
+    }
+    // Every prompt is a stream of its own
+    decoder_cache_->ResetState(kAudioMixerPrompt);
+    return true;
+}
+
+// Writes the next frame of the current prompt to the mixer, returns false when no prompt is playing
+bool Application::DecodePrompt() {
+    while (TakePrompt()) {
+        if (current_prompt_.cached) {
+            // Cached prompts are already PCM at the output rate, they skip the decoder
+            auto cached = current_prompt_.cached;
+            int count = std::min<int>(cached->samples - current_prompt_.offset, audio_mixer_->ring(kAudioMixerPrompt).block_samples());
+            WritePlayback(kAudioMixerPrompt, cached->pcm + current_prompt_.offset, count, 0);
+            current_prompt_.offset += count;
+            if (current_prompt_.offset >= cached->samples) {
+                FinishPrompt(current_prompt_);
+            }
+            return true;
+        }
+        AudioPacketView packet;
+        if (current_prompt_.source->Next(packet)) {
+            SetDecodeSampleRate(kAudioMixerPrompt, packet.sample_rate, packet.frame_duration);
+            DecodePacket(kAudioMixerPrompt, packet);
+            return true;
+        }
+        FinishPrompt(current_prompt_);
+    }
+    return false;
+}
+
+void Application::FinishPrompt(PromptPlayback& prompt) {
+    if (prompt.on_done) {
+        Schedule(std::move(prompt.on_done));
+    }
+    prompt.on_done = nullptr;
+    prompt.source.reset();
+    prompt.cached = nullptr;
+    prompt.offset = 0;
+}
+
+AudioJitterResult Application::PopOutputPacket(AudioPacketView& packet) {
+    packet.fec = false;
+    decoding_stream_ = false;
+    // The recorded audio of the testing mode goes before the server stream
+    AudioJitterResult result = kJitterPacket;
+    if (device_state_ == kDeviceStateAudioTesting || !audio_testing_queue_->Pop(decode_packet_)) {
+        decoding_stream_ = true;
+        int64_t push_time_us;
+        while (audio_decode_queue_.Pop(jitter_packet_, &push_time_us)) {
+            jitter_buffer_.Put(jitter_packet_, push_time_us);
+        }
+        bool was_playing = jitter_buffer_.playing();
+        result = jitter_buffer_.Get(decode_packet_, esp_timer_get_time(), GetPlaybackAheadMs());
+        if (result == kJitterEmpty) {
+            return result;
+        }
+        if (!was_playing) {
+            // The queue drained before the stream restarted, it settles at a new level
+            drift_compensator_.Reset();
+        }
     }
 
-    auto now = std::chrono::steady_clock::now();
+    packet.sample_rate = decode_packet_.sample_rate;
+    packet.frame_duration = decode_packet_.frame_duration;
+    packet.timestamp = decode_packet_.timestamp;
+    // A null payload asks the decoder to conceal the missing frame
+    packet.payload = result == kJitterConceal ? nullptr : decode_packet_.payload.data();
+    packet.size = decode_packet_.payload.size();
+    packet.fec = result == kJitterRecover;
+    return result;
+}
+
+// Server audio decoded but not heard yet, in the stream ring and the TX DMA buffers
+int Application::GetPlaybackAheadMs() {
     auto codec = Board::GetInstance().GetAudioCodec();
-    const int max_silence_seconds = 10;
+    // A block holds one frame, longer frames are split into blocks of OPUS_FRAME_DURATION_MS
+    int block_ms = std::min(jitter_buffer_.frame_duration(), OPUS_FRAME_DURATION_MS);
+    uint32_t dma_frames = codec->output_position() - codec->playout_position();
+    return audio_mixer_->ring(kAudioMixerStream).size() * block_ms + dma_frames * 1000 / codec->output_sample_rate();
+}
 
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (audio_decode_queue_.empty()) {
-        // Disable the output if there is no audio data for a long time
-        if (device_state_ == kDeviceStateIdle) {
-            auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - last_output_time_).count();
-            if (duration > max_silence_seconds) {
-                codec->EnableOutput(false);
+// The Audio Decode Loop keeps the mixer rings filled a few frames ahead of the output task
+void Application::AudioDecodeLoop() {
+    auto codec = Board::GetInstance().GetAudioCodec();
+    auto& stream_ring = audio_mixer_->ring(kAudioMixerStream);
+    auto& prompt_ring = audio_mixer_->ring(kAudioMixerPrompt);
+    while (true) {
+        if (decoder_reset_requested_.exchange(false)) {
+            decoder_cache_->ResetState(kAudioMixerStream);
+            drift_compensator_.Reset();
+        }
+        if (!codec->output_enabled()) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OPUS_FRAME_DURATION_MS));
+            continue;
+        }
+
+        // Prompts and the server stream fill rings of their own, neither waits for the other
+        bool decoded = false;
+        if (!prompt_ring.full()) {
+            decoded = DecodePrompt();
+        }
+        int wait_ms = OPUS_FRAME_DURATION_MS;
+        if (!stream_ring.full()) {
+            AudioPacketView packet;
+            if (PopOutputPacket(packet) != kJitterEmpty) {
+                if (!aborted_) {
+                    // Synchronize the sample rate and frame duration
+                    SetDecodeSampleRate(kAudioMixerStream, packet.sample_rate, packet.frame_duration);
+                    DecodePacket(kAudioMixerStream, packet);
+                }
+                decoded = true;
+            } else if (jitter_buffer_.depth() > 0) {
+                // The jitter buffer releases frames by time, poll it while it holds packets
+                wait_ms = AUDIO_DECODE_POLL_MS;
             }
         }
+        if (!decoded) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+        }
+    }
+}
+
+void Application::DecodePacket(AudioMixerSource source, const AudioPacketView& packet) {
+    // A null payload marks a lost frame, let the decoder conceal it or restore it from the next packet
+    int16_t* pcm = decode_pcm_.data();
+    int samples;
+    if (packet.payload == nullptr) {
+        samples = opus_decoder_->Conceal(pcm);
+    } else if (packet.fec) {
+        samples = opus_decoder_->DecodeFec(packet.payload, packet.size, pcm);
+    } else {
+        samples = opus_decoder_->Decode(packet.payload, packet.size, pcm);
+    }
+    if (samples <= 0) {
         return;
     }
 
-    auto packet = std::move(audio_decode_queue_.front());
-    audio_decode_queue_.pop_front();
-    lock.unlock();
-    audio_decode_cv_.notify_all();
+    // Resample if the sample rate is different
+    if (output_resampler_ != nullptr) {
+        int resampled = output_resampler_->GetOutputSamples(samples);
+        output_resampler_->Process(pcm, samples, resample_pcm_.data());
+        pcm = resample_pcm_.data();
+        samples = resampled;
+    }
 
-    // Synchronize the sample rate and frame duration
-    SetDecodeSampleRate(packet.sample_rate, packet.frame_duration);
+    if (source == kAudioMixerStream && decoding_stream_) {
+        // How far the audio queued ahead of the DAC moves from where it settled is the drift between the server and I2S clocks
+        drift_compensator_.UpdateFill(jitter_buffer_.depth() * jitter_buffer_.frame_duration() + GetPlaybackAheadMs());
+        if (drift_pcm_.size() < (size_t)samples + DRIFT_COMPENSATOR_MAX_EXTRA_SAMPLES) {
+            drift_pcm_.resize(samples + DRIFT_COMPENSATOR_MAX_EXTRA_SAMPLES);
+        }
+        samples = drift_compensator_.Process(pcm, samples, drift_pcm_.data());
+        pcm = drift_pcm_.data();
+    }
 
-    busy_decoding_audio_ = true;
-    background_task_->Schedule([this, codec, packet = std::move(packet)]() mutable {
-        busy_decoding_audio_ = false;
-        if (aborted_) {
+    WritePlayback(source, pcm, samples, packet.timestamp);
+}
+
+void Application::WritePlayback(AudioMixerSource source, const int16_t* pcm, int samples, uint32_t timestamp) {
+    // Copy the frame into the blocks of its mixer ring, waiting for the output task when the ring is full
+    auto& ring = audio_mixer_->ring(source);
+    int offset = 0;
+    while (offset < samples) {
+        if (source == kAudioMixerStream && (aborted_ || decoder_reset_requested_)) {
             return;
         }
+        auto block = ring.AcquireWrite();
+        if (block == nullptr) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OPUS_FRAME_DURATION_MS));
+            continue;
+        }
+        int count = std::min<int>(samples - offset, ring.block_samples());
+        memcpy(block->data, pcm + offset, count * sizeof(int16_t));
+        offset += count;
+        block->samples = count;
+        block->timestamp = timestamp;
+        block->frame_end = offset == samples;
+        ring.CommitWrite();
+        xTaskNotifyGive(audio_output_task_handle_);
+    }
+}
 
-        std::vector<int16_t> pcm;
-        if (!opus_decoder_->Decode(std::move(packet.payload), pcm)) {
-            return;
+// The Audio Output Loop writes decoded blocks to the codec at the pace of the I2S DMA
+void Application::AudioOutputLoop() {
+    auto codec = Board::GetInstance().GetAudioCodec();
+    const int max_silence_seconds = 10;
+    bool streaming = false;
+    uint32_t underruns = 0;
+    while (true) {
+        if (output_flush_requested_.exchange(false)) {
+            codec->FlushOutput();
+            streaming = false;
+            xEventGroupSetBits(event_group_, PLAYBACK_FLUSHED_EVENT);
         }
-        // Resample if the sample rate is different
-        if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-            int target_size = output_resampler_.GetOutputSamples(pcm.size());
-            std::vector<int16_t> resampled(target_size);
-            output_resampler_.Process(pcm.data(), pcm.size(), resampled.data());
-            pcm = std::move(resampled);
+
+        if (aborted_) {
+            // Speech that was aborted is not heard, prompts still are
+            audio_mixer_->Clear(kAudioMixerStream);
+        }
+        AudioMixerResult mixed;
+        int samples = audio_mixer_->Mix(mix_pcm_.data(), mix_pcm_.size(), &mixed);
+        if (samples == 0) {
+            // Disable the output if there is no audio data for a long time
+            if (device_state_ == kDeviceStateIdle && codec->output_enabled()) {
+                auto duration = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - last_output_time_).count();
+                if (duration > max_silence_seconds) {
+                    codec->EnableOutput(false);
+                }
+            }
+            // A stream that pauses for a whole frame has ended, it did not miss a deadline
+            if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OPUS_FRAME_DURATION_MS)) == 0) {
+                streaming = false;
+            }
+            continue;
         }
-        codec->OutputData(pcm);
+        // The mixed blocks are free again
+        xTaskNotifyGive(audio_decode_task_handle_);
+
+        if (codec->output_enabled()) {
+            // The TX DMA ran dry between two blocks of the same stream
+            if (streaming && codec->output_underruns() != underruns) {
+                output_deadline_misses_++;
+            }
 #ifdef CONFIG_USE_SERVER_AEC
-        std::lock_guard<std::mutex> lock(timestamp_mutex_);
-        timestamp_queue_.push_back(packet.timestamp);
+            // The server audio in this block is heard once the DMA reaches its position
+            if ((mixed.sources & (1 << kAudioMixerStream)) && mixed.timestamps[kAudioMixerStream] != 0) {
+                playout_timestamps_->Mark(codec->output_position(), samples / codec->output_channels(),
+                    mixed.timestamps[kAudioMixerStream]);
+            }
 #endif
-        last_output_time_ = std::chrono::steady_clock::now();
-    });
+            codec->OutputData(mix_pcm_.data(), samples);
+            if (device_state_ == kDeviceStateSpeaking && (mixed.sources & (1 << kAudioMixerStream))) {
+                LatencyTracer::GetInstance().Mark(kLatencyFirstSampleOutput);
+            }
+            if ((mixed.sources & (1 << kAudioMixerPrompt)) && wake_beep_pending_.exchange(false)) {
+                LatencyTracer::GetInstance().Mark(kLatencyWakeBeep);
+            }
+            underruns = codec->output_underruns();
+            streaming = true;
+            last_output_time_ = std::chrono::steady_clock::now();
+        }
+    }
+}
+
+// Drops all the server audio that has not been heard yet and waits until the speaker is quiet
+void Application::FlushPlayback() {
+    audio_decode_queue_.Clear();
+    jitter_buffer_.Reset();
+    audio_mixer_->Clear(kAudioMixerStream);
+
+    auto start_time = esp_timer_get_time();
+    xEventGroupClearBits(event_group_, PLAYBACK_FLUSHED_EVENT);
+    output_flush_requested_ = true;
+    xTaskNotifyGive(audio_output_task_handle_);
+    auto bits = xEventGroupWaitBits(event_group_, PLAYBACK_FLUSHED_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(120));
+    if (bits & PLAYBACK_FLUSHED_EVENT) {
+        ESP_LOGI(TAG, "Playback flushed in %lld us", esp_timer_get_time() - start_time);
+    } else {
+        ESP_LOGW(TAG, "Playback flush timed out");
+    }
 }
 
-void Application::OnAudioInput() {
+bool Application::OnAudioInput() {
     if (device_state_ == kDeviceStateAudioTesting) {
-        if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+        if (audio_testing_queue_->full()) {
             ExitAudioTestingMode();
-            return;
+            return false;
         }
         std::vector<int16_t> data;
         int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
         if (ReadAudio(data, 16000, samples)) {
-            background_task_->Schedule([this, data = std::move(data)]() mutable {
-                opus_encoder_->Encode(std::move(data), [this](std::vector<uint8_t>&& opus) {
-                    AudioStreamPacket packet;
-                    packet.payload = std::move(opus);
-                    packet.frame_duration = OPUS_FRAME_DURATION_MS;
-                    packet.sample_rate = 16000;
-                    std::lock_guard<std::mutex> lock(mutex_);
-                    audio_testing_queue_.push_back(std::move(packet));
+            background_task_->Schedule([this, data = std::move(data)]() {
+                opus_encoder_->Encode(data, [this](const uint8_t* opus, size_t size) {
+                    audio_testing_queue_->Push(16000, uplink_frame_duration_, 0, opus, size);
                 });
             });
-            return;
+            return true;
         }
     }
 
-    if (wake_word_->IsDetectionRunning()) {
-        std::vector<int16_t> data;
+#if CONFIG_USE_AFE_WAKE_WORD && CONFIG_USE_AUDIO_PROCESSOR
+    // Both feed through AfeFrontEnd, while the processor runs its feed reaches the wake word AFE too
+    bool shared_feed = audio_processor_->IsRunning();
+#else
+    bool shared_feed = false;
+#endif
+    if (!shared_feed && wake_word_->IsDetectionRunning()) {
         int samples = wake_word_->GetFeedSize();
         if (samples > 0) {
-            if (ReadAudio(data, 16000, samples)) {
-                wake_word_->Feed(data);
-                return;
+            if (ReadAudio(input_buffer_, 16000, samples)) {
+                wake_word_->Feed(input_buffer_);
+                return true;
             }
         }
     }
 
     if (audio_processor_->IsRunning()) {
-        std::vector<int16_t> data;
         int samples = audio_processor_->GetFeedSize();
         if (samples > 0) {
-            if (ReadAudio(data, 16000, samples)) {
-                audio_processor_->Feed(data);
-                return;
+            if (ReadAudio(input_buffer_, 16000, samples)) {
+#ifdef CONFIG_USE_SERVER_AEC
+                // The chunk started one chunk of playback ago, stamp it with the server audio leaving the DAC then
+                auto codec = Board::GetInstance().GetAudioCodec();
+                uint32_t frames = input_buffer_.size() / codec->input_channels();
+                uint32_t playout = codec->playout_position() - frames * codec->output_sample_rate() / 16000;
+                capture_timestamps_.Mark(capture_position_, frames, playout_timestamps_->Lookup(playout));
+                capture_position_ += frames;
+#endif
+                audio_processor_->Feed(input_buffer_);
+                return true;
             }
         }
     }
-
-    vTaskDelay(pdMS_TO_TICKS(OPUS_FRAME_DURATION_MS / 2));
+    return false;
 }
 
 bool Application::ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples) {
@@ -907,30 +1346,27 @@ bool Application::ReadAudio(std::vector<int16_t>& data, int sample_rate, int sam
     }
 
     if (codec->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec->input_sample_rate() / sample_rate);
-        if (!codec->InputData(data)) {
+        // The scratch buffers keep their capacity, so only the first frame of a stream allocates
+        input_raw_.resize(samples * codec->input_sample_rate() / sample_rate);
+        if (!codec->InputData(input_raw_)) {
             return false;
         }
         if (codec->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
-            }
+            // The resampler needs contiguous mono input: split, resample each channel, merge into data
+            size_t frames = input_raw_.size() / 2;
+            size_t output_frames = input_resampler_.GetOutputSamples(frames);
+            input_mic_.resize(frames);
+            input_reference_.resize(frames);
+            input_resampled_mic_.resize(output_frames);
+            input_resampled_reference_.resize(output_frames);
+            PcmDeinterleave2(input_raw_.data(), input_mic_.data(), input_reference_.data(), frames);
+            input_resampler_.Process(input_mic_.data(), frames, input_resampled_mic_.data());
+            reference_resampler_.Process(input_reference_.data(), frames, input_resampled_reference_.data());
+            data.resize(output_frames * 2);
+            PcmInterleave2(input_resampled_mic_.data(), input_resampled_reference_.data(), data.data(), output_frames);
         } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
+            data.resize(input_resampler_.GetOutputSamples(input_raw_.size()));
+            input_resampler_.Process(input_raw_.data(), input_raw_.size(), data.data());
         }
     } else {
         data.resize(samples);
@@ -986,7 +1422,6 @@ void Application::SetDeviceState(DeviceState state) {
             display->SetStatus(Lang::Strings::CONNECTING);
             display->SetEmotion("neutral");
             display->SetChatMessage("system", "");
-            timestamp_queue_.clear();
             break;
         case kDeviceStateListening:
             display->SetStatus(Lang::Strings::LISTENING);
@@ -1001,12 +1436,28 @@ void Application::SetDeviceState(DeviceState state) {
                 // Send the start listening command
                 protocol_->SendStartListening(listening_mode_);
                 if (previous_state == kDeviceStateSpeaking) {
-                    audio_decode_queue_.clear();
-                    audio_decode_cv_.notify_all();
-                    // FIXME: Wait for the speaker to empty the buffer
-                    vTaskDelay(pdMS_TO_TICKS(120));
+                    FlushPlayback();
                 }
                 opus_encoder_->ResetState();
+#if CONFIG_AUDIO_UPLINK_DTX
+                // Realtime sessions stay open through long silences, stop sending them
+                uplink_dtx_active_ = listening_mode_ == kListeningModeRealtime;
+                opus_encoder_->SetDtx(uplink_dtx_active_);
+                // Without the AFE VAD (device AEC) only the Opus DTX applies
+                silence_gate_active_ = uplink_dtx_active_ && aec_mode_ != kAecOnDeviceSide;
+                silence_gate_.Reset();
+#endif
+#if CONFIG_AUDIO_ENDPOINTER
+                // Only auto stop turns end on the device, the device AEC runs without the VAD
+                endpointer_active_ = listening_mode_ == kListeningModeAutoStop && aec_mode_ != kAecOnDeviceSide;
+                endpointer_.Reset();
+#endif
+#ifdef CONFIG_USE_SERVER_AEC
+                // The processor starts empty, count both sides from the first frame fed to it
+                capture_timestamps_.Clear();
+                capture_position_ = 0;
+                processed_position_ = 0;
+#endif
                 audio_processor_->Start();
                 wake_word_->StopDetection();
             }
@@ -1029,30 +1480,49 @@ void Application::SetDeviceState(DeviceState state) {
             // Do nothing
             break;
     }
+
+    // Wake the input task, the new state may need the microphone
+    if (audio_input_task_handle_ != nullptr) {
+        xTaskNotifyGive(audio_input_task_handle_);
+    }
 }
 
 void Application::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    opus_decoder_->ResetState();
-    audio_decode_queue_.clear();
-    audio_decode_cv_.notify_all();
+    // The decoder belongs to the decode task, it resets the state before the next frame
+    decoder_reset_requested_ = true;
+    audio_decode_queue_.Clear();
+    jitter_buffer_.Reset();
+    // Prompts are mixed over the stream, they keep playing
+    if (audio_mixer_) {
+        audio_mixer_->Clear(kAudioMixerStream);
+    }
     last_output_time_ = std::chrono::steady_clock::now();
     auto codec = Board::GetInstance().GetAudioCodec();
     codec->EnableOutput(true);
 }
 
-void Application::SetDecodeSampleRate(int sample_rate, int frame_duration) {
-    if (opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
+void Application::SetDecodeSampleRate(AudioMixerSource source, int sample_rate, int frame_duration) {
+    if (opus_decoder_ && decoder_source_ == source && opus_decoder_->sample_rate() == sample_rate &&
+        opus_decoder_->duration_ms() == frame_duration) {
         return;
     }
 
-    opus_decoder_.reset();
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
+    // Prompts and server audio are decoded in turns, each source keeps its own entry in the cache
+    auto& entry = decoder_cache_->Get(sample_rate, frame_duration, source);
+    decoder_source_ = source;
+    opus_decoder_ = entry.decoder.get();
+    output_resampler_ = entry.resampler.get();
 
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-        ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec->output_sample_rate());
-        output_resampler_.Configure(opus_decoder_->sample_rate(), codec->output_sample_rate());
+    // Scratch buffers only grow, switching back to a smaller format reuses them
+    size_t frame_size = opus_decoder_->frame_size();
+    if (decode_pcm_.size() < frame_size) {
+        decode_pcm_.resize(frame_size);
+    }
+    if (output_resampler_ != nullptr) {
+        size_t resampled = output_resampler_->GetOutputSamples(frame_size);
+        if (resample_pcm_.size() < resampled) {
+            resample_pcm_.resize(resampled);
+        }
     }
 }
 
@@ -12,21 +12,36 @@
 #include <vector>
 #include <condition_variable>
 #include <memory>
+#include <atomic>
 
-#include <opus_encoder.h>
-#include <opus_decoder.h>
-#include <opus_resampler.h>
 
 #include "protocol.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "ota.h"
+#endif
 #include "background_task.h"
 #include "audio_processor.h"
 #include "wake_word.h"
 #include "audio_debugger.h"
+#include "audio_packet_ring.h"
+#include "audio_jitter_buffer.h"
+#include "audio_mixer.h"
+#include "audio_timestamp_map.h"
+#include "audio_packet_source.h"
+#include "audio_prompt_cache.h"
+#include "opus_stream_decoder.h"
+#include "opus_decoder_cache.h"
+#include "polyphase_resampler.h"
+#include "drift_compensator.h"
+#include "opus_stream_encoder.h"
+#include "opus_encoder_controller.h"
+#include "silence_gate.h"
+#include "endpointer.h"
 
 #define SCHEDULE_EVENT (1 << 0)
 #define SEND_AUDIO_EVENT (1 << 1)
 #define CHECK_NEW_VERSION_DONE_EVENT (1 << 2)
+#define PLAYBACK_FLUSHED_EVENT (1 << 3)
 
 enum AecMode {
     kAecOff,
@@ -49,8 +64,14 @@ enum DeviceState {
 };
 
 #define OPUS_FRAME_DURATION_MS 60
-#define MAX_AUDIO_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+#define AUDIO_QUEUE_DURATION_MS 2400
+#define MAX_AUDIO_PACKETS_IN_QUEUE (AUDIO_QUEUE_DURATION_MS / OPUS_FRAME_DURATION_MS)
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
+// Decoded frames buffered ahead of the I2S output
+#define AUDIO_PLAYBACK_AHEAD_FRAMES 4
+// Longest block the output task mixes before writing it, bounds how late a prompt can start
+#define AUDIO_MIXER_PERIOD_MS 20
+#define AUDIO_DECODE_POLL_MS 10
 
 class Application {
 public:
@@ -76,12 +97,14 @@ public:
     void UpdateIotStates();
     void Reboot();
     void WakeWordInvoke(const std::string& wake_word);
-    void PlaySound(const std::string_view& sound);
+    // Queues a P3 asset for playback, on_done runs on the main loop once it is decoded or discarded
+    void PlaySound(const std::string_view& sound, std::function<void()> on_done = nullptr);
     bool CanEnterSleepMode();
     void SendMcpMessage(const std::string& payload);
     void SetAecMode(AecMode mode);
     AecMode GetAecMode() const { return aec_mode_; }
     BackgroundTask* GetBackgroundTask() const { return background_task_; }
+    std::string GetEncoderStatsJson();
 
 private:
     Application();
@@ -102,41 +125,114 @@ private:
     bool has_server_time_ = false;
     bool aborted_ = false;
     bool voice_detected_ = false;
-    bool busy_decoding_audio_ = false;
     int clock_ticks_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
 
     // Audio encode / decode
-    TaskHandle_t audio_loop_task_handle_ = nullptr;
+    TaskHandle_t audio_input_task_handle_ = nullptr;
+    TaskHandle_t audio_decode_task_handle_ = nullptr;
+    TaskHandle_t audio_output_task_handle_ = nullptr;
     BackgroundTask* background_task_ = nullptr;
     std::chrono::steady_clock::time_point last_output_time_;
-    std::list<AudioStreamPacket> audio_send_queue_;
-    std::list<AudioStreamPacket> audio_decode_queue_;
-    std::condition_variable audio_decode_cv_;
-    std::list<AudioStreamPacket> audio_testing_queue_;
-
-    // 新增：用于维护音频包的timestamp队列
-    std::list<uint32_t> timestamp_queue_;
-    std::mutex timestamp_mutex_;
-
-    std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
-    std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
-
-    OpusResampler input_resampler_;
-    OpusResampler reference_resampler_;
-    OpusResampler output_resampler_;
+    // Lock-free rings, each one has exactly one producer and one consumer task
+    std::unique_ptr<AudioPacketRing> audio_send_queue_;                 // encoder -> main loop, sized for the uplink frames
+    AudioPacketRing audio_decode_queue_{MAX_AUDIO_PACKETS_IN_QUEUE};    // protocol -> audio loop
+    std::unique_ptr<AudioPacketRing> audio_testing_queue_;              // encoder -> audio loop
+
+    // Prompts are played from their flash assets, PlaySound only queues a source
+    struct PromptPlayback {
+        std::unique_ptr<AudioPacketSource> source;
+        const AudioPromptCache::Entry* cached = nullptr;   // Set instead of source on a cache hit
+        size_t offset = 0;                                  // Samples of the cached PCM already played
+        std::function<void()> on_done;
+    };
+    std::mutex prompt_mutex_;
+    std::list<PromptPlayback> pending_prompts_;     // Guarded by prompt_mutex_
+    PromptPlayback current_prompt_;                 // Owned by the decode task
+    std::unique_ptr<AudioPromptCache> prompt_cache_;
+    AudioJitterBuffer jitter_buffer_;   // Reorders the server stream, owned by the decode task
+    AudioStreamPacket jitter_packet_;
+    AudioStreamPacket send_packet_;
+    AudioStreamPacket decode_packet_;
+    std::unique_ptr<AudioMixer> audio_mixer_;       // decode task -> output task, one ring per source
+    std::vector<int16_t> mix_pcm_;
+    std::vector<int16_t> decode_pcm_;
+    std::vector<int16_t> resample_pcm_;
+    std::atomic<bool> decoder_reset_requested_{false};
+    std::atomic<bool> output_flush_requested_{false};
+    std::atomic<bool> wake_beep_pending_{false};    // Mark the first output of the wake word beep
+    uint32_t input_deadline_misses_ = 0;
+    uint32_t output_deadline_misses_ = 0;
+
+#ifdef CONFIG_USE_SERVER_AEC
+    // Server AEC reference: output position -> server timestamp, then captured frame -> server timestamp
+    std::unique_ptr<AudioTimestampMap> playout_timestamps_;
+    AudioTimestampMap capture_timestamps_{16000};
+    std::atomic<uint32_t> capture_position_{0};     // Frames fed to the audio processor
+    std::atomic<uint32_t> processed_position_{0};   // Frames the audio processor returned
+#endif
+
+    std::unique_ptr<OpusStreamEncoder> opus_encoder_;
+    OpusEncoderController encoder_controller_;
+#if CONFIG_AUDIO_UPLINK_FEC
+    int uplink_loss_percent_ = 0;
+#endif
+#if CONFIG_AUDIO_UPLINK_DTX
+    std::atomic<bool> uplink_dtx_active_{false};
+    bool silence_gate_active_ = false;
+    SilenceGate silence_gate_{16000, CONFIG_AUDIO_UPLINK_DTX_HANGOVER_MS, CONFIG_AUDIO_UPLINK_DTX_PRE_ROLL_MS};
+#endif
+#if CONFIG_AUDIO_ENDPOINTER
+    std::atomic<bool> endpointer_active_{false};
+    Endpointer endpointer_{16000, CONFIG_AUDIO_ENDPOINTER_HANGOVER_MS, CONFIG_AUDIO_ENDPOINTER_MIN_SPEECH_MS,
+        CONFIG_AUDIO_ENDPOINTER_MAX_UTTERANCE_MS};
+#endif
+    int uplink_frame_duration_ = OPUS_FRAME_DURATION_MS;
+    // The decoder and resampler of the current stream format, owned by decoder_cache_
+    std::unique_ptr<OpusDecoderCache> decoder_cache_;
+    AudioMixerSource decoder_source_ = kAudioMixerStream;
+    OpusStreamDecoder* opus_decoder_ = nullptr;
+    PolyphaseResampler* output_resampler_ = nullptr;
+    // Server audio is played through the drift compensator, prompts are not
+    DriftCompensator drift_compensator_;
+    bool decoding_stream_ = false;
+    std::vector<int16_t> drift_pcm_;
+
+    // Capture scratch buffers, reused for every frame read by the input task
+    std::vector<int16_t> input_buffer_;
+    std::vector<int16_t> input_raw_;
+    std::vector<int16_t> input_mic_;
+    std::vector<int16_t> input_reference_;
+    std::vector<int16_t> input_resampled_mic_;
+    std::vector<int16_t> input_resampled_reference_;
+
+    PolyphaseResampler input_resampler_;
+    PolyphaseResampler reference_resampler_;
 
     void MainEventLoop();
-    void OnAudioInput();
-    void OnAudioOutput();
+    bool OnAudioInput();
+    void AudioDecodeLoop();
+    void AudioOutputLoop();
+    void CreateEncoder(int frame_duration);
+    void EncodeUplinkAudio(std::vector<int16_t>&& data, uint32_t timestamp, bool restart = false);
+    void FlushPlayback();
+    void DecodePacket(AudioMixerSource source, const AudioPacketView& packet);
+    void WritePlayback(AudioMixerSource source, const int16_t* pcm, int samples, uint32_t timestamp);
+    AudioJitterResult PopOutputPacket(AudioPacketView& packet);
+    int GetPlaybackAheadMs();
+    bool TakePrompt();
+    bool DecodePrompt();
+    void FinishPrompt(PromptPlayback& prompt);
     bool ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
-    void SetDecodeSampleRate(int sample_rate, int frame_duration);
+    void SetDecodeSampleRate(AudioMixerSource source, int sample_rate, int frame_duration);
+#if !CONFIG_IDF_TARGET_LINUX
     void CheckNewVersion(Ota& ota);
+#endif
     void ShowActivationCode(const std::string& code, const std::string& message);
     void OnClockTimer();
     void SetListeningMode(ListeningMode mode);
-    void AudioLoop();
+    void AudioInputLoop();
     void EnterAudioTestingMode();
     void ExitAudioTestingMode();
 };
@@ -3,8 +3,14 @@
 #include "settings.h"
 
 #include <esp_log.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
 #include <cstring>
+#include <algorithm>
+#if !CONFIG_IDF_TARGET_LINUX
 #include <driver/i2s_common.h>
+#include <esp_rom_sys.h>
+#endif
 
 #define TAG "AudioCodec"
 
@@ -15,7 +21,62 @@ AudioCodec::~AudioCodec() {
 }
 
 void AudioCodec::OutputData(std::vector<int16_t>& data) {
-    Write(data.data(), data.size());
+    OutputData(data.data(), data.size());
+}
+
+void AudioCodec::OutputData(const int16_t* data, size_t samples) {
+    Write(data, samples);
+    output_position_ = output_position_ + samples / output_channels_;
+    if (samples >= (size_t)output_channels_) {
+        memcpy(last_output_, data + samples - output_channels_, output_channels_ * sizeof(int16_t));
+    }
+}
+
+int AudioCodec::Preload(const int16_t* data, int samples) {
+#if CONFIG_IDF_TARGET_LINUX
+    return 0;
+#else
+    size_t bytes_loaded = 0;
+    ESP_ERROR_CHECK_WITHOUT_ABORT(i2s_channel_preload_data(tx_handle_, data, samples * sizeof(int16_t), &bytes_loaded));
+    return bytes_loaded / sizeof(int16_t);
+#endif
+}
+
+void AudioCodec::FlushOutput() {
+#if CONFIG_IDF_TARGET_LINUX
+    // There is no DMA holding written audio, the output is already quiet
+    memset(last_output_, 0, sizeof(last_output_));
+    SyncPlayoutPosition();
+#else
+    if (tx_handle_ == nullptr || !output_enabled_) {
+        return;
+    }
+
+    // Fade from the last written frame to zero so the cut does not click
+    int frames = output_sample_rate_ * AUDIO_CODEC_FLUSH_RAMP_MS / 1000;
+    flush_buffer_.resize(frames * output_channels_);
+    auto pcm = flush_buffer_.data();
+    for (int i = 0; i < frames; i++) {
+        for (int ch = 0; ch < output_channels_; ch++) {
+            pcm[i * output_channels_ + ch] = last_output_[ch] * (frames - 1 - i) / frames;
+        }
+    }
+    memset(last_output_, 0, sizeof(last_output_));
+
+    // Re-enabling the channel restarts the DMA from its first descriptor, overwrite all of them
+    // with the ramp followed by silence so nothing stale is played
+    ESP_ERROR_CHECK_WITHOUT_ABORT(i2s_channel_disable(tx_handle_));
+    int loaded = Preload(pcm, flush_buffer_.size());
+    std::fill(flush_buffer_.begin(), flush_buffer_.end(), 0);
+    while (loaded > 0) {
+        loaded = Preload(pcm, flush_buffer_.size());
+    }
+    ESP_ERROR_CHECK_WITHOUT_ABORT(i2s_channel_enable(tx_handle_));
+    SyncPlayoutPosition();
+
+    // The ramp is shorter than a tick at 100 Hz, vTaskDelay() would not wait at all
+    esp_rom_delay_us(AUDIO_CODEC_FLUSH_RAMP_MS * 1000);
+#endif
 }
 
 bool AudioCodec::InputData(std::vector<int16_t>& data) {
@@ -26,6 +87,69 @@ bool AudioCodec::InputData(std::vector<int16_t>& data) {
     return false;
 }
 
+#if !CONFIG_IDF_TARGET_LINUX
+static bool IRAM_ATTR OnInputOverflow(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx) {
+    (*(volatile uint32_t*)user_ctx)++;
+    return false;
+}
+
+bool IRAM_ATTR AudioCodec::OnOutputUnderrun(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx) {
+    auto codec = (AudioCodec*)user_ctx;
+    codec->output_underruns_ = codec->output_underruns_ + 1;
+    return false;
+}
+
+bool IRAM_ATTR AudioCodec::OnOutputSent(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx) {
+    auto codec = (AudioCodec*)user_ctx;
+    // Audio written while a buffer plays goes into the buffers after it, so the buffer that just
+    // finished held audio written before the previous one finished, or silence once that ran out
+    uint32_t played = codec->played_position_;
+    uint32_t queued = codec->queued_position_ - played;
+    codec->played_position_ = played + std::min<uint32_t>(queued, AUDIO_CODEC_DMA_FRAME_NUM);
+    codec->queued_position_ = codec->output_position_;
+    codec->sent_time_us_ = (uint32_t)esp_timer_get_time();
+    return false;
+}
+#endif
+
+uint32_t AudioCodec::playout_position() const {
+    uint32_t played, queued, sent_time_us;
+    do {
+        played = played_position_;
+        queued = queued_position_;
+        sent_time_us = sent_time_us_;
+    } while (played != played_position_);
+
+    // Frames of the buffer playing now, the buffer holds no more than was queued for it
+    uint32_t elapsed_us = (uint32_t)esp_timer_get_time() - sent_time_us;
+    uint32_t buffer_us = AUDIO_CODEC_DMA_FRAME_NUM * 1000000ULL / output_sample_rate_;
+    uint32_t progress = (uint64_t)std::min(elapsed_us, buffer_us) * output_sample_rate_ / 1000000;
+    return played + std::min(progress, queued - played);
+}
+
+void AudioCodec::SyncPlayoutPosition() {
+    // Whatever was written before is gone from the DMA
+    played_position_ = output_position_;
+    queued_position_ = output_position_;
+    sent_time_us_ = (uint32_t)esp_timer_get_time();
+}
+
+void AudioCodec::RegisterDmaCallbacks() {
+#if !CONFIG_IDF_TARGET_LINUX
+    if (rx_handle_ != nullptr) {
+        i2s_event_callbacks_t callbacks = {};
+        callbacks.on_recv_q_ovf = OnInputOverflow;
+        ESP_ERROR_CHECK_WITHOUT_ABORT(i2s_channel_register_event_callback(rx_handle_, &callbacks, (void*)&input_overflows_));
+    }
+    if (tx_handle_ != nullptr) {
+        i2s_event_callbacks_t callbacks = {};
+        callbacks.on_sent = OnOutputSent;
+        callbacks.on_send_q_ovf = OnOutputUnderrun;
+        ESP_ERROR_CHECK_WITHOUT_ABORT(i2s_channel_register_event_callback(tx_handle_, &callbacks, this));
+    }
+#endif
+}
+
 void AudioCodec::Start() {
     Settings settings("audio", false);
     output_volume_ = settings.GetInt("output_volume", output_volume_);
@@ -34,8 +158,11 @@ void AudioCodec::Start() {
         output_volume_ = 10;
     }
 
+#if !CONFIG_IDF_TARGET_LINUX
+    RegisterDmaCallbacks();
     ESP_ERROR_CHECK(i2s_channel_enable(tx_handle_));
     ESP_ERROR_CHECK(i2s_channel_enable(rx_handle_));
+#endif
 
     EnableInput(true);
     EnableOutput(true);
@@ -63,5 +190,6 @@ void AudioCodec::EnableOutput(bool enable) {
         return;
     }
     output_enabled_ = enable;
+    SyncPlayoutPosition();
     ESP_LOGI(TAG, "Set output enable to %s", enable ? "true" : "false");
 }
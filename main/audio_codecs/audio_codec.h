@@ -3,7 +3,9 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#if !CONFIG_IDF_TARGET_LINUX
 #include <driver/i2s_std.h>
+#endif
 
 #include <vector>
 #include <string>
@@ -14,6 +16,7 @@
 #define AUDIO_CODEC_DMA_DESC_NUM 6
 #define AUDIO_CODEC_DMA_FRAME_NUM 240
 #define AUDIO_CODEC_DEFAULT_MIC_GAIN 30.0
+#define AUDIO_CODEC_FLUSH_RAMP_MS 4
 
 class AudioCodec {
 public:
@@ -25,7 +28,11 @@ public:
     virtual void EnableOutput(bool enable);
 
     virtual void OutputData(std::vector<int16_t>& data);
+    virtual void OutputData(const int16_t* data, size_t samples);
     virtual bool InputData(std::vector<int16_t>& data);
+    // Drops the audio queued in the TX DMA and ramps to silence, returns once the output is quiet.
+    // Must be called from the task that calls OutputData()
+    virtual void FlushOutput();
     virtual void Start();
 
     inline bool duplex() const { return duplex_; }
@@ -37,10 +44,19 @@ public:
     inline int output_volume() const { return output_volume_; }
     inline bool input_enabled() const { return input_enabled_; }
     inline bool output_enabled() const { return output_enabled_; }
+    inline uint32_t input_overflows() const { return input_overflows_; }
+    inline uint32_t output_underruns() const { return output_underruns_; }
+    // Output frames passed to Write() since the codec was created, wraps around
+    inline uint32_t output_position() const { return output_position_; }
+    // Output frame leaving the DAC now, on the same scale as output_position().
+    // Must be called from a task, it interpolates between two DMA interrupts
+    uint32_t playout_position() const;
 
 protected:
+#if !CONFIG_IDF_TARGET_LINUX
     i2s_chan_handle_t tx_handle_ = nullptr;
     i2s_chan_handle_t rx_handle_ = nullptr;
+#endif
 
     bool duplex_ = false;
     bool input_reference_ = false;
@@ -52,8 +68,32 @@ protected:
     int output_channels_ = 1;
     int output_volume_ = 70;
 
+    // Counted from the I2S DMA interrupts
+    volatile uint32_t input_overflows_ = 0;     // RX buffers overwritten before they were read
+    volatile uint32_t output_underruns_ = 0;    // TX ran out of written buffers
+    // Playout clock, every sent DMA buffer advances it by AUDIO_CODEC_DMA_FRAME_NUM written frames
+    volatile uint32_t output_position_ = 0;
+    volatile uint32_t played_position_ = 0;     // Frames of written audio the DMA has sent
+    volatile uint32_t queued_position_ = 0;     // output_position_ when the previous buffer was sent
+    volatile uint32_t sent_time_us_ = 0;
+    int16_t last_output_[2] = {0, 0};           // Last frame passed to Write(), where the flush ramp starts
+    std::vector<int16_t> flush_buffer_;         // The flush ramp, then the silence preloaded after it
+
     virtual int Read(int16_t* dest, int samples) = 0;
     virtual int Write(const int16_t* data, int samples) = 0;
+    // Loads samples into the TX DMA buffers while the channel is disabled, in the same format as Write().
+    // Returns the number of samples loaded, 0 once the DMA buffers are full
+    virtual int Preload(const int16_t* data, int samples);
+    // Must be called before the channels are enabled
+    void RegisterDmaCallbacks();
+    // Lines the playout clock up with the written audio after the TX DMA was restarted
+    void SyncPlayoutPosition();
+
+#if !CONFIG_IDF_TARGET_LINUX
+private:
+    static bool OnOutputSent(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx);
+    static bool OnOutputUnderrun(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx);
+#endif
 };
 
 #endif // _AUDIO_CODEC_H
@@ -0,0 +1,132 @@
+#include "file_audio_codec.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <cstring>
+
+#define TAG "FileAudioCodec"
+
+FileAudioCodec::FileAudioCodec(const char* input_path, const char* output_path, int input_sample_rate, int output_sample_rate) {
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+    duplex_ = true;
+
+    if (!OpenWav(input_path)) {
+        // Keep running with silence as input, playback can still be tested
+        input_ended_ = true;
+    }
+    output_file_ = fopen(output_path, "wb");
+    if (output_file_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to open output file %s", output_path);
+    }
+}
+
+FileAudioCodec::~FileAudioCodec() {
+    if (input_file_ != nullptr) {
+        fclose(input_file_);
+    }
+    if (output_file_ != nullptr) {
+        fclose(output_file_);
+    }
+}
+
+bool FileAudioCodec::OpenWav(const char* path) {
+    input_file_ = fopen(path, "rb");
+    if (input_file_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to open input file %s", path);
+        return false;
+    }
+
+    char riff[12];
+    if (fread(riff, 1, sizeof(riff), input_file_) != sizeof(riff) || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        ESP_LOGE(TAG, "%s is not a WAV file", path);
+        return false;
+    }
+
+    // Walk the chunks until the data chunk, the format must be 16-bit PCM at the input sample rate
+    bool format_ok = false;
+    while (true) {
+        char id[4];
+        uint32_t size;
+        if (fread(id, 1, 4, input_file_) != 4 || fread(&size, 4, 1, input_file_) != 1) {
+            ESP_LOGE(TAG, "No data chunk in %s", path);
+            return false;
+        }
+        if (memcmp(id, "fmt ", 4) == 0) {
+            uint16_t format, channels, block_align, bits;
+            uint32_t sample_rate, byte_rate;
+            if (size < 16 || fread(&format, 2, 1, input_file_) != 1 || fread(&channels, 2, 1, input_file_) != 1 ||
+                fread(&sample_rate, 4, 1, input_file_) != 1 || fread(&byte_rate, 4, 1, input_file_) != 1 ||
+                fread(&block_align, 2, 1, input_file_) != 1 || fread(&bits, 2, 1, input_file_) != 1) {
+                ESP_LOGE(TAG, "Truncated fmt chunk in %s", path);
+                return false;
+            }
+            if (format != 1 || bits != 16 || channels < 1 || channels > 2 || (int)sample_rate != input_sample_rate_) {
+                ESP_LOGE(TAG, "%s must be 16-bit PCM, 1 or 2 channels, %d Hz (format %u, %u bits, %u channels, %lu Hz)",
+                    path, input_sample_rate_, format, bits, channels, sample_rate);
+                return false;
+            }
+            input_channels_ = channels;
+            input_reference_ = channels == 2;
+            format_ok = true;
+            fseek(input_file_, size - 16 + (size & 1), SEEK_CUR);
+        } else if (memcmp(id, "data", 4) == 0) {
+            if (!format_ok) {
+                ESP_LOGE(TAG, "Data chunk before fmt chunk in %s", path);
+                return false;
+            }
+            ESP_LOGI(TAG, "Input %s: %d Hz, %d channels, %lu ms", path, input_sample_rate_, input_channels_,
+                (uint32_t)(size / (2 * input_channels_) * 1000ULL / input_sample_rate_));
+            return true;
+        } else {
+            fseek(input_file_, size + (size & 1), SEEK_CUR);
+        }
+    }
+}
+
+void FileAudioCodec::Start() {
+    // There are no I2S channels to enable
+    EnableInput(true);
+    EnableOutput(true);
+    ESP_LOGI(TAG, "Audio codec started");
+}
+
+// Blocks until the given number of frames would have been clocked by a real codec
+void FileAudioCodec::Pace(int64_t& next_time_us, int frames, int sample_rate) {
+    auto now = esp_timer_get_time();
+    if (next_time_us == 0 || now - next_time_us > 100000) {
+        // First call, or the caller stalled, start again from now instead of bursting to catch up
+        next_time_us = now;
+    }
+    next_time_us += (int64_t)frames * 1000000 / sample_rate;
+    if (next_time_us > now) {
+        vTaskDelay(pdMS_TO_TICKS((next_time_us - now) / 1000));
+    }
+}
+
+int FileAudioCodec::Read(int16_t* dest, int samples) {
+    size_t read = 0;
+    if (input_enabled_ && !input_ended_) {
+        read = fread(dest, sizeof(int16_t), samples, input_file_);
+        if (read < (size_t)samples) {
+            ESP_LOGI(TAG, "End of input file, feeding silence");
+            input_ended_ = true;
+        }
+    }
+    memset(dest + read, 0, (samples - read) * sizeof(int16_t));
+    Pace(next_read_time_us_, samples / input_channels_, input_sample_rate_);
+    return samples;
+}
+
+int FileAudioCodec::Write(const int16_t* data, int samples) {
+    if (output_enabled_ && output_file_ != nullptr) {
+        fwrite(data, sizeof(int16_t), samples, output_file_);
+    }
+    Pace(next_write_time_us_, samples / output_channels_, output_sample_rate_);
+    // Paced audio is heard once it is written, there is no DMA interrupt to advance the playout clock
+    played_position_ = output_position_ + samples / output_channels_;
+    queued_position_ = played_position_;
+    sent_time_us_ = (uint32_t)esp_timer_get_time();
+    return samples;
+}
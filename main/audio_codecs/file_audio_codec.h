@@ -0,0 +1,35 @@
+#ifndef _FILE_AUDIO_CODEC_H
+#define _FILE_AUDIO_CODEC_H
+
+#include "audio_codec.h"
+
+#include <cstdio>
+
+/*
+ * Plays the role of the microphone and speaker on hosts without I2S.
+ * The input is a 16-bit PCM WAV file, a stereo file is read as microphone + reference.
+ * The output is written as raw 16-bit mono PCM. Both sides are paced to real time,
+ * so the application sees the same timing as with a DMA driven codec.
+ */
+class FileAudioCodec : public AudioCodec {
+public:
+    FileAudioCodec(const char* input_path, const char* output_path, int input_sample_rate, int output_sample_rate);
+    virtual ~FileAudioCodec();
+
+    virtual void Start() override;
+
+private:
+    FILE* input_file_ = nullptr;
+    FILE* output_file_ = nullptr;
+    bool input_ended_ = false;
+    int64_t next_read_time_us_ = 0;
+    int64_t next_write_time_us_ = 0;
+
+    bool OpenWav(const char* path);
+    void Pace(int64_t& next_time_us, int frames, int sample_rate);
+
+    virtual int Read(int16_t* dest, int samples) override;
+    virtual int Write(const int16_t* data, int samples) override;
+};
+
+#endif // _FILE_AUDIO_CODEC_H
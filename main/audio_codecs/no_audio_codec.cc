@@ -1,7 +1,7 @@
 #include "no_audio_codec.h"
+#include "pcm_convert.h"
 
 #include <esp_log.h>
-#include <cmath>
 #include <cstring>
 
 #define TAG "NoAudioCodec"
@@ -336,59 +336,53 @@ NoAudioCodecSimplexPdm::NoAudioCodecSimplexPdm(int input_sample_rate, int output
 }
 
 int NoAudioCodec::Write(const int16_t* data, int samples) {
-    std::vector<int32_t> buffer(samples);
-
-    // output_volume_: 0-100
-    // volume_factor_: 0-65536
-    int32_t volume_factor = pow(double(output_volume_) / 100.0, 2) * 65536;
-    for (int i = 0; i < samples; i++) {
-        int64_t temp = int64_t(data[i]) * volume_factor; // 使用 int64_t 进行乘法运算
-        if (temp > INT32_MAX) {
-            buffer[i] = INT32_MAX;
-        } else if (temp < INT32_MIN) {
-            buffer[i] = INT32_MIN;
-        } else {
-            buffer[i] = static_cast<int32_t>(temp);
-        }
+    if (write_slots_.size() < (size_t)samples) {
+        write_slots_.resize(samples);
     }
+    PcmToSlot32(data, write_slots_.data(), samples, PcmVolumeToGain(output_volume_));
 
     size_t bytes_written;
-    ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, buffer.data(), samples * sizeof(int32_t), &bytes_written, portMAX_DELAY));
+    ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, write_slots_.data(), samples * sizeof(int32_t), &bytes_written, portMAX_DELAY));
     return bytes_written / sizeof(int32_t);
 }
 
+int NoAudioCodec::Preload(const int16_t* data, int samples) {
+    // Same 32-bit slots and volume scaling as Write()
+    if (write_slots_.size() < (size_t)samples) {
+        write_slots_.resize(samples);
+    }
+    PcmToSlot32(data, write_slots_.data(), samples, PcmVolumeToGain(output_volume_));
+
+    size_t bytes_loaded = 0;
+    ESP_ERROR_CHECK_WITHOUT_ABORT(i2s_channel_preload_data(tx_handle_, write_slots_.data(), samples * sizeof(int32_t), &bytes_loaded));
+    return bytes_loaded / sizeof(int32_t);
+}
+
 int NoAudioCodec::Read(int16_t* dest, int samples) {
     size_t bytes_read;
 
-    std::vector<int32_t> bit32_buffer(samples);
-    if (i2s_channel_read(rx_handle_, bit32_buffer.data(), samples * sizeof(int32_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
+    if (read_slots_.size() < (size_t)samples) {
+        read_slots_.resize(samples);
+    }
+    if (i2s_channel_read(rx_handle_, read_slots_.data(), samples * sizeof(int32_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
         ESP_LOGE(TAG, "Read Failed!");
         return 0;
     }
 
     samples = bytes_read / sizeof(int32_t);
-    for (int i = 0; i < samples; i++) {
-        int32_t value = bit32_buffer[i] >> 12;
-        dest[i] = (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
-    }
+    PcmFromSlot32(read_slots_.data(), dest, samples, 12);
     return samples;
 }
 
 int NoAudioCodecSimplexPdm::Read(int16_t* dest, int samples) {
     size_t bytes_read;
 
-    // PDM 解调后的数据位宽为 16 位
-    std::vector<int16_t> bit16_buffer(samples);
-    if (i2s_channel_read(rx_handle_, bit16_buffer.data(), samples * sizeof(int16_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
+    // PDM 解调后的数据位宽为 16 位，直接读入目标缓冲区
+    if (i2s_channel_read(rx_handle_, dest, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
         ESP_LOGE(TAG, "Read Failed!");
         return 0;
     }
 
     // 计算实际读取的样本数
-    samples = bytes_read / sizeof(int16_t);
-
-    // 将 16 位数据直接复制到目标缓冲区
-    memcpy(dest, bit16_buffer.data(), samples * sizeof(int16_t));
-
-    return samples;
+    return bytes_read / sizeof(int16_t);
 }
@@ -5,10 +5,16 @@
 
 #include <driver/gpio.h>
 #include <driver/i2s_pdm.h>
+#include <vector>
 
 class NoAudioCodec : public AudioCodec {
 private:
+    // 32-bit slot buffers kept across calls, Write and Preload both run on the output side
+    std::vector<int32_t> write_slots_;
+    std::vector<int32_t> read_slots_;
+
     virtual int Write(const int16_t* data, int samples) override;
+    virtual int Preload(const int16_t* data, int samples) override;
     virtual int Read(int16_t* dest, int samples) override;
 
 public:
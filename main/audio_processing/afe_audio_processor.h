@@ -9,9 +9,11 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
 
 #include "audio_processor.h"
 #include "audio_codec.h"
+#include "afe_front_end.h"
 
 class AfeAudioProcessor : public AudioProcessor {
 public:
@@ -24,20 +26,19 @@ public:
     void Stop() override;
     bool IsRunning() override;
     void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) override;
+    AudioFramePool& output_pool() override { return *output_pool_; }
     void OnVadStateChange(std::function<void(bool speaking)> callback) override;
     size_t GetFeedSize() override;
     void EnableDeviceAec(bool enable) override;
 
 private:
-    EventGroupHandle_t event_group_ = nullptr;
-    esp_afe_sr_iface_t* afe_iface_ = nullptr;
-    esp_afe_sr_data_t* afe_data_ = nullptr;
     std::function<void(std::vector<int16_t>&& data)> output_callback_;
+    std::unique_ptr<AudioFramePool> output_pool_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     AudioCodec* codec_ = nullptr;
     bool is_speaking_ = false;
 
-    void AudioProcessorTask();
+    void OnFetch(afe_fetch_result_t* res);
 };
 
 #endif 
\ No newline at end of file
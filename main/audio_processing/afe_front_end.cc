@@ -0,0 +1,276 @@
+#include "afe_front_end.h"
+
+#include <esp_log.h>
+#include <model_path.h>
+#include <esp_nsn_models.h>
+
+#define TAG "AfeFrontEnd"
+
+AfeFrontEnd::AfeFrontEnd() {
+    event_group_ = xEventGroupCreate();
+}
+
+AfeFrontEnd::~AfeFrontEnd() {
+    for (int i = 0; i < kAfeConsumerCount; i++) {
+        if (afe_data_[i] != nullptr) {
+            afe_iface_[i]->destroy(afe_data_[i]);
+        }
+    }
+    vEventGroupDelete(event_group_);
+}
+
+void AfeFrontEnd::Initialize(AudioCodec* codec) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (codec_ != nullptr) {
+        return;
+    }
+    codec_ = codec;
+
+    auto start_time = esp_timer_get_time();
+    models_ = esp_srmodel_init("model");
+    if (models_ == nullptr || models_->num == -1) {
+        ESP_LOGE(TAG, "Failed to initialize models");
+        models_ = nullptr;
+    }
+
+#if CONFIG_USE_AFE_WAKE_WORD
+    CreateDetection();
+#endif
+#if CONFIG_USE_AUDIO_PROCESSOR
+    CreateCommunication();
+#endif
+    ESP_LOGI(TAG, "AFE created in %lld ms, wakenet %d, detection aec %d, communication aec %d",
+        (esp_timer_get_time() - start_time) / 1000, wakenet_init_, detection_aec_init_, communication_aec_init_);
+
+    // Both consumers are fed the same chunks
+    auto& detection = afe_data_[kAfeConsumerWakeWord];
+    auto& communication = afe_data_[kAfeConsumerProcessor];
+    if (detection != nullptr && communication != nullptr &&
+        afe_iface_[kAfeConsumerWakeWord]->get_feed_chunksize(detection) !=
+        afe_iface_[kAfeConsumerProcessor]->get_feed_chunksize(communication)) {
+        ESP_LOGE(TAG, "The SR and VC AFE take different feed sizes");
+    }
+
+    // Nothing is enabled yet, every stage starts off
+    UpdateStages();
+
+    if (detection != nullptr) {
+        xTaskCreate([](void* arg) {
+            auto this_ = (AfeFrontEnd*)arg;
+            this_->FetchTask(kAfeConsumerWakeWord);
+            vTaskDelete(NULL);
+        }, "audio_detection", 4096, this, 3, nullptr);
+    }
+    if (communication != nullptr) {
+        xTaskCreate([](void* arg) {
+            auto this_ = (AfeFrontEnd*)arg;
+            this_->FetchTask(kAfeConsumerProcessor);
+            vTaskDelete(NULL);
+        }, "audio_communication", 4096, this, 3, nullptr);
+    }
+}
+
+std::string AfeFrontEnd::GetInputFormat() {
+    int ref_num = codec_->input_reference() ? 1 : 0;
+    std::string input_format;
+    for (int i = 0; i < codec_->input_channels() - ref_num; i++) {
+        input_format.push_back('M');
+    }
+    for (int i = 0; i < ref_num; i++) {
+        input_format.push_back('R');
+    }
+    return input_format;
+}
+
+// WakeNet only runs in the SR pipeline
+void AfeFrontEnd::CreateDetection() {
+    if (models_ == nullptr) {
+        return;
+    }
+    afe_config_t* afe_config = afe_config_init(GetInputFormat().c_str(), models_, AFE_TYPE_SR, AFE_MODE_HIGH_PERF);
+    wakenet_init_ = afe_config->wakenet_init;
+    detection_aec_init_ = codec_->input_reference();
+    afe_config->aec_init = detection_aec_init_;
+    afe_config->aec_mode = AEC_MODE_SR_HIGH_PERF;
+    afe_config->afe_perferred_core = 1;
+    afe_config->afe_perferred_priority = 1;
+    afe_config->memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
+
+    auto& iface = afe_iface_[kAfeConsumerWakeWord];
+    iface = esp_afe_handle_from_config(afe_config);
+    afe_data_[kAfeConsumerWakeWord] = iface->create_from_config(afe_config);
+}
+
+// The VC pipeline is tuned for a listener rather than for recognition
+void AfeFrontEnd::CreateCommunication() {
+    afe_config_t* afe_config = afe_config_init(GetInputFormat().c_str(), NULL, AFE_TYPE_VC, AFE_MODE_HIGH_PERF);
+    afe_config->aec_mode = AEC_MODE_VOIP_HIGH_PERF;
+    afe_config->vad_mode = VAD_MODE_0;
+    afe_config->vad_min_noise_ms = 100;
+
+    char* ns_model_name = models_ ? esp_srmodel_filter(models_, ESP_NSNET_PREFIX, NULL) : nullptr;
+    char* vad_model_name = models_ ? esp_srmodel_filter(models_, ESP_VADN_PREFIX, NULL) : nullptr;
+    if (vad_model_name != nullptr) {
+        afe_config->vad_model_name = vad_model_name;
+    }
+    if (ns_model_name != nullptr) {
+        afe_config->ns_init = true;
+        afe_config->ns_model_name = ns_model_name;
+        afe_config->afe_ns_mode = AFE_NS_MODE_NET;
+    } else {
+        afe_config->ns_init = false;
+    }
+
+    afe_config->afe_perferred_core = 1;
+    afe_config->afe_perferred_priority = 1;
+    afe_config->agc_init = false;
+    afe_config->memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
+
+#if CONFIG_USE_DEVICE_AEC
+    communication_aec_init_ = true;
+#endif
+    afe_config->aec_init = communication_aec_init_;
+    afe_config->vad_init = true;
+
+    auto& iface = afe_iface_[kAfeConsumerProcessor];
+    iface = esp_afe_handle_from_config(afe_config);
+    afe_data_[kAfeConsumerProcessor] = iface->create_from_config(afe_config);
+}
+
+void AfeFrontEnd::Feed(const std::vector<int16_t>& data) {
+    auto bits = xEventGroupGetBits(event_group_);
+    for (int i = 0; i < kAfeConsumerCount; i++) {
+        if ((bits & (1 << i)) && afe_data_[i] != nullptr) {
+            afe_iface_[i]->feed(afe_data_[i], data.data());
+        }
+    }
+}
+
+size_t AfeFrontEnd::GetFeedSize() {
+    for (int i = 0; i < kAfeConsumerCount; i++) {
+        if (afe_data_[i] != nullptr) {
+            return afe_iface_[i]->get_feed_chunksize(afe_data_[i]) * codec_->input_channels();
+        }
+    }
+    return 0;
+}
+
+size_t AfeFrontEnd::GetFetchSize(AfeConsumer consumer) {
+    if (afe_data_[consumer] == nullptr) {
+        return 0;
+    }
+    return afe_iface_[consumer]->get_fetch_chunksize(afe_data_[consumer]);
+}
+
+void AfeFrontEnd::OnFetch(AfeConsumer consumer, std::function<void(afe_fetch_result_t* result)> callback) {
+    callbacks_[consumer] = callback;
+}
+
+void AfeFrontEnd::Enable(AfeConsumer consumer, bool enable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EventBits_t bit = 1 << consumer;
+    if (((xEventGroupGetBits(event_group_) & bit) != 0) == enable) {
+        return;
+    }
+    // A consumer starts from the audio fed after it was enabled, and leaves nothing behind
+    if (enable) {
+        if (afe_data_[consumer] != nullptr) {
+            afe_iface_[consumer]->reset_buffer(afe_data_[consumer]);
+        }
+        xEventGroupSetBits(event_group_, bit);
+    } else {
+        xEventGroupClearBits(event_group_, bit);
+        if (afe_data_[consumer] != nullptr) {
+            afe_iface_[consumer]->reset_buffer(afe_data_[consumer]);
+        }
+    }
+    UpdateStages();
+}
+
+bool AfeFrontEnd::IsEnabled(AfeConsumer consumer) {
+    return xEventGroupGetBits(event_group_) & (1 << consumer);
+}
+
+void AfeFrontEnd::EnableDeviceAec(bool enable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+#if !CONFIG_USE_DEVICE_AEC
+    if (enable) {
+        ESP_LOGE(TAG, "Device AEC is not supported");
+        return;
+    }
+#endif
+    device_aec_ = enable;
+    UpdateStages();
+}
+
+// Runs only the stages the enabled consumers need, the others cost no CPU
+void AfeFrontEnd::UpdateStages() {
+    auto bits = xEventGroupGetBits(event_group_);
+
+    auto iface = afe_iface_[kAfeConsumerWakeWord];
+    auto data = afe_data_[kAfeConsumerWakeWord];
+    bool wake_word = bits & (1 << kAfeConsumerWakeWord);
+    if (data != nullptr) {
+        if (wakenet_init_) {
+            if (wake_word) {
+                iface->enable_wakenet(data);
+            } else {
+                iface->disable_wakenet(data);
+            }
+        }
+        if (detection_aec_init_) {
+            if (wake_word) {
+                iface->enable_aec(data);
+            } else {
+                iface->disable_aec(data);
+            }
+        }
+    }
+
+    iface = afe_iface_[kAfeConsumerProcessor];
+    data = afe_data_[kAfeConsumerProcessor];
+    bool processor = bits & (1 << kAfeConsumerProcessor);
+    if (data != nullptr) {
+        if (communication_aec_init_) {
+            if (processor && device_aec_) {
+                iface->enable_aec(data);
+            } else {
+                iface->disable_aec(data);
+            }
+        }
+        if (processor && !device_aec_) {
+            iface->enable_vad(data);
+        } else {
+            iface->disable_vad(data);
+        }
+    }
+}
+
+void AfeFrontEnd::FetchTask(AfeConsumer consumer) {
+    auto iface = afe_iface_[consumer];
+    auto data = afe_data_[consumer];
+    auto fetch_size = iface->get_fetch_chunksize(data);
+    auto feed_size = iface->get_feed_chunksize(data);
+    ESP_LOGI(TAG, "Audio %s task started, feed size: %d fetch size: %d",
+        consumer == kAfeConsumerWakeWord ? "detection" : "communication", feed_size, fetch_size);
+
+    const EventBits_t bit = 1 << consumer;
+    while (true) {
+        xEventGroupWaitBits(event_group_, bit, pdFALSE, pdTRUE, portMAX_DELAY);
+
+        auto res = iface->fetch_with_delay(data, portMAX_DELAY);
+        // A consumer disabled while the frame was fetched does not get it
+        if ((xEventGroupGetBits(event_group_) & bit) == 0) {
+            continue;
+        }
+        if (res == nullptr || res->ret_value == ESP_FAIL) {
+            if (res != nullptr) {
+                ESP_LOGI(TAG, "Error code: %d", res->ret_value);
+            }
+            continue;
+        }
+        if (callbacks_[consumer]) {
+            callbacks_[consumer](res);
+        }
+    }
+}
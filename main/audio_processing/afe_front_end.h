@@ -0,0 +1,86 @@
+#ifndef AFE_FRONT_END_H
+#define AFE_FRONT_END_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+
+#include <esp_afe_sr_models.h>
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "audio_codec.h"
+
+enum AfeConsumer {
+    kAfeConsumerWakeWord,
+    kAfeConsumerProcessor,
+    kAfeConsumerCount
+};
+
+/*
+ * The AFE front end of AfeWakeWord and AfeAudioProcessor.
+ *
+ * The models are loaded once and shared. WakeNet only runs in the SR pipeline while communication
+ * is tuned for a listener in the VC one, so each consumer has an AFE of its own type: an SR instance
+ * with WakeNet and the wake word AEC for detection, a VC instance with VoIP AEC or VAD and NSNet for
+ * communication. They share the feed path, every chunk passed to Feed() reaches the instance of each
+ * enabled consumer, so the microphone is read once while both run. Each instance has a fetch task
+ * that waits while its consumer is disabled.
+ */
+class AfeFrontEnd {
+public:
+    static AfeFrontEnd& GetInstance() {
+        static AfeFrontEnd instance;
+        return instance;
+    }
+    AfeFrontEnd(const AfeFrontEnd&) = delete;
+    AfeFrontEnd& operator=(const AfeFrontEnd&) = delete;
+
+    // Loads the models and creates the AFE on the first call, later calls only return
+    void Initialize(AudioCodec* codec);
+    srmodel_list_t* models() const { return models_; }
+
+    void Feed(const std::vector<int16_t>& data);
+    size_t GetFeedSize();
+    // Samples of one fetched frame of the consumer's AFE, the output is mono
+    size_t GetFetchSize(AfeConsumer consumer);
+
+    // Runs on the fetch task for every frame fetched while the consumer is enabled
+    void OnFetch(AfeConsumer consumer, std::function<void(afe_fetch_result_t* result)> callback);
+    void Enable(AfeConsumer consumer, bool enable);
+    bool IsEnabled(AfeConsumer consumer);
+    // Communication uses the device AEC instead of the VAD
+    void EnableDeviceAec(bool enable);
+
+private:
+    AfeFrontEnd();
+    ~AfeFrontEnd();
+
+    std::mutex mutex_;
+    EventGroupHandle_t event_group_ = nullptr;
+    srmodel_list_t* models_ = nullptr;
+    AudioCodec* codec_ = nullptr;
+    // One AFE per consumer, null when the build has no such consumer or it failed to create
+    esp_afe_sr_iface_t* afe_iface_[kAfeConsumerCount] = {};
+    esp_afe_sr_data_t* afe_data_[kAfeConsumerCount] = {};
+    std::function<void(afe_fetch_result_t* result)> callbacks_[kAfeConsumerCount];
+    bool wakenet_init_ = false;
+    bool detection_aec_init_ = false;
+    bool communication_aec_init_ = false;
+#if CONFIG_USE_DEVICE_AEC
+    bool device_aec_ = true;
+#else
+    bool device_aec_ = false;
+#endif
+
+    std::string GetInputFormat();
+    void CreateDetection();
+    void CreateCommunication();
+    void UpdateStages();
+    void FetchTask(AfeConsumer consumer);
+};
+
+#endif // AFE_FRONT_END_H
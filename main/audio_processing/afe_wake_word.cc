@@ -1,41 +1,39 @@
 #include "afe_wake_word.h"
 #include "application.h"
+#include "latency_tracer.h"
 
 #include <esp_log.h>
 #include <model_path.h>
 #include <arpa/inet.h>
 #include <sstream>
 
-#define DETECTION_RUNNING_EVENT 1
+#define PRE_ROLL_PCM_EVENT (1 << 0)
+#define PRE_ROLL_FLUSH_EVENT (1 << 1)
 
 #define TAG "AfeWakeWord"
 
-AfeWakeWord::AfeWakeWord()
-    : afe_data_(nullptr),
-      wake_word_pcm_(),
-      wake_word_opus_() {
-
+AfeWakeWord::AfeWakeWord() {
     event_group_ = xEventGroupCreate();
 }
 
 AfeWakeWord::~AfeWakeWord() {
-    if (afe_data_ != nullptr) {
-        afe_iface_->destroy(afe_data_);
+    if (wake_word_encode_task_ != nullptr) {
+        vTaskDelete(wake_word_encode_task_);
     }
-
     if (wake_word_encode_task_stack_ != nullptr) {
         heap_caps_free(wake_word_encode_task_stack_);
     }
-
     vEventGroupDelete(event_group_);
 }
 
 void AfeWakeWord::Initialize(AudioCodec* codec) {
     codec_ = codec;
-    int ref_num = codec_->input_reference() ? 1 : 0;
 
-    srmodel_list_t *models = esp_srmodel_init("model");
-    if (models == nullptr || models->num == -1) {
+    // The models and the feed path are shared with the audio processor, the SR AFE is only used here
+    auto& front_end = AfeFrontEnd::GetInstance();
+    front_end.Initialize(codec_);
+    srmodel_list_t *models = front_end.models();
+    if (models == nullptr) {
         ESP_LOGE(TAG, "Failed to initialize wakenet model");
         return;
     }
@@ -53,28 +51,22 @@ void AfeWakeWord::Initialize(AudioCodec* codec) {
         }
     }
 
-    std::string input_format;
-    for (int i = 0; i < codec_->input_channels() - ref_num; i++) {
-        input_format.push_back('M');
-    }
-    for (int i = 0; i < ref_num; i++) {
-        input_format.push_back('R');
-    }
-    afe_config_t* afe_config = afe_config_init(input_format.c_str(), models, AFE_TYPE_SR, AFE_MODE_HIGH_PERF);
-    afe_config->aec_init = codec_->input_reference();
-    afe_config->aec_mode = AEC_MODE_SR_HIGH_PERF;
-    afe_config->afe_perferred_core = 1;
-    afe_config->afe_perferred_priority = 1;
-    afe_config->memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
-    
-    afe_iface_ = esp_afe_handle_from_config(afe_config);
-    afe_data_ = afe_iface_->create_from_config(afe_config);
-
-    xTaskCreate([](void* arg) {
+    // AFE output is 16 kHz mono
+    pre_roll_ = std::make_unique<AudioPreRoll>(16000, CONFIG_WAKE_WORD_PRE_ROLL_MS);
+    CreatePreRollEncoder(wake_word_frame_duration_);
+    pre_roll_dropped_.payload.reserve(AUDIO_PACKET_MAX_PAYLOAD_SIZE);
+
+    // Below the audio tasks, the encoder only has to keep up on average
+    wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(4096 * 8, MALLOC_CAP_SPIRAM);
+    wake_word_encode_task_ = xTaskCreateStatic([](void* arg) {
         auto this_ = (AfeWakeWord*)arg;
-        this_->AudioDetectionTask();
+        this_->PreRollEncodeTask();
         vTaskDelete(NULL);
-    }, "audio_detection", 4096, this, 3, nullptr);
+    }, "encode_pre_roll", 4096 * 8, this, 1, wake_word_encode_task_stack_, &wake_word_encode_task_buffer_);
+
+    front_end.OnFetch(kAfeConsumerWakeWord, [this](afe_fetch_result_t* res) {
+        OnFetch(res);
+    });
 }
 
 void AfeWakeWord::OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback) {
@@ -82,111 +74,149 @@ void AfeWakeWord::OnWakeWordDetected(std::function<void(const std::string& wake_
 }
 
 void AfeWakeWord::StartDetection() {
-    xEventGroupSetBits(event_group_, DETECTION_RUNNING_EVENT);
+    AfeFrontEnd::GetInstance().Enable(kAfeConsumerWakeWord, true);
 }
 
 void AfeWakeWord::StopDetection() {
-    xEventGroupClearBits(event_group_, DETECTION_RUNNING_EVENT);
-    if (afe_data_ != nullptr) {
-        afe_iface_->reset_buffer(afe_data_);
-    }
+    AfeFrontEnd::GetInstance().Enable(kAfeConsumerWakeWord, false);
 }
 
 bool AfeWakeWord::IsDetectionRunning() {
-    return xEventGroupGetBits(event_group_) & DETECTION_RUNNING_EVENT;
+    return AfeFrontEnd::GetInstance().IsEnabled(kAfeConsumerWakeWord);
 }
 
 void AfeWakeWord::Feed(const std::vector<int16_t>& data) {
-    if (afe_data_ == nullptr) {
-        return;
-    }
-    afe_iface_->feed(afe_data_, data.data());
+    AfeFrontEnd::GetInstance().Feed(data);
 }
 
 size_t AfeWakeWord::GetFeedSize() {
-    if (afe_data_ == nullptr) {
-        return 0;
-    }
-    return afe_iface_->get_feed_chunksize(afe_data_) * codec_->input_channels();
+    return AfeFrontEnd::GetInstance().GetFeedSize();
 }
 
-void AfeWakeWord::AudioDetectionTask() {
-    auto fetch_size = afe_iface_->get_fetch_chunksize(afe_data_);
-    auto feed_size = afe_iface_->get_feed_chunksize(afe_data_);
-    ESP_LOGI(TAG, "Audio detection task started, feed size: %d fetch size: %d",
-        feed_size, fetch_size);
-
-    while (true) {
-        xEventGroupWaitBits(event_group_, DETECTION_RUNNING_EVENT, pdFALSE, pdTRUE, portMAX_DELAY);
-
-        auto res = afe_iface_->fetch_with_delay(afe_data_, portMAX_DELAY);
-        if (res == nullptr || res->ret_value == ESP_FAIL) {
-            continue;;
-        }
-
-        // Store the wake word data for voice recognition, like who is speaking
-        StoreWakeWordData(res->data, res->data_size / sizeof(int16_t));
+void AfeWakeWord::OnFetch(afe_fetch_result_t* res) {
+    // Store the wake word data for voice recognition, like who is speaking
+    StoreWakeWordData(res->data, res->data_size / sizeof(int16_t));
 
-        if (res->wakeup_state == WAKENET_DETECTED) {
-            StopDetection();
-            last_detected_wake_word_ = wake_words_[res->wake_word_index - 1];
+    if (res->wakeup_state == WAKENET_DETECTED) {
+        StopDetection();
+        last_detected_wake_word_ = wake_words_[res->wake_word_index - 1];
+        LatencyTracer::GetInstance().Mark(kLatencyWakeWordDetected);
 
-            if (wake_word_detected_callback_) {
-                wake_word_detected_callback_(last_detected_wake_word_);
-            }
+        if (wake_word_detected_callback_) {
+            wake_word_detected_callback_(last_detected_wake_word_);
         }
     }
 }
 
 void AfeWakeWord::StoreWakeWordData(const int16_t* data, size_t samples) {
-    // store audio data to wake_word_pcm_
-    wake_word_pcm_.emplace_back(std::vector<int16_t>(data, data + samples));
-    // keep about 2 seconds of data, detect duration is 30ms (sample_rate == 16000, chunksize == 512)
-    while (wake_word_pcm_.size() > 2000 / 30) {
-        wake_word_pcm_.pop_front();
+    if (pre_roll_ == nullptr) {
+        return;
+    }
+    // Audio from before the last wake word is not part of the next pre-roll
+    if (pre_roll_clear_.exchange(false)) {
+        pre_roll_->Clear();
+        pre_roll_restart_ = true;
     }
+    pre_roll_->Write(data, samples);
+    xEventGroupSetBits(event_group_, PRE_ROLL_PCM_EVENT);
 }
 
-void AfeWakeWord::EncodeWakeWordData() {
-    wake_word_opus_.clear();
-    if (wake_word_encode_task_stack_ == nullptr) {
-        wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(4096 * 8, MALLOC_CAP_SPIRAM);
+void AfeWakeWord::CreatePreRollEncoder(int frame_duration) {
+    pre_roll_encoder_ = std::make_unique<OpusStreamEncoder>(16000, 1, frame_duration);
+    pre_roll_encoder_->SetComplexity(0); // 0 is the fastest
+    pre_roll_packets_ = std::make_unique<AudioPacketRing>((CONFIG_WAKE_WORD_PRE_ROLL_MS + frame_duration - 1) / frame_duration);
+    pre_roll_frame_.resize(pre_roll_encoder_->frame_size());
+    pre_roll_opus_.resize(pre_roll_packets_->max_payload_size());
+    // Start again from the oldest sample held
+    pre_roll_position_ = pre_roll_->begin();
+}
+
+void AfeWakeWord::EncodePreRoll() {
+    size_t frame_size = pre_roll_frame_.size();
+    while (true) {
+        if (pre_roll_restart_.exchange(false) || (int32_t)(pre_roll_position_ - pre_roll_->begin()) < 0) {
+            // The ring was cleared, or the encoder fell a whole pre-roll behind, start a new stream
+            pre_roll_position_ = pre_roll_->begin();
+            pre_roll_encoder_->ResetState();
+            pre_roll_packets_->Clear();
+            // Popping applies the clear, so the slots can be reused
+            pre_roll_packets_->Pop(pre_roll_dropped_);
+        }
+        if ((int32_t)(pre_roll_->end() - pre_roll_position_) < (int32_t)frame_size) {
+            break;
+        }
+        if (!pre_roll_->Copy(pre_roll_position_, pre_roll_frame_.data(), frame_size)) {
+            continue;
+        }
+        pre_roll_position_ += frame_size;
+
+        int ret = pre_roll_encoder_->EncodeFrame(pre_roll_frame_.data(), pre_roll_opus_.data(), pre_roll_opus_.size());
+        if (ret < 0) {
+            continue;
+        }
+        // Keep the packets of the last pre-roll duration only
+        if (pre_roll_packets_->full()) {
+            pre_roll_packets_->Pop(pre_roll_dropped_);
+        }
+        pre_roll_packets_->Push(16000, pre_roll_encoder_->duration_ms(), 0, pre_roll_opus_.data(), ret);
     }
-    wake_word_encode_task_ = xTaskCreateStatic([](void* arg) {
-        auto this_ = (AfeWakeWord*)arg;
-        {
-            auto start_time = esp_timer_get_time();
-            auto encoder = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-            encoder->SetComplexity(0); // 0 is the fastest
-
-            int packets = 0;
-            for (auto& pcm: this_->wake_word_pcm_) {
-                encoder->Encode(std::move(pcm), [this_](std::vector<uint8_t>&& opus) {
-                    std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-                    this_->wake_word_opus_.emplace_back(std::move(opus));
-                    this_->wake_word_cv_.notify_all();
-                });
-                packets++;
-            }
-            this_->wake_word_pcm_.clear();
+}
 
-            auto end_time = esp_timer_get_time();
-            ESP_LOGI(TAG, "Encode wake word opus %d packets in %ld ms", packets, (long)((end_time - start_time) / 1000));
+void AfeWakeWord::PreRollEncodeTask() {
+    while (true) {
+        auto bits = xEventGroupWaitBits(event_group_, PRE_ROLL_PCM_EVENT | PRE_ROLL_FLUSH_EVENT, pdTRUE, pdFALSE, portMAX_DELAY);
+        if (!(bits & PRE_ROLL_FLUSH_EVENT)) {
+            EncodePreRoll();
+            continue;
+        }
 
-            std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-            this_->wake_word_opus_.push_back(std::vector<uint8_t>());
-            this_->wake_word_cv_.notify_all();
+        // Detection has stopped, only the audio since the last fetch is left to encode
+        auto start_time = esp_timer_get_time();
+        int frame_duration;
+        {
+            std::lock_guard<std::mutex> lock(wake_word_mutex_);
+            frame_duration = wake_word_frame_duration_;
         }
-        vTaskDelete(NULL);
-    }, "encode_detect_packets", 4096 * 8, this, 2, wake_word_encode_task_stack_, &wake_word_encode_task_buffer_);
+        if (frame_duration != pre_roll_encoder_->duration_ms()) {
+            // The uplink frame duration changed, encode the whole pre-roll again at the new duration
+            CreatePreRollEncoder(frame_duration);
+        }
+        EncodePreRoll();
+        ESP_LOGI(TAG, "Pre-roll ready, %u packets, encoded on detection in %ld ms", pre_roll_packets_->size(),
+            (long)((esp_timer_get_time() - start_time) / 1000));
+
+        std::lock_guard<std::mutex> lock(wake_word_mutex_);
+        pre_roll_ready_ = true;
+        wake_word_cv_.notify_all();
+    }
+}
+
+void AfeWakeWord::EncodeWakeWordData(int frame_duration) {
+    std::lock_guard<std::mutex> lock(wake_word_mutex_);
+    if (wake_word_encode_task_ == nullptr) {
+        // No model, nothing was stored
+        pre_roll_ready_ = true;
+        return;
+    }
+    pre_roll_ready_ = false;
+    wake_word_frame_duration_ = frame_duration;
+    // Once sent, the next detection starts a new pre-roll
+    pre_roll_clear_ = true;
+    xEventGroupSetBits(event_group_, PRE_ROLL_FLUSH_EVENT);
 }
 
 bool AfeWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
     std::unique_lock<std::mutex> lock(wake_word_mutex_);
     wake_word_cv_.wait(lock, [this]() {
-        return !wake_word_opus_.empty();
+        return pre_roll_ready_;
     });
-    opus.swap(wake_word_opus_.front());
-    wake_word_opus_.pop_front();
-    return !opus.empty();
+    if (pre_roll_packets_ == nullptr) {
+        return false;
+    }
+    // Pop into the caller's vector, so its capacity is reused from packet to packet
+    AudioStreamPacket packet;
+    packet.payload.swap(opus);
+    bool ok = pre_roll_packets_->Pop(packet);
+    opus.swap(packet.payload);
+    return ok;
 }
@@ -8,14 +8,19 @@
 #include <esp_afe_sr_models.h>
 #include <esp_nsn_models.h>
 
-#include <list>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <condition_variable>
 
 #include "audio_codec.h"
+#include "afe_front_end.h"
+#include "audio_pre_roll.h"
+#include "audio_packet_ring.h"
+#include "opus_stream_encoder.h"
 #include "wake_word.h"
 
 class AfeWakeWord : public WakeWord {
@@ -30,30 +35,41 @@ public:
     void StopDetection();
     bool IsDetectionRunning();
     size_t GetFeedSize();
-    void EncodeWakeWordData();
+    void EncodeWakeWordData(int frame_duration);
     bool GetWakeWordOpus(std::vector<uint8_t>& opus);
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
 
 private:
-    esp_afe_sr_iface_t* afe_iface_ = nullptr;
-    esp_afe_sr_data_t* afe_data_ = nullptr;
     char* wakenet_model_ = NULL;
     std::vector<std::string> wake_words_;
-    EventGroupHandle_t event_group_;
     std::function<void(const std::string& wake_word)> wake_word_detected_callback_;
     AudioCodec* codec_ = nullptr;
     std::string last_detected_wake_word_;
 
+    // The pre-roll is encoded while detection runs, so it can be sent as soon as the channel opens
     TaskHandle_t wake_word_encode_task_ = nullptr;
     StaticTask_t wake_word_encode_task_buffer_;
     StackType_t* wake_word_encode_task_stack_ = nullptr;
-    std::list<std::vector<int16_t>> wake_word_pcm_;
-    std::list<std::vector<uint8_t>> wake_word_opus_;
+    EventGroupHandle_t event_group_ = nullptr;
+    int wake_word_frame_duration_ = CONFIG_AUDIO_UPLINK_FRAME_DURATION;  // Requested for the next pre-roll
+    std::unique_ptr<AudioPreRoll> pre_roll_;
+    std::unique_ptr<OpusStreamEncoder> pre_roll_encoder_;
+    std::unique_ptr<AudioPacketRing> pre_roll_packets_;
+    uint32_t pre_roll_position_ = 0;            // Next PCM position to encode
+    std::vector<int16_t> pre_roll_frame_;
+    std::vector<uint8_t> pre_roll_opus_;
+    AudioStreamPacket pre_roll_dropped_;        // Oldest packet popped to make room
+    std::atomic<bool> pre_roll_clear_{false};     // Set for the fetch task
+    std::atomic<bool> pre_roll_restart_{false};   // Set for the encode task
+    bool pre_roll_ready_ = false;
     std::mutex wake_word_mutex_;
     std::condition_variable wake_word_cv_;
 
     void StoreWakeWordData(const int16_t* data, size_t size);
-    void AudioDetectionTask();
+    void OnFetch(afe_fetch_result_t* res);
+    void CreatePreRollEncoder(int frame_duration);
+    void EncodePreRoll();
+    void PreRollEncodeTask();
 };
 
 #endif
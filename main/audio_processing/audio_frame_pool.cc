@@ -0,0 +1,62 @@
+#include "audio_frame_pool.h"
+
+#include <esp_log.h>
+#include <algorithm>
+
+#define TAG "AudioFramePool"
+
+AudioFramePool::AudioFramePool(size_t frames, size_t frame_samples)
+    : frames_(frames), frame_samples_(frame_samples) {
+    free_.resize(frames_);
+    for (auto& frame : free_) {
+        frame.reserve(frame_samples_);
+    }
+    ESP_LOGI(TAG, "Frame pool %u frames of %u samples", frames_, frame_samples_);
+}
+
+bool AudioFramePool::Acquire(std::vector<int16_t>& frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+        exhausted_++;
+        if (exhausted_ % 50 == 1) {
+            ESP_LOGW(TAG, "Every frame is in use, the consumer is behind, %lu frames dropped", exhausted_);
+        }
+        return false;
+    }
+    frame.swap(free_.back());
+    free_.pop_back();
+    acquired_++;
+    peak_in_use_ = std::max(peak_in_use_, frames_ - free_.size());
+    return true;
+}
+
+void AudioFramePool::Release(std::vector<int16_t>&& frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // free_ never grows past the capacity reserved at construction, so this does not allocate
+    if (free_.size() >= frames_) {
+        ESP_LOGW(TAG, "Released a frame that was not acquired");
+        return;
+    }
+    frame.clear();
+    free_.push_back(std::move(frame));
+}
+
+size_t AudioFramePool::in_use() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return frames_ - free_.size();
+}
+
+size_t AudioFramePool::peak_in_use() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_in_use_;
+}
+
+uint32_t AudioFramePool::acquired() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return acquired_;
+}
+
+uint32_t AudioFramePool::exhausted() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return exhausted_;
+}
@@ -0,0 +1,46 @@
+#ifndef AUDIO_FRAME_POOL_H
+#define AUDIO_FRAME_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*
+ * Fixed set of PCM frame buffers lent to the audio processor output.
+ *
+ * Every buffer is allocated at construction with room for one frame. A frame is moved out by
+ * Acquire(), travels by move through the output callback, the silence gate and the encoder task,
+ * and is moved back by Release(), so the buffers are reused instead of allocated per frame.
+ * When every buffer is out the encoder has fallen behind, Acquire() fails and the frame is dropped.
+ * Acquire() and Release() may be called from any task.
+ */
+class AudioFramePool {
+public:
+    AudioFramePool(size_t frames, size_t frame_samples);
+    AudioFramePool(const AudioFramePool&) = delete;
+    AudioFramePool& operator=(const AudioFramePool&) = delete;
+
+    // Moves a free buffer into frame, returns false if every buffer is in use
+    bool Acquire(std::vector<int16_t>& frame);
+    void Release(std::vector<int16_t>&& frame);
+
+    // Backpressure counters
+    inline size_t frames() const { return frames_; }
+    inline size_t frame_samples() const { return frame_samples_; }
+    size_t in_use();
+    size_t peak_in_use();
+    uint32_t acquired();
+    uint32_t exhausted();
+
+private:
+    std::mutex mutex_;
+    std::vector<std::vector<int16_t>> free_;
+    size_t frames_;
+    size_t frame_samples_;
+    size_t peak_in_use_ = 0;
+    uint32_t acquired_ = 0;
+    uint32_t exhausted_ = 0;
+};
+
+#endif // AUDIO_FRAME_POOL_H
@@ -0,0 +1,258 @@
+#include "audio_jitter_buffer.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+#include <algorithm>
+#include <cassert>
+
+#define TAG "AudioJitterBuffer"
+
+AudioJitterBuffer::AudioJitterBuffer(size_t capacity, size_t max_payload_size)
+    : capacity_(capacity), max_payload_size_(max_payload_size) {
+    slots_ = new Slot[capacity_]();
+    payloads_ = (uint8_t*)heap_caps_malloc(capacity_ * max_payload_size_, MALLOC_CAP_SPIRAM);
+    if (payloads_ == nullptr) {
+        payloads_ = (uint8_t*)heap_caps_malloc(capacity_ * max_payload_size_, MALLOC_CAP_8BIT);
+    }
+    assert(payloads_ != nullptr);
+}
+
+AudioJitterBuffer::~AudioJitterBuffer() {
+    heap_caps_free(payloads_);
+    delete[] slots_;
+}
+
+void AudioJitterBuffer::Reset() {
+    reset_requested_ = true;
+}
+
+void AudioJitterBuffer::ApplyReset() {
+    if (!reset_requested_.exchange(false)) {
+        return;
+    }
+    for (size_t i = 0; i < capacity_; i++) {
+        slots_[i].used = false;
+    }
+    count_ = 0;
+    playing_ = false;
+    has_next_ = false;
+    has_reference_ = false;
+    last_sequence_ = 0;
+    // The jitter estimate describes the network, keep it for the next stream
+}
+
+void AudioJitterBuffer::Put(const AudioStreamPacket& packet, int64_t arrival_time_us) {
+    ApplyReset();
+    if (packet.payload.size() > max_payload_size_) {
+        ESP_LOGW(TAG, "Payload size %u exceeds slot size %u, drop the packet", packet.payload.size(), max_payload_size_);
+        overflowed_++;
+        return;
+    }
+
+    uint32_t sequence = packet.sequence != 0 ? packet.sequence : last_sequence_ + 1;
+    received_++;
+    if (packet.frame_duration > 0) {
+        frame_duration_ = packet.frame_duration;
+    }
+
+    if (!has_next_) {
+        next_sequence_ = sequence;
+        has_next_ = true;
+    } else if ((int32_t)(sequence - next_sequence_) < 0) {
+        // Out of order frame that is older than the playout point
+        if (playing_ || (int32_t)(last_sequence_ - sequence) >= (int32_t)capacity_) {
+            late_++;
+            return;
+        }
+        next_sequence_ = sequence;
+    }
+
+    // Keep the window [next_sequence_, next_sequence_ + capacity_) by dropping the oldest frames
+    if ((int32_t)(sequence - next_sequence_) >= (int32_t)capacity_) {
+        uint32_t new_next = sequence - capacity_ + 1;
+        for (size_t i = 0; i < capacity_; i++) {
+            auto& slot = slots_[i];
+            if (slot.used && (int32_t)(slot.sequence - new_next) < 0) {
+                slot.used = false;
+                count_--;
+                overflowed_++;
+            }
+        }
+        next_sequence_ = new_next;
+    }
+
+    size_t index = sequence % capacity_;
+    auto& slot = slots_[index];
+    if (slot.used) {
+        if (slot.sequence == sequence) {
+            duplicated_++;
+            return;
+        }
+        slot.used = false;
+        count_--;
+    }
+
+    if (count_ == 0 && !playing_) {
+        buffering_since_us_ = arrival_time_us;
+    }
+    slot.used = true;
+    slot.sequence = sequence;
+    slot.sample_rate = packet.sample_rate;
+    slot.frame_duration = packet.frame_duration;
+    slot.timestamp = packet.timestamp;
+    slot.size = packet.payload.size();
+    memcpy(payloads_ + index * max_payload_size_, packet.payload.data(), slot.size);
+    count_++;
+
+    if ((int32_t)(sequence - last_sequence_) > 0) {
+        last_sequence_ = sequence;
+    }
+    UpdateJitter(sequence, arrival_time_us);
+}
+
+void AudioJitterBuffer::UpdateJitter(uint32_t sequence, int64_t arrival_time_us) {
+    int32_t sequence_delta = sequence - reference_sequence_;
+    if (has_reference_ && sequence_delta <= 0) {
+        return;
+    }
+
+    int64_t lateness = arrival_time_us - reference_arrival_us_ - (int64_t)sequence_delta * frame_duration_ * 1000;
+    bool new_talk_spurt = lateness > AUDIO_JITTER_MAX_DEPTH_MS * 1000;
+    reference_sequence_ = sequence;
+    reference_arrival_us_ = arrival_time_us;
+    if (!has_reference_ || new_talk_spurt) {
+        // A pause between sentences is not jitter, start measuring again
+        has_reference_ = true;
+        return;
+    }
+
+    // Only late arrivals can starve the decoder, early ones just fill the buffer
+    int32_t deviation = lateness > 0 ? (int32_t)lateness : 0;
+    jitter_us_ += (deviation - jitter_us_) / 16;
+
+    // One frame plus enough to cover three times the mean jitter
+    int frame_us = frame_duration_ * 1000;
+    int depth = 1 + (3 * jitter_us_ + frame_us - 1) / frame_us;
+    int max_depth = std::min<int>(capacity_ / 2, std::max(1, AUDIO_JITTER_MAX_DEPTH_MS / frame_duration_));
+    target_depth_ = std::clamp(depth, 1, max_depth);
+}
+
+AudioJitterResult AudioJitterBuffer::Get(AudioStreamPacket& packet, int64_t now_us, int playout_ms) {
+    ApplyReset();
+    if (count_ == 0) {
+        // The decode task keeps the buffer drained, the stream only stalls once the audio ahead runs out
+        if (playing_ && playout_ms < AUDIO_JITTER_CONCEAL_DEADLINE_MS) {
+            playing_ = false;
+            rebuffered_++;
+        }
+        return kJitterEmpty;
+    }
+
+    if (!playing_) {
+        // Wait until the target depth is reached, or for as long as it would take to fill it
+        int64_t waited_us = now_us - buffering_since_us_;
+        if ((int)count_ < target_depth_ && waited_us < (int64_t)target_depth_ * frame_duration_ * 1000) {
+            return kJitterEmpty;
+        }
+        playing_ = true;
+        // Frames that did not arrive before the stall are not played
+        uint32_t first = next_sequence_;
+        FindNextBuffered(next_sequence_);
+        skipped_ += next_sequence_ - first;
+    }
+
+    auto& slot = slots_[next_sequence_ % capacity_];
+    if (slot.used && slot.sequence == next_sequence_) {
+        CopyOut(slot, packet);
+        ReleaseSlot(next_sequence_);
+        next_sequence_++;
+        return kJitterPacket;
+    }
+
+    // The packet may still be on its way, give up on it only when the frame is about to be heard
+    if (playout_ms >= AUDIO_JITTER_CONCEAL_DEADLINE_MS) {
+        return kJitterEmpty;
+    }
+
+    uint32_t buffered = next_sequence_;
+    FindNextBuffered(buffered);
+    uint32_t gap = buffered - next_sequence_;
+    if (gap > AUDIO_JITTER_MAX_CONCEAL_FRAMES) {
+        // Too long to conceal, jump to the next frame we have
+        skipped_ += gap;
+        next_sequence_ = buffered;
+        CopyOut(slots_[next_sequence_ % capacity_], packet);
+        ReleaseSlot(next_sequence_);
+        next_sequence_++;
+        return kJitterPacket;
+    }
+
+    if (gap == 1) {
+        // Opus in-band FEC carries the previous frame in the packet after it, hand that packet out without consuming it
+        CopyOut(slots_[buffered % capacity_], packet);
+        packet.timestamp = 0;
+        packet.sequence = next_sequence_;
+        next_sequence_++;
+        recovered_++;
+        return kJitterRecover;
+    }
+
+    packet.sample_rate = sample_rate_;
+    packet.frame_duration = frame_duration_;
+    packet.timestamp = 0;
+    packet.sequence = next_sequence_;
+    packet.payload.clear();
+    next_sequence_++;
+    concealed_++;
+    return kJitterConceal;
+}
+
+bool AudioJitterBuffer::FindNextBuffered(uint32_t& sequence) const {
+    for (size_t i = 0; i < capacity_; i++) {
+        uint32_t candidate = next_sequence_ + i;
+        const auto& slot = slots_[candidate % capacity_];
+        if (slot.used && slot.sequence == candidate) {
+            sequence = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void AudioJitterBuffer::ReleaseSlot(uint32_t sequence) {
+    auto& slot = slots_[sequence % capacity_];
+    if (slot.used && slot.sequence == sequence) {
+        slot.used = false;
+        count_--;
+    }
+}
+
+void AudioJitterBuffer::CopyOut(const Slot& slot, AudioStreamPacket& packet) {
+    const uint8_t* payload = payloads_ + (&slot - slots_) * max_payload_size_;
+    packet.sample_rate = slot.sample_rate;
+    packet.frame_duration = slot.frame_duration;
+    packet.timestamp = slot.timestamp;
+    packet.sequence = slot.sequence;
+    packet.payload.assign(payload, payload + slot.size);
+    sample_rate_ = slot.sample_rate;
+    if (slot.frame_duration > 0) {
+        frame_duration_ = slot.frame_duration;
+    }
+}
+
+AudioJitterStats AudioJitterBuffer::GetStats() const {
+    return AudioJitterStats{
+        .depth = count_,
+        .target_depth = target_depth_,
+        .jitter_ms = jitter_us_ / 1000,
+        .received = received_,
+        .late = late_,
+        .duplicated = duplicated_,
+        .concealed = concealed_,
+        .recovered = recovered_,
+        .skipped = skipped_,
+        .overflowed = overflowed_,
+        .rebuffered = rebuffered_,
+    };
+}
@@ -0,0 +1,118 @@
+#ifndef AUDIO_JITTER_BUFFER_H
+#define AUDIO_JITTER_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.h"
+#include "audio_packet_ring.h"
+
+#define AUDIO_JITTER_BUFFER_CAPACITY 32
+#define AUDIO_JITTER_MAX_DEPTH_MS 1000
+// Gaps longer than this are skipped instead of concealed
+#define AUDIO_JITTER_MAX_CONCEAL_FRAMES 3
+// A missing frame waits for its packet until less decoded audio than this is left to play before it
+#define AUDIO_JITTER_CONCEAL_DEADLINE_MS 40
+
+enum AudioJitterResult {
+    kJitterEmpty,    // Nothing to play yet, or the next frame is missing and not due yet
+    kJitterPacket,   // A packet was returned
+    kJitterConceal,  // The next frame is missing, the caller should run packet loss concealment
+    kJitterRecover,  // The next frame is missing, the packet returned is the one after it, whose FEC data may restore it
+};
+
+struct AudioJitterStats {
+    size_t depth;
+    int target_depth;
+    int jitter_ms;
+    uint32_t received;
+    uint32_t late;
+    uint32_t duplicated;
+    uint32_t concealed;
+    uint32_t recovered;
+    uint32_t skipped;
+    uint32_t overflowed;
+    uint32_t rebuffered;
+};
+
+/*
+ * Reorders incoming server audio by sequence number and releases it once enough frames
+ * are buffered to absorb the measured arrival jitter (RFC 3550 interarrival jitter).
+ *
+ * A missing frame is only concealed, recovered or skipped at its playout deadline, so a packet
+ * that is reordered or delayed by less than the audio queued ahead of it is still played.
+ *
+ * Put() and Get() must be called from the same task. Reset() may be called from any task,
+ * it is applied on the next Put() or Get().
+ */
+class AudioJitterBuffer {
+public:
+    AudioJitterBuffer(size_t capacity = AUDIO_JITTER_BUFFER_CAPACITY, size_t max_payload_size = AUDIO_PACKET_MAX_PAYLOAD_SIZE);
+    ~AudioJitterBuffer();
+    AudioJitterBuffer(const AudioJitterBuffer&) = delete;
+    AudioJitterBuffer& operator=(const AudioJitterBuffer&) = delete;
+
+    // Packets without a sequence number (sequence == 0) are numbered in arrival order
+    void Put(const AudioStreamPacket& packet, int64_t arrival_time_us);
+    // playout_ms is the audio already decoded and not heard yet, the next frame plays after it
+    AudioJitterResult Get(AudioStreamPacket& packet, int64_t now_us, int playout_ms);
+    void Reset();
+
+    AudioJitterStats GetStats() const;
+    inline size_t depth() const { return count_; }
+    inline int target_depth() const { return target_depth_; }
+    inline int frame_duration() const { return frame_duration_; }
+    // False while buffering up to the target depth, at the start of a stream and after it ran dry
+    inline bool playing() const { return playing_; }
+
+private:
+    struct Slot {
+        bool used;
+        uint32_t sequence;
+        int sample_rate;
+        int frame_duration;
+        uint32_t timestamp;
+        size_t size;
+    };
+
+    Slot* slots_ = nullptr;
+    uint8_t* payloads_ = nullptr;
+    size_t capacity_;
+    size_t max_payload_size_;
+    size_t count_ = 0;
+    std::atomic<bool> reset_requested_{false};
+
+    // Playout state
+    bool playing_ = false;
+    bool has_next_ = false;
+    uint32_t next_sequence_ = 0;
+    uint32_t last_sequence_ = 0;
+    int64_t buffering_since_us_ = 0;
+    int sample_rate_ = 0;
+    int frame_duration_ = 60;
+
+    // Jitter estimation
+    bool has_reference_ = false;
+    int64_t reference_arrival_us_ = 0;
+    uint32_t reference_sequence_ = 0;
+    int32_t jitter_us_ = 0;
+    int target_depth_ = 1;
+
+    uint32_t received_ = 0;
+    uint32_t late_ = 0;
+    uint32_t duplicated_ = 0;
+    uint32_t concealed_ = 0;
+    uint32_t recovered_ = 0;
+    uint32_t skipped_ = 0;
+    uint32_t overflowed_ = 0;
+    uint32_t rebuffered_ = 0;
+
+    void ApplyReset();
+    void UpdateJitter(uint32_t sequence, int64_t arrival_time_us);
+    void ReleaseSlot(uint32_t sequence);
+    bool FindNextBuffered(uint32_t& sequence) const;
+    void CopyOut(const Slot& slot, AudioStreamPacket& packet);
+};
+
+#endif // AUDIO_JITTER_BUFFER_H
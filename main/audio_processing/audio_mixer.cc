@@ -0,0 +1,151 @@
+#include "audio_mixer.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cmath>
+
+#define TAG "AudioMixer"
+
+AudioMixer::AudioMixer(int sample_rate, size_t blocks, size_t block_samples, int duck_db) : sample_rate_(sample_rate) {
+    for (auto& source : sources_) {
+        source.ring = std::make_unique<AudioPcmRing>(blocks, block_samples);
+    }
+    accumulator_.resize(block_samples);
+    duck_q15_ = (int32_t)(32768 * std::pow(10.0, -duck_db / 20.0));
+    // Full scale ramps take the attack or release time
+    attack_step_ = std::max<int32_t>(1, 32768 / (sample_rate * AUDIO_MIXER_ATTACK_MS / 1000));
+    release_step_ = std::max<int32_t>(1, 32768 / (sample_rate * AUDIO_MIXER_RELEASE_MS / 1000));
+    ESP_LOGI(TAG, "Mixer %d sources, %u blocks of %u samples, ducking %d dB", kAudioMixerSourceCount,
+        blocks, block_samples, duck_db);
+}
+
+void AudioMixer::SetGain(AudioMixerSource source, int percent) {
+    percent = std::clamp(percent, 0, 100);
+    sources_[source].gain_q15 = percent * 32768 / 100;
+}
+
+void AudioMixer::Clear(AudioMixerSource source) {
+    // The output task drops the block it holds when it sees the new count
+    sources_[source].ring->Clear();
+    sources_[source].clears.fetch_add(1, std::memory_order_release);
+}
+
+bool AudioMixer::empty() const {
+    for (auto& source : sources_) {
+        if (source.block != nullptr || !source.ring->empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AudioMixer::AcquireBlock(Source& source) {
+    uint32_t clears = source.clears.load(std::memory_order_acquire);
+    if (clears != source.seen_clears) {
+        source.seen_clears = clears;
+        if (source.block != nullptr) {
+            source.ring->ReleaseRead();
+            source.block = nullptr;
+        }
+    }
+    while (source.block == nullptr) {
+        source.block = source.ring->AcquireRead();
+        if (source.block == nullptr) {
+            return false;
+        }
+        source.offset = 0;
+        if (source.block->samples == 0) {
+            source.ring->ReleaseRead();
+            source.block = nullptr;
+        }
+    }
+    return true;
+}
+
+void AudioMixer::Accumulate(Source& source, int32_t target_q15, int samples, bool first) {
+    const int16_t* input = source.block->data + source.offset;
+    int32_t* acc = accumulator_.data();
+    int32_t gain = source.current_q15;
+    int i = 0;
+
+    // Ramp sample by sample until the target is reached
+    while (i < samples && gain != target_q15) {
+        if (gain > target_q15) {
+            gain = std::max(gain - attack_step_, target_q15);
+        } else {
+            gain = std::min(gain + release_step_, target_q15);
+        }
+        int32_t value = (input[i] * gain) >> 15;
+        acc[i] = first ? value : acc[i] + value;
+        i++;
+    }
+    source.current_q15 = gain;
+
+    if (gain == 32768) {
+        for (; i < samples; i++) {
+            acc[i] = first ? input[i] : acc[i] + input[i];
+        }
+    } else if (first) {
+        for (; i < samples; i++) {
+            acc[i] = (input[i] * gain) >> 15;
+        }
+    } else {
+        for (; i < samples; i++) {
+            acc[i] += (input[i] * gain) >> 15;
+        }
+    }
+}
+
+int AudioMixer::Mix(int16_t* output, int max_samples, AudioMixerResult* result) {
+    // Mix up to the end of the shortest block so no source has to be padded with silence
+    int samples = std::min<int>(max_samples, accumulator_.size());
+    uint32_t active = 0;
+    for (int i = 0; i < kAudioMixerSourceCount; i++) {
+        auto& source = sources_[i];
+        if (AcquireBlock(source)) {
+            active |= 1 << i;
+            samples = std::min<int>(samples, source.block->samples - source.offset);
+        } else {
+            // An idle source restarts at its gain, not where the last ramp left it
+            source.current_q15 = source.gain_q15.load(std::memory_order_relaxed);
+        }
+    }
+    if (result != nullptr) {
+        *result = {};
+        result->sources = active;
+    }
+    if (active == 0 || samples <= 0) {
+        return 0;
+    }
+
+    bool ducking = active & (1 << kAudioMixerPrompt);
+    bool first = true;
+    for (int i = 0; i < kAudioMixerSourceCount; i++) {
+        if (!(active & (1 << i))) {
+            continue;
+        }
+        auto& source = sources_[i];
+        if (result != nullptr) {
+            // A block without a timestamp keeps 0, it has no position in the server stream
+            auto timestamp = source.block->timestamp;
+            result->timestamps[i] = timestamp == 0 ? 0 : timestamp + (uint32_t)(source.offset * 1000 / sample_rate_);
+        }
+        int32_t target = source.gain_q15.load(std::memory_order_relaxed);
+        if (ducking && i == kAudioMixerStream) {
+            target = (target * duck_q15_) >> 15;
+        }
+        Accumulate(source, target, samples, first);
+        first = false;
+
+        source.offset += samples;
+        if (source.offset >= source.block->samples) {
+            source.ring->ReleaseRead();
+            source.block = nullptr;
+        }
+    }
+
+    for (int i = 0; i < samples; i++) {
+        output[i] = (int16_t)std::clamp<int32_t>(accumulator_[i], INT16_MIN, INT16_MAX);
+    }
+    return samples;
+}
@@ -0,0 +1,77 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "audio_pcm_ring.h"
+
+enum AudioMixerSource {
+    kAudioMixerStream,      // Server TTS and the recording of the audio testing mode
+    kAudioMixerPrompt,      // Local sounds, alerts and prompts
+    kAudioMixerSourceCount
+};
+
+struct AudioMixerResult {
+    uint32_t sources;                               // AudioMixerSource bits that took part
+    uint32_t timestamps[kAudioMixerSourceCount];    // Timestamp of the first mixed sample of each source, in ms
+};
+
+// Gain ramps, the attack is short so a prompt is not masked, the release is slow so speech fades back in
+#define AUDIO_MIXER_ATTACK_MS 20
+#define AUDIO_MIXER_RELEASE_MS 300
+
+/*
+ * Mixes the playback sources in front of the codec.
+ *
+ * Every source has its own ring of PCM blocks at the output sample rate, filled by the decode
+ * task and drained by Mix() on the output task, so a prompt starts within one mix period
+ * instead of waiting for the speech queued ahead of it. The stream is ducked while a prompt plays.
+ * Gains are Q15 and ramp per sample, the sum is saturated to 16 bits.
+ */
+class AudioMixer {
+public:
+    AudioMixer(int sample_rate, size_t blocks, size_t block_samples, int duck_db);
+    AudioMixer(const AudioMixer&) = delete;
+    AudioMixer& operator=(const AudioMixer&) = delete;
+
+    // Producer side, owned by the decode task
+    inline AudioPcmRing& ring(AudioMixerSource source) { return *sources_[source].ring; }
+
+    // Gain of a source in percent, 100 plays it unchanged
+    void SetGain(AudioMixerSource source, int percent);
+    // Discard the audio of a source that has not been mixed yet, may be called from any task
+    void Clear(AudioMixerSource source);
+
+    // Mixes up to max_samples from the sources holding audio, returns the number of samples written,
+    // 0 when every source is empty. The result tells which sources took part and where they were
+    int Mix(int16_t* output, int max_samples, AudioMixerResult* result = nullptr);
+
+    bool empty() const;
+
+private:
+    struct Source {
+        std::unique_ptr<AudioPcmRing> ring;
+        const AudioPcmBlock* block = nullptr;   // Block being mixed, held across Mix() calls
+        size_t offset = 0;
+        std::atomic<uint32_t> clears{0};
+        uint32_t seen_clears = 0;
+        std::atomic<int32_t> gain_q15{32768};
+        int32_t current_q15 = 32768;            // Ramped towards gain_q15, times the ducking
+    };
+
+    Source sources_[kAudioMixerSourceCount];
+    int sample_rate_;
+    std::vector<int32_t> accumulator_;
+    int32_t duck_q15_;
+    int32_t attack_step_;
+    int32_t release_step_;
+
+    bool AcquireBlock(Source& source);
+    void Accumulate(Source& source, int32_t target_q15, int samples, bool first);
+};
+
+#endif // AUDIO_MIXER_H
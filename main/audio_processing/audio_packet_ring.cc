@@ -0,0 +1,95 @@
+#include "audio_packet_ring.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <cstring>
+#include <algorithm>
+#include <cassert>
+
+#define TAG "AudioPacketRing"
+
+AudioPacketRing::AudioPacketRing(size_t capacity, size_t max_payload_size)
+    : capacity_(capacity), max_payload_size_(max_payload_size) {
+    slots_ = new Slot[capacity_]();
+    payloads_ = (uint8_t*)heap_caps_malloc(capacity_ * max_payload_size_, MALLOC_CAP_SPIRAM);
+    if (payloads_ == nullptr) {
+        payloads_ = (uint8_t*)heap_caps_malloc(capacity_ * max_payload_size_, MALLOC_CAP_8BIT);
+    }
+    assert(payloads_ != nullptr);
+}
+
+AudioPacketRing::~AudioPacketRing() {
+    heap_caps_free(payloads_);
+    delete[] slots_;
+}
+
+bool AudioPacketRing::Push(const AudioStreamPacket& packet) {
+    return Push(packet.sample_rate, packet.frame_duration, packet.timestamp, packet.payload.data(), packet.payload.size(), packet.sequence);
+}
+
+bool AudioPacketRing::Push(int sample_rate, int frame_duration, uint32_t timestamp, const uint8_t* payload, size_t size, uint32_t sequence) {
+    if (size > max_payload_size_) {
+        ESP_LOGW(TAG, "Payload size %u exceeds slot size %u, drop the packet", size, max_payload_size_);
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    size_t head = head_.load(std::memory_order_relaxed);
+    // Slots are only reusable once the consumer has moved past them, even after a Clear()
+    if (head - tail_.load(std::memory_order_acquire) >= capacity_) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    size_t index = head % capacity_;
+    auto& slot = slots_[index];
+    slot.sample_rate = sample_rate;
+    slot.frame_duration = frame_duration;
+    slot.timestamp = timestamp;
+    slot.sequence = sequence;
+    slot.push_time_us = esp_timer_get_time();
+    slot.size = size;
+    memcpy(payloads_ + index * max_payload_size_, payload, size);
+
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool AudioPacketRing::Pop(AudioStreamPacket& packet, int64_t* push_time_us) {
+    size_t tail = ConsumerTail();
+    if (tail == head_.load(std::memory_order_acquire)) {
+        tail_.store(tail, std::memory_order_release);
+        return false;
+    }
+
+    size_t index = tail % capacity_;
+    const auto& slot = slots_[index];
+    const uint8_t* payload = payloads_ + index * max_payload_size_;
+    packet.sample_rate = slot.sample_rate;
+    packet.frame_duration = slot.frame_duration;
+    packet.timestamp = slot.timestamp;
+    packet.sequence = slot.sequence;
+    packet.payload.assign(payload, payload + slot.size);
+    if (push_time_us != nullptr) {
+        *push_time_us = slot.push_time_us;
+    }
+
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+void AudioPacketRing::Clear() {
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t mark = clear_mark_.load(std::memory_order_relaxed);
+    while (mark < head && !clear_mark_.compare_exchange_weak(mark, head, std::memory_order_release)) {
+    }
+}
+
+size_t AudioPacketRing::size() const {
+    return head_.load(std::memory_order_acquire) - ConsumerTail();
+}
+
+size_t AudioPacketRing::ConsumerTail() const {
+    return std::max(tail_.load(std::memory_order_acquire), clear_mark_.load(std::memory_order_acquire));
+}
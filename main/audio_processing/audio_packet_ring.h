@@ -0,0 +1,71 @@
+#ifndef AUDIO_PACKET_RING_H
+#define AUDIO_PACKET_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.h"
+
+// Largest Opus payload a slot can hold, 512 bytes is about 68kbps at 60ms per frame
+#define AUDIO_PACKET_MAX_PAYLOAD_SIZE 512
+
+/*
+ * Fixed-capacity single-producer / single-consumer ring of audio packets.
+ *
+ * Payload storage for every slot is allocated once in the constructor (PSRAM when available),
+ * so Push() and Pop() never take a lock or touch the heap. Exactly one task may push and
+ * exactly one task may pop. Clear() may be called from any task, it is applied by the
+ * consumer on its next Pop().
+ */
+class AudioPacketRing {
+public:
+    AudioPacketRing(size_t capacity, size_t max_payload_size = AUDIO_PACKET_MAX_PAYLOAD_SIZE);
+    ~AudioPacketRing();
+    AudioPacketRing(const AudioPacketRing&) = delete;
+    AudioPacketRing& operator=(const AudioPacketRing&) = delete;
+
+    // Producer side, returns false if the ring is full or the payload is too large
+    bool Push(const AudioStreamPacket& packet);
+    bool Push(int sample_rate, int frame_duration, uint32_t timestamp, const uint8_t* payload, size_t size, uint32_t sequence = 0);
+
+    // Consumer side, copies the oldest packet into a caller owned packet
+    // The payload vector of the caller is reused, reserve() it once to stay allocation free
+    // push_time_us receives the esp_timer time at which the packet was pushed
+    bool Pop(AudioStreamPacket& packet, int64_t* push_time_us = nullptr);
+
+    // Discard every packet pushed before this call
+    void Clear();
+
+    size_t size() const;
+    inline bool empty() const { return size() == 0; }
+    inline bool full() const { return size() >= capacity_; }
+    inline size_t capacity() const { return capacity_; }
+    inline size_t max_payload_size() const { return max_payload_size_; }
+    inline uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        int sample_rate;
+        int frame_duration;
+        uint32_t timestamp;
+        uint32_t sequence;
+        int64_t push_time_us;
+        size_t size;
+    };
+
+    Slot* slots_ = nullptr;
+    uint8_t* payloads_ = nullptr;
+    size_t capacity_;
+    size_t max_payload_size_;
+
+    // Monotonic counters, the slot index is counter % capacity_
+    std::atomic<size_t> head_{0};       // Written by the producer
+    std::atomic<size_t> tail_{0};       // Written by the consumer
+    std::atomic<size_t> clear_mark_{0}; // Value of head_ at the last Clear()
+    std::atomic<uint32_t> dropped_{0};
+
+    size_t ConsumerTail() const;
+};
+
+#endif // AUDIO_PACKET_RING_H
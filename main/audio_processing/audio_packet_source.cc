@@ -0,0 +1,33 @@
+#include "audio_packet_source.h"
+#include "protocol.h"
+
+#include <esp_log.h>
+#include <arpa/inet.h>
+
+#define TAG "AudioPacketSource"
+
+P3PacketSource::P3PacketSource(std::string_view data, int sample_rate, int frame_duration)
+    : data_(data), sample_rate_(sample_rate), frame_duration_(frame_duration) {
+}
+
+bool P3PacketSource::Next(AudioPacketView& packet) {
+    if (offset_ + sizeof(BinaryProtocol3) > data_.size()) {
+        return false;
+    }
+
+    auto p3 = (const BinaryProtocol3*)(data_.data() + offset_);
+    size_t payload_size = ntohs(p3->payload_size);
+    if (offset_ + sizeof(BinaryProtocol3) + payload_size > data_.size()) {
+        ESP_LOGW(TAG, "Truncated P3 frame at offset %u", offset_);
+        offset_ = data_.size();
+        return false;
+    }
+
+    packet.sample_rate = sample_rate_;
+    packet.frame_duration = frame_duration_;
+    packet.timestamp = 0;
+    packet.payload = p3->payload;
+    packet.size = payload_size;
+    offset_ += sizeof(BinaryProtocol3) + payload_size;
+    return true;
+}
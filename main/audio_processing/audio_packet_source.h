@@ -0,0 +1,42 @@
+#ifndef AUDIO_PACKET_SOURCE_H
+#define AUDIO_PACKET_SOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// A packet that borrows its payload from the source, valid until the next call to Next()
+struct AudioPacketView {
+    int sample_rate = 0;
+    int frame_duration = 0;
+    uint32_t timestamp = 0;
+    const uint8_t* payload = nullptr;
+    size_t size = 0;
+    bool fec = false;   // The payload is the next frame, decode the missing one from its FEC data
+};
+
+class AudioPacketSource {
+public:
+    virtual ~AudioPacketSource() = default;
+    // Returns false once the source is exhausted
+    virtual bool Next(AudioPacketView& packet) = 0;
+};
+
+/*
+ * Walks the BinaryProtocol3 frames of a P3 asset in place.
+ * The asset stays in the memory mapped flash partition, no payload is copied.
+ */
+class P3PacketSource : public AudioPacketSource {
+public:
+    P3PacketSource(std::string_view data, int sample_rate = 16000, int frame_duration = 60);
+
+    bool Next(AudioPacketView& packet) override;
+
+private:
+    std::string_view data_;
+    size_t offset_ = 0;
+    int sample_rate_;
+    int frame_duration_;
+};
+
+#endif // AUDIO_PACKET_SOURCE_H
@@ -0,0 +1,70 @@
+#include "audio_pcm_ring.h"
+
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <cassert>
+
+AudioPcmRing::AudioPcmRing(size_t blocks, size_t block_samples)
+    : capacity_(blocks), block_samples_(block_samples) {
+    size_t bytes = capacity_ * block_samples_ * sizeof(int16_t);
+    samples_ = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+    if (samples_ == nullptr) {
+        samples_ = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+    }
+    assert(samples_ != nullptr);
+
+    blocks_ = new AudioPcmBlock[capacity_]();
+    for (size_t i = 0; i < capacity_; i++) {
+        blocks_[i].data = samples_ + i * block_samples_;
+    }
+}
+
+AudioPcmRing::~AudioPcmRing() {
+    delete[] blocks_;
+    heap_caps_free(samples_);
+}
+
+AudioPcmBlock* AudioPcmRing::AcquireWrite() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= capacity_) {
+        return nullptr;
+    }
+    auto block = &blocks_[head % capacity_];
+    block->samples = 0;
+    block->timestamp = 0;
+    block->frame_end = false;
+    return block;
+}
+
+void AudioPcmRing::CommitWrite() {
+    head_.fetch_add(1, std::memory_order_release);
+}
+
+const AudioPcmBlock* AudioPcmRing::AcquireRead() {
+    size_t tail = ConsumerTail();
+    if (tail == head_.load(std::memory_order_acquire)) {
+        tail_.store(tail, std::memory_order_release);
+        return nullptr;
+    }
+    reading_ = tail;
+    return &blocks_[tail % capacity_];
+}
+
+void AudioPcmRing::ReleaseRead() {
+    tail_.store(reading_ + 1, std::memory_order_release);
+}
+
+void AudioPcmRing::Clear() {
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t mark = clear_mark_.load(std::memory_order_relaxed);
+    while (mark < head && !clear_mark_.compare_exchange_weak(mark, head, std::memory_order_release)) {
+    }
+}
+
+size_t AudioPcmRing::size() const {
+    return head_.load(std::memory_order_acquire) - ConsumerTail();
+}
+
+size_t AudioPcmRing::ConsumerTail() const {
+    return std::max(tail_.load(std::memory_order_acquire), clear_mark_.load(std::memory_order_acquire));
+}
@@ -0,0 +1,60 @@
+#ifndef AUDIO_PCM_RING_H
+#define AUDIO_PCM_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+struct AudioPcmBlock {
+    int16_t* data;      // Points to block_samples() samples owned by the ring
+    size_t samples;
+    uint32_t timestamp;
+    bool frame_end;     // Last block of a decoded frame
+};
+
+/*
+ * Fixed-capacity single-producer / single-consumer ring of PCM blocks.
+ *
+ * The producer fills a block in place between AcquireWrite() and CommitWrite(), the consumer
+ * reads it in place between AcquireRead() and ReleaseRead(), so no samples are copied and
+ * nothing is allocated after construction. Clear() may be called from any task.
+ */
+class AudioPcmRing {
+public:
+    AudioPcmRing(size_t blocks, size_t block_samples);
+    ~AudioPcmRing();
+    AudioPcmRing(const AudioPcmRing&) = delete;
+    AudioPcmRing& operator=(const AudioPcmRing&) = delete;
+
+    // Producer side, returns nullptr if every block is in use
+    AudioPcmBlock* AcquireWrite();
+    void CommitWrite();
+
+    // Consumer side, returns nullptr if nothing is ready
+    const AudioPcmBlock* AcquireRead();
+    void ReleaseRead();
+
+    // Discard every block committed before this call
+    void Clear();
+
+    size_t size() const;
+    inline bool empty() const { return size() == 0; }
+    inline bool full() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire) >= capacity_; }
+    inline size_t capacity() const { return capacity_; }
+    inline size_t block_samples() const { return block_samples_; }
+
+private:
+    AudioPcmBlock* blocks_ = nullptr;
+    int16_t* samples_ = nullptr;
+    size_t capacity_;
+    size_t block_samples_;
+
+    std::atomic<size_t> head_{0};       // Written by the producer
+    std::atomic<size_t> tail_{0};       // Written by the consumer
+    std::atomic<size_t> clear_mark_{0}; // Value of head_ at the last Clear()
+    size_t reading_ = 0;                // Block held by the consumer
+
+    size_t ConsumerTail() const;
+};
+
+#endif // AUDIO_PCM_RING_H
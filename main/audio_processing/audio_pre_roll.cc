@@ -0,0 +1,69 @@
+#include "audio_pre_roll.h"
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#define TAG "AudioPreRoll"
+
+AudioPreRoll::AudioPreRoll(int sample_rate, int duration_ms)
+    : limit_((size_t)sample_rate * duration_ms / 1000), sample_rate_(sample_rate) {
+    size_t storage = 1;
+    while (storage < limit_) {
+        storage <<= 1;
+    }
+    mask_ = storage - 1;
+    size_t bytes = storage * sizeof(int16_t);
+    samples_ = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+    if (samples_ == nullptr) {
+        samples_ = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+    }
+    assert(samples_ != nullptr);
+    ESP_LOGI(TAG, "Pre-roll %d ms, %u bytes", duration_ms, bytes);
+}
+
+AudioPreRoll::~AudioPreRoll() {
+    heap_caps_free(samples_);
+}
+
+void AudioPreRoll::Write(const int16_t* data, size_t samples) {
+    uint32_t end = end_.load(std::memory_order_relaxed);
+    uint32_t new_end = end + samples;
+    // Only the newest limit_ samples can survive the write
+    if (samples > limit_) {
+        data += samples - limit_;
+        samples = limit_;
+    }
+    if (new_end - begin_.load(std::memory_order_relaxed) > limit_) {
+        // Move begin before overwriting, so a reader copying these samples notices
+        begin_.store(new_end - limit_, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    size_t index = (new_end - samples) & mask_;
+    size_t first = std::min(samples, mask_ + 1 - index);
+    memcpy(samples_ + index, data, first * sizeof(int16_t));
+    memcpy(samples_, data + first, (samples - first) * sizeof(int16_t));
+    end_.store(new_end, std::memory_order_release);
+}
+
+void AudioPreRoll::Clear() {
+    begin_.store(end_.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+bool AudioPreRoll::Copy(uint32_t position, int16_t* out, size_t samples) const {
+    uint32_t end = end_.load(std::memory_order_acquire);
+    if ((int32_t)(position - begin_.load(std::memory_order_acquire)) < 0 || (int32_t)(end - position) < (int32_t)samples) {
+        return false;
+    }
+    size_t index = position & mask_;
+    size_t first = std::min(samples, mask_ + 1 - index);
+    memcpy(out, samples_ + index, first * sizeof(int16_t));
+    memcpy(out + first, samples_, (samples - first) * sizeof(int16_t));
+
+    // The writer may have overwritten the samples while they were copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return (int32_t)(position - begin_.load(std::memory_order_relaxed)) >= 0;
+}
@@ -0,0 +1,47 @@
+#ifndef AUDIO_PRE_ROLL_H
+#define AUDIO_PRE_ROLL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Fixed ring holding the most recent audio, for the pre-roll sent with a wake word.
+ *
+ * The samples live in one PSRAM allocation made at construction, a write overwrites the
+ * oldest samples once the ring is full, so nothing is allocated while the device idles.
+ * Samples are addressed by position, counted from construction and wrapping at 2^32,
+ * so one task can write while another reads behind it. Copy() fails if the writer
+ * overwrote the samples in the meantime.
+ */
+class AudioPreRoll {
+public:
+    AudioPreRoll(int sample_rate, int duration_ms);
+    ~AudioPreRoll();
+    AudioPreRoll(const AudioPreRoll&) = delete;
+    AudioPreRoll& operator=(const AudioPreRoll&) = delete;
+
+    // Writer side
+    void Write(const int16_t* data, size_t samples);
+    // Drops every sample written so far
+    void Clear();
+
+    // Reader side, the ring holds the positions [begin(), end())
+    inline uint32_t begin() const { return begin_.load(std::memory_order_acquire); }
+    inline uint32_t end() const { return end_.load(std::memory_order_acquire); }
+    bool Copy(uint32_t position, int16_t* out, size_t samples) const;
+
+    inline size_t size() const { return end() - begin(); }
+    inline size_t capacity() const { return limit_; }
+    inline int sample_rate() const { return sample_rate_; }
+
+private:
+    int16_t* samples_ = nullptr;
+    size_t limit_;      // Samples held, the pre-roll duration
+    uint32_t mask_;     // Storage is a power of two so positions wrap with the index
+    int sample_rate_;
+    std::atomic<uint32_t> begin_{0};
+    std::atomic<uint32_t> end_{0};
+};
+
+#endif // AUDIO_PRE_ROLL_H
@@ -6,6 +6,14 @@
 #include <functional>
 
 #include "audio_codec.h"
+#include "audio_frame_pool.h"
+
+// Output frames in flight: queued for the encoder, plus held back by the silence gate
+#if CONFIG_AUDIO_UPLINK_DTX
+#define AUDIO_PROCESSOR_OUTPUT_POOL_MS (500 + CONFIG_AUDIO_UPLINK_DTX_PRE_ROLL_MS)
+#else
+#define AUDIO_PROCESSOR_OUTPUT_POOL_MS 500
+#endif
 
 class AudioProcessor {
 public:
@@ -16,7 +24,9 @@ public:
     virtual void Start() = 0;
     virtual void Stop() = 0;
     virtual bool IsRunning() = 0;
+    // The frames passed to the callback are borrowed from output_pool(), release them once consumed
     virtual void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) = 0;
+    virtual AudioFramePool& output_pool() = 0;
     virtual void OnVadStateChange(std::function<void(bool speaking)> callback) = 0;
     virtual size_t GetFeedSize() = 0;
     virtual void EnableDeviceAec(bool enable) = 0;
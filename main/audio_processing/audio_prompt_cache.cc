@@ -0,0 +1,148 @@
+#include "audio_prompt_cache.h"
+#include "audio_packet_source.h"
+#include "opus_stream_decoder.h"
+#include "polyphase_resampler.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#define TAG "AudioPromptCache"
+
+// P3 assets are always 16kHz mono with 60ms frames
+#define PROMPT_SAMPLE_RATE 16000
+#define PROMPT_FRAME_DURATION_MS 60
+
+AudioPromptCache::AudioPromptCache(size_t budget_bytes, int output_sample_rate)
+    : budget_bytes_(budget_bytes), output_sample_rate_(output_sample_rate) {
+}
+
+AudioPromptCache::~AudioPromptCache() {
+    for (auto& entry : entries_) {
+        heap_caps_free(entry.pcm);
+    }
+}
+
+void AudioPromptCache::Register(const std::string_view& sound) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    registered_.push_back(sound);
+}
+
+void AudioPromptCache::LoadRegistered() {
+    std::list<std::string_view> registered;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        registered = registered_;
+    }
+    for (auto& sound : registered) {
+        Load(sound);
+    }
+    ESP_LOGI(TAG, "%u prompts cached, %u/%u bytes used", entries_.size(), used_bytes_, budget_bytes_);
+}
+
+bool AudioPromptCache::IsCached(const char* key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : entries_) {
+        if (entry.key == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool AudioPromptCache::Load(const std::string_view& sound) {
+    if (sound.empty() || IsCached(sound.data())) {
+        return !sound.empty();
+    }
+
+    // Count the frames first so the PCM buffer is allocated once with its final size
+    size_t frames = 0;
+    AudioPacketView packet;
+    P3PacketSource counter(sound);
+    while (counter.Next(packet)) {
+        frames++;
+    }
+    if (frames == 0) {
+        return false;
+    }
+
+    OpusStreamDecoder decoder(PROMPT_SAMPLE_RATE, 1, PROMPT_FRAME_DURATION_MS);
+    PolyphaseResampler resampler;
+    bool resample = output_sample_rate_ != PROMPT_SAMPLE_RATE;
+    if (resample) {
+        resampler.Configure(PROMPT_SAMPLE_RATE, output_sample_rate_);
+    }
+    size_t frame_samples = resample ? resampler.GetOutputSamples(decoder.frame_size()) : decoder.frame_size();
+    size_t capacity = frames * frame_samples;
+    size_t bytes = capacity * sizeof(int16_t);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (used_bytes_ + bytes > budget_bytes_) {
+            ESP_LOGW(TAG, "Prompt needs %u bytes, only %u of %u left", bytes, budget_bytes_ - used_bytes_, budget_bytes_);
+            return false;
+        }
+        used_bytes_ += bytes;
+    }
+
+    auto pcm = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+    if (pcm == nullptr) {
+        pcm = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+    }
+    if (pcm == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes for a prompt", bytes);
+        std::lock_guard<std::mutex> lock(mutex_);
+        used_bytes_ -= bytes;
+        return false;
+    }
+
+    std::vector<int16_t> frame(decoder.frame_size());
+    size_t samples = 0;
+    P3PacketSource source(sound);
+    while (source.Next(packet)) {
+        int decoded = decoder.Decode(packet.payload, packet.size, frame.data());
+        if (decoded <= 0) {
+            continue;
+        }
+        if (resample) {
+            int output = resampler.GetOutputSamples(decoded);
+            if (samples + output > capacity) {
+                break;
+            }
+            resampler.Process(frame.data(), decoded, pcm + samples);
+            samples += output;
+        } else {
+            size_t count = std::min<size_t>(decoded, capacity - samples);
+            memcpy(pcm + samples, frame.data(), count * sizeof(int16_t));
+            samples += count;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.push_back(Entry{
+        .key = sound.data(),
+        .pcm = pcm,
+        .samples = samples,
+    });
+    return true;
+}
+
+const AudioPromptCache::Entry* AudioPromptCache::Find(const std::string_view& sound) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : entries_) {
+        if (entry.key == sound.data()) {
+            hits_++;
+            ESP_LOGD(TAG, "Hit, %lu hits / %lu misses", hits_.load(), misses_.load());
+            return &entry;
+        }
+    }
+    for (auto& registered : registered_) {
+        if (registered.data() == sound.data()) {
+            misses_++;
+            ESP_LOGD(TAG, "Miss, %lu hits / %lu misses", hits_.load(), misses_.load());
+            break;
+        }
+    }
+    return nullptr;
+}
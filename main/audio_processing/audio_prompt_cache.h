@@ -0,0 +1,57 @@
+#ifndef AUDIO_PROMPT_CACHE_H
+#define AUDIO_PROMPT_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <list>
+#include <mutex>
+#include <atomic>
+
+/*
+ * Keeps selected P3 prompts as decoded PCM at the codec output sample rate,
+ * so they can be written to the output without running the Opus decoder.
+ *
+ * Prompts are identified by the address of their embedded asset. Entries are never
+ * evicted, Load() refuses prompts that do not fit in the budget.
+ */
+class AudioPromptCache {
+public:
+    struct Entry {
+        const char* key;
+        int16_t* pcm;
+        size_t samples;
+    };
+
+    AudioPromptCache(size_t budget_bytes, int output_sample_rate);
+    ~AudioPromptCache();
+    AudioPromptCache(const AudioPromptCache&) = delete;
+    AudioPromptCache& operator=(const AudioPromptCache&) = delete;
+
+    // Mark a prompt as worth caching, Find() only counts hits and misses for these
+    void Register(const std::string_view& sound);
+    // Decode every registered prompt that is not cached yet, may take a while
+    void LoadRegistered();
+    bool Load(const std::string_view& sound);
+
+    // Returns nullptr on a miss, entries stay valid for the lifetime of the cache
+    const Entry* Find(const std::string_view& sound);
+
+    inline size_t used_bytes() const { return used_bytes_; }
+    inline uint32_t hits() const { return hits_; }
+    inline uint32_t misses() const { return misses_; }
+
+private:
+    std::mutex mutex_;
+    std::list<Entry> entries_;
+    std::list<std::string_view> registered_;
+    size_t budget_bytes_;
+    size_t used_bytes_ = 0;
+    int output_sample_rate_;
+    std::atomic<uint32_t> hits_{0};
+    std::atomic<uint32_t> misses_{0};
+
+    bool IsCached(const char* key);
+};
+
+#endif // AUDIO_PROMPT_CACHE_H
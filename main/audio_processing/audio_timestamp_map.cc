@@ -0,0 +1,29 @@
+#include "audio_timestamp_map.h"
+
+#include <algorithm>
+
+void AudioTimestampMap::Mark(uint32_t position, uint32_t frames, uint32_t timestamp) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    spans_[count_ % AUDIO_TIMESTAMP_MAP_SIZE] = Span{position, frames, timestamp};
+    count_++;
+}
+
+uint32_t AudioTimestampMap::Lookup(uint32_t position) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Newest first, a later span overrides an older one at the same position
+    size_t spans = std::min<size_t>(count_, AUDIO_TIMESTAMP_MAP_SIZE);
+    for (size_t i = 1; i <= spans; i++) {
+        auto& span = spans_[(count_ - i) % AUDIO_TIMESTAMP_MAP_SIZE];
+        uint32_t offset = position - span.position;
+        if (offset < span.frames) {
+            // A zero timestamp marks audio without a reference, such as prompts or silence
+            return span.timestamp == 0 ? 0 : span.timestamp + (uint32_t)((uint64_t)offset * 1000 / sample_rate_);
+        }
+    }
+    return 0;
+}
+
+void AudioTimestampMap::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    count_ = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef AUDIO_TIMESTAMP_MAP_H
+#define AUDIO_TIMESTAMP_MAP_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+
+// Spans kept, about a second of 20 ms playback blocks or 32 ms capture blocks
+#define AUDIO_TIMESTAMP_MAP_SIZE 64
+
+/*
+ * Maps positions in a sample stream to the server timestamp of the audio at that position,
+ * for stamping the uplink with the playback reference of server-side AEC.
+ * Positions count frames and wrap around, a marked span advances one millisecond of
+ * timestamp per millisecond of samples. Mark and Lookup may be called from different tasks.
+ */
+class AudioTimestampMap {
+public:
+    explicit AudioTimestampMap(int sample_rate) : sample_rate_(sample_rate) {}
+
+    // The frames from position on carry the audio of the given server timestamp
+    void Mark(uint32_t position, uint32_t frames, uint32_t timestamp);
+    // Server timestamp of the frame at position, 0 when no recent span holds it
+    uint32_t Lookup(uint32_t position);
+    void Clear();
+
+private:
+    struct Span {
+        uint32_t position;
+        uint32_t frames;
+        uint32_t timestamp;
+    };
+
+    int sample_rate_;
+    std::mutex mutex_;
+    Span spans_[AUDIO_TIMESTAMP_MAP_SIZE] = {};
+    size_t count_ = 0;
+};
+
+#endif // AUDIO_TIMESTAMP_MAP_H
@@ -0,0 +1,77 @@
+#include "drift_compensator.h"
+
+#include <algorithm>
+
+// Proportional gain in ppm per millisecond of excess buffering
+#define DRIFT_COMPENSATOR_KP 4
+// Integral gain in ppm per millisecond per frame, Q8
+#define DRIFT_COMPENSATOR_KI_Q8 4
+// Smoothing of the queue level, one over this many frames
+#define DRIFT_COMPENSATOR_AVERAGE_FRAMES 32
+// Frames the playback ring and DMA take to fill at the start of a stream, then the frames averaged into the setpoint
+#define DRIFT_COMPENSATOR_FILL_FRAMES 4
+#define DRIFT_COMPENSATOR_SETPOINT_FRAMES 8
+
+void DriftCompensator::Reset() {
+    frames_ = 0;
+    setpoint_q8_ = 0;
+    average_q8_ = 0;
+    position_q32_ = 1LL << 32;
+    history_[0] = history_[1] = history_[2] = 0;
+}
+
+void DriftCompensator::UpdateFill(int queued_ms) {
+    const int32_t max_q8 = DRIFT_COMPENSATOR_MAX_PPM << 8;
+    if (frames_ < DRIFT_COMPENSATOR_FILL_FRAMES + DRIFT_COMPENSATOR_SETPOINT_FRAMES) {
+        // Play at the learned offset until the setpoint is known
+        if (frames_++ >= DRIFT_COMPENSATOR_FILL_FRAMES) {
+            setpoint_q8_ += queued_ms << 8;
+        }
+        if (frames_ == DRIFT_COMPENSATOR_FILL_FRAMES + DRIFT_COMPENSATOR_SETPOINT_FRAMES) {
+            setpoint_q8_ /= DRIFT_COMPENSATOR_SETPOINT_FRAMES;
+            average_q8_ = setpoint_q8_;
+        }
+        ppm_ = integral_q8_ >> 8;
+        return;
+    }
+
+    // Packets arrive in bursts, only the trend of the queue level is drift
+    average_q8_ += ((queued_ms << 8) - average_q8_) / DRIFT_COMPENSATOR_AVERAGE_FRAMES;
+    int32_t error_q8 = average_q8_ - setpoint_q8_;
+
+    integral_q8_ = std::clamp(integral_q8_ + error_q8 * DRIFT_COMPENSATOR_KI_Q8 / 256, -max_q8, max_q8);
+    ppm_ = std::clamp((error_q8 * DRIFT_COMPENSATOR_KP + integral_q8_) / 256, -DRIFT_COMPENSATOR_MAX_PPM, DRIFT_COMPENSATOR_MAX_PPM);
+}
+
+int DriftCompensator::Process(const int16_t* input, int samples, int16_t* output) {
+    // Positions index the three history samples followed by the input, a positive ppm consumes the input faster
+    auto at = [&](int index) -> int32_t {
+        return index < 3 ? history_[index] : input[index - 3];
+    };
+    int64_t step_q32 = (1LL << 32) + ((int64_t)ppm_ << 32) / 1000000;
+
+    int written = 0;
+    while ((position_q32_ >> 32) <= samples && written < samples + DRIFT_COMPENSATOR_MAX_EXTRA_SAMPLES) {
+        int i = position_q32_ >> 32;
+        // Fraction in Q16, all integer since ESP32-C3 has no FPU. Q15 would be off by a step of a
+        // full scale tone near Nyquist times 2^-15, more than one LSB
+        int32_t t = (uint32_t)position_q32_ >> 16;
+        int32_t xm1 = at(i - 1), x0 = at(i), x1 = at(i + 1), x2 = at(i + 2);
+        // Catmull-Rom between x0 and x1 with doubled coefficients, evaluated by Horner's rule.
+        // The terms stay within 21 bits, only the products with t need 64
+        int32_t c1 = x1 - xm1;
+        int32_t c2 = 2 * xm1 - 5 * x0 + 4 * x1 - x2;
+        int32_t c3 = x2 - xm1 + 3 * (x0 - x1);
+        int32_t y = (int32_t)(((int64_t)c3 * t + (1 << 15)) >> 16) + c2;
+        y = (int32_t)(((int64_t)y * t + (1 << 15)) >> 16) + c1;
+        y = x0 + (int32_t)(((int64_t)y * t + (1 << 16)) >> 17);
+        output[written++] = (int16_t)std::clamp(y, -32768, 32767);
+        position_q32_ += step_q32;
+    }
+
+    position_q32_ -= (int64_t)samples << 32;
+    for (int k = 0; k < 3; k++) {
+        history_[k] = at(samples + k);
+    }
+    return written;
+}
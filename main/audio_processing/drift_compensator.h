@@ -0,0 +1,43 @@
+#ifndef DRIFT_COMPENSATOR_H
+#define DRIFT_COMPENSATOR_H
+
+#include <cstdint>
+
+#define DRIFT_COMPENSATOR_MAX_PPM 500
+// A frame never grows by more than this, playback blocks keep room for it
+#define DRIFT_COMPENSATOR_MAX_EXTRA_SAMPLES 4
+
+/*
+ * Absorbs the rate difference between the server's audio clock and the local I2S clock.
+ *
+ * The server stream is played through a cubic interpolator whose ratio differs from 1 by
+ * at most DRIFT_COMPENSATOR_MAX_PPM. A PI controller sets the ratio from all the audio
+ * queued ahead of the DAC, compared with the level the stream settled at when its playback
+ * started: a queue that keeps growing is played slightly faster, one that keeps shrinking
+ * slightly slower. The integral term learns the clock offset itself and is kept across
+ * streams, so later turns start out compensated.
+ * Only used from the decode task.
+ */
+class DriftCompensator {
+public:
+    // Starts a new stream, the learned clock offset is kept
+    void Reset();
+    // Called once per frame with the audio queued ahead of the DAC: the jitter buffer, the playback ring and the DMA.
+    // The level of the first frames after Reset() becomes the setpoint of the stream
+    void UpdateFill(int queued_ms);
+    // output must hold samples + DRIFT_COMPENSATOR_MAX_EXTRA_SAMPLES, returns the samples written
+    int Process(const int16_t* input, int samples, int16_t* output);
+
+    inline int ppm() const { return ppm_; }
+
+private:
+    int ppm_ = 0;
+    int frames_ = 0;                // Updates since Reset(), counted until the setpoint is latched
+    int32_t setpoint_q8_ = 0;       // Summed over the setpoint frames, then their mean in Q8
+    int32_t average_q8_ = 0;        // Smoothed queued_ms in Q8
+    int32_t integral_q8_ = 0;       // Integral term in ppm, Q8
+    int64_t position_q32_ = 1LL << 32;
+    int16_t history_[3] = {};
+};
+
+#endif // DRIFT_COMPENSATOR_H
@@ -0,0 +1,81 @@
+#include "endpointer.h"
+
+#include <esp_log.h>
+#include <cmath>
+
+#define TAG "Endpointer"
+
+Endpointer::Endpointer(int sample_rate, int hangover_ms, int min_speech_ms, int max_utterance_ms)
+    : sample_rate_(sample_rate),
+      hangover_samples_(sample_rate / 1000 * hangover_ms),
+      min_speech_samples_(sample_rate / 1000 * min_speech_ms),
+      max_utterance_samples_(sample_rate / 1000 * max_utterance_ms) {
+}
+
+void Endpointer::Reset() {
+    in_utterance_ = false;
+    ended_ = false;
+    speech_samples_ = 0;
+    silence_samples_ = 0;
+    utterance_samples_ = 0;
+    noise_floor_db_ = -1.0f;
+}
+
+EndpointerEvent Endpointer::Process(const int16_t* data, size_t samples) {
+    if (ended_ || samples == 0) {
+        return kEndpointerNone;
+    }
+
+    int64_t sum = 0;
+    for (size_t i = 0; i < samples; i++) {
+        sum += data[i] * data[i];
+    }
+    // Mean square in dB, 0 for digital silence and about 90 at full scale
+    float energy_db = 10.0f * log10f((float)(sum / (int64_t)samples) + 1.0f);
+    // The turn often starts with speech, only frames without it may set the floor
+    float noise_floor_db = noise_floor_db_ < 0 ? ENDPOINTER_DEFAULT_NOISE_FLOOR_DB : noise_floor_db_;
+    bool speech = speaking_ && energy_db > noise_floor_db + ENDPOINTER_ENERGY_MARGIN_DB;
+    if (!speaking_) {
+        // Follow a quieter room at once, a louder one slowly
+        if (noise_floor_db_ < 0 || energy_db < noise_floor_db_) {
+            noise_floor_db_ = energy_db;
+        } else {
+            noise_floor_db_ += (energy_db - noise_floor_db_) * 0.05f;
+        }
+    }
+
+    if (!in_utterance_) {
+        if (speech) {
+            in_utterance_ = true;
+            speech_samples_ = samples;
+            silence_samples_ = 0;
+            utterance_samples_ = samples;
+        }
+        return kEndpointerNone;
+    }
+
+    utterance_samples_ += samples;
+    if (speech) {
+        speech_samples_ += samples;
+        silence_samples_ = 0;
+    } else {
+        silence_samples_ += samples;
+    }
+
+    if (silence_samples_ >= hangover_samples_) {
+        if (speech_samples_ < min_speech_samples_) {
+            // Too short for an utterance, wait for the next one
+            in_utterance_ = false;
+            return kEndpointerNone;
+        }
+        ended_ = true;
+        ESP_LOGI(TAG, "End of utterance, %d ms of speech in %d ms", speech_ms(), utterance_ms());
+        return kEndpointerSpeechEnd;
+    }
+    if (utterance_samples_ >= max_utterance_samples_) {
+        ended_ = true;
+        ESP_LOGI(TAG, "Utterance reached %d ms", utterance_ms());
+        return kEndpointerMaxUtterance;
+    }
+    return kEndpointerNone;
+}
@@ -0,0 +1,56 @@
+#ifndef ENDPOINTER_H
+#define ENDPOINTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// A frame only counts as speech this far above the noise floor, so a VAD latched on noise ends the utterance
+#define ENDPOINTER_ENERGY_MARGIN_DB 6.0f
+// Noise floor until a frame without speech was measured, a quiet room after the AFE noise suppression
+#define ENDPOINTER_DEFAULT_NOISE_FLOOR_DB 20.0f
+
+enum EndpointerEvent {
+    kEndpointerNone,
+    kEndpointerSpeechEnd,       // Silence for the hangover after enough speech
+    kEndpointerMaxUtterance,    // The utterance reached the length limit
+};
+
+/*
+ * Decides on the device when the user has finished speaking in auto stop listening.
+ *
+ * A frame is speech when the AFE VAD reports speech and its energy is above the noise floor, which is
+ * tracked over the frames without speech of the turn.
+ * The utterance starts with the first speech frame and ends once silence has lasted the hangover,
+ * provided it held at least the minimum speech, shorter bursts are dropped as noise.
+ * An utterance reaching the maximum length ends as well.
+ * Process and SetSpeaking are called from the audio processor task.
+ */
+class Endpointer {
+public:
+    Endpointer(int sample_rate, int hangover_ms, int min_speech_ms, int max_utterance_ms);
+
+    // Starts a new turn, the speaking state is kept and the noise floor measured again
+    void Reset();
+    void SetSpeaking(bool speaking) { speaking_ = speaking; }
+    // Returns an event for the frame that ends the utterance, later frames return kEndpointerNone
+    EndpointerEvent Process(const int16_t* data, size_t samples);
+
+    inline bool ended() const { return ended_; }
+    inline int speech_ms() const { return speech_samples_ * 1000 / sample_rate_; }
+    inline int utterance_ms() const { return utterance_samples_ * 1000 / sample_rate_; }
+
+private:
+    int sample_rate_;
+    size_t hangover_samples_;
+    size_t min_speech_samples_;
+    size_t max_utterance_samples_;
+    bool speaking_ = false;
+    bool in_utterance_ = false;
+    bool ended_ = false;
+    size_t speech_samples_ = 0;
+    size_t silence_samples_ = 0;
+    size_t utterance_samples_ = 0;
+    float noise_floor_db_ = -1.0f;  // Negative until the first frame without speech
+};
+
+#endif // ENDPOINTER_H
@@ -1,5 +1,7 @@
 #include "esp_wake_word.h"
 #include "application.h"
+#include "latency_tracer.h"
+#include "pcm_convert.h"
 
 #include <esp_log.h>
 #include <model_path.h>
@@ -63,10 +65,20 @@ bool EspWakeWord::IsDetectionRunning() {
 }
 
 void EspWakeWord::Feed(const std::vector<int16_t>& data) {
-    int res = wakenet_iface_->detect(wakenet_data_, (int16_t *)data.data());
+    // GetFeedSize() asks for every input channel, wakenet only takes the mic
+    const int16_t* mic = data.data();
+    int channels = codec_->input_channels();
+    if (channels > 1) {
+        size_t frames = data.size() / channels;
+        feed_buffer_.resize(frames);
+        PcmExtractChannel(data.data(), feed_buffer_.data(), frames, channels, 0);
+        mic = feed_buffer_.data();
+    }
+    int res = wakenet_iface_->detect(wakenet_data_, (int16_t *)mic);
     if (res > 0) {
         StopDetection();
         last_detected_wake_word_ = wakenet_iface_->get_word_name(wakenet_data_, res);
+        LatencyTracer::GetInstance().Mark(kLatencyWakeWordDetected);
 
         if (wake_word_detected_callback_) {
             wake_word_detected_callback_(last_detected_wake_word_);
@@ -81,7 +93,7 @@ size_t EspWakeWord::GetFeedSize() {
     return wakenet_iface_->get_samp_chunksize(wakenet_data_) * codec_->input_channels();
 }
 
-void EspWakeWord::EncodeWakeWordData() {
+void EspWakeWord::EncodeWakeWordData(int frame_duration) {
 }
 
 bool EspWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
@@ -31,7 +31,7 @@ public:
     void StopDetection();
     bool IsDetectionRunning();
     size_t GetFeedSize();
-    void EncodeWakeWordData();
+    void EncodeWakeWordData(int frame_duration);
     bool GetWakeWordOpus(std::vector<uint8_t>& opus);
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
 
@@ -44,6 +44,7 @@ private:
 
     std::function<void(const std::string& wake_word)> wake_word_detected_callback_;
     std::string last_detected_wake_word_;
+    std::vector<int16_t> feed_buffer_;  // The mic channel of a stereo feed
 };
 
 #endif
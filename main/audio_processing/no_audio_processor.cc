@@ -5,14 +5,20 @@
 
 void NoAudioProcessor::Initialize(AudioCodec* codec) {
     codec_ = codec;
+    size_t frame_samples = GetFeedSize();
+    output_pool_ = std::make_unique<AudioFramePool>((AUDIO_PROCESSOR_OUTPUT_POOL_MS + 29) / 30, frame_samples);
 }
 
 void NoAudioProcessor::Feed(const std::vector<int16_t>& data) {
     if (!is_running_ || !output_callback_) {
         return;
     }
-    // 直接将输入数据传递给输出回调
-    output_callback_(std::vector<int16_t>(data));
+    // 直接将输入数据复制到池中的帧，传递给输出回调
+    std::vector<int16_t> frame;
+    if (output_pool_->Acquire(frame)) {
+        frame.assign(data.begin(), data.end());
+        output_callback_(std::move(frame));
+    }
 }
 
 void NoAudioProcessor::Start() {
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <functional>
+#include <memory>
 
 #include "audio_processor.h"
 #include "audio_codec.h"
@@ -18,6 +19,7 @@ public:
     void Stop() override;
     bool IsRunning() override;
     void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) override;
+    AudioFramePool& output_pool() override { return *output_pool_; }
     void OnVadStateChange(std::function<void(bool speaking)> callback) override;
     size_t GetFeedSize() override;
     void EnableDeviceAec(bool enable) override;
@@ -25,6 +27,7 @@ public:
 private:
     AudioCodec* codec_ = nullptr;
     std::function<void(std::vector<int16_t>&& data)> output_callback_;
+    std::unique_ptr<AudioFramePool> output_pool_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     bool is_running_ = false;
 };
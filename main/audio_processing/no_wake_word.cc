@@ -31,7 +31,7 @@ size_t NoWakeWord::GetFeedSize() {
     return 0;  // No specific feed size requirement
 }
 
-void NoWakeWord::EncodeWakeWordData() {
+void NoWakeWord::EncodeWakeWordData(int frame_duration) {
     // Do nothing - no encoding needed
 }
 
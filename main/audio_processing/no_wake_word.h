@@ -20,7 +20,7 @@ public:
     void StopDetection() override;
     bool IsDetectionRunning() override;
     size_t GetFeedSize() override;
-    void EncodeWakeWordData() override;
+    void EncodeWakeWordData(int frame_duration) override;
     bool GetWakeWordOpus(std::vector<uint8_t>& opus) override;
     const std::string& GetLastDetectedWakeWord() const override;
 
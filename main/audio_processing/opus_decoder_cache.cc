@@ -0,0 +1,55 @@
+#include "opus_decoder_cache.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+
+#define TAG "OpusDecoderCache"
+
+OpusDecoderCache::OpusDecoderCache(int output_sample_rate) : output_sample_rate_(output_sample_rate) {
+}
+
+OpusDecoderCache::Entry& OpusDecoderCache::Get(int sample_rate, int frame_duration, int owner) {
+    Entry* victim = &entries_[0];
+    for (auto& entry : entries_) {
+        if (entry.decoder && entry.owner == owner && entry.decoder->sample_rate() == sample_rate &&
+            entry.decoder->duration_ms() == frame_duration) {
+            entry.last_used = ++use_counter_;
+            stats_.hits++;
+            return entry;
+        }
+        // Empty entries were never used, so they go before the least recently used one
+        if (entry.last_used < victim->last_used) {
+            victim = &entry;
+        }
+    }
+
+    stats_.misses++;
+    if (victim->decoder) {
+        stats_.evictions++;
+        ESP_LOGI(TAG, "Evicting decoder %dHz/%dms", victim->decoder->sample_rate(), victim->decoder->duration_ms());
+        victim->decoder.reset();
+        victim->resampler.reset();
+    }
+
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    victim->decoder = std::make_unique<OpusStreamDecoder>(sample_rate, 1, frame_duration);
+    if (sample_rate != output_sample_rate_) {
+        victim->resampler = std::make_unique<PolyphaseResampler>();
+        victim->resampler->Configure(sample_rate, output_sample_rate_);
+    }
+    size_t free_after = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    stats_.allocated_bytes = free_before > free_after ? free_before - free_after : 0;
+    victim->last_used = ++use_counter_;
+    victim->owner = owner;
+    ESP_LOGI(TAG, "Created decoder %dHz/%dms%s, %u bytes", sample_rate, frame_duration,
+        victim->resampler ? " with resampler" : "", stats_.allocated_bytes);
+    return *victim;
+}
+
+void OpusDecoderCache::ResetState(int owner) {
+    for (auto& entry : entries_) {
+        if (entry.decoder && entry.owner == owner) {
+            entry.decoder->ResetState();
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef OPUS_DECODER_CACHE_H
+#define OPUS_DECODER_CACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+#include "opus_stream_decoder.h"
+#include "polyphase_resampler.h"
+
+// Local prompts, server TTS and one spare format
+#define OPUS_DECODER_CACHE_SIZE 3
+
+/*
+ * Keeps the decoder and output resampler of the last few stream formats, keyed by
+ * owner, sample rate and frame duration. Switching between prompt and TTS playback then reuses
+ * a configured pair instead of allocating and initializing a new decoder, and each
+ * stream keeps its own decoder state. The owner keeps two streams of the same format that
+ * are decoded in turns, such as a prompt mixed over TTS, from sharing a decoder.
+ * Only used from the decode task, except GetStats().
+ */
+class OpusDecoderCache {
+public:
+    struct Entry {
+        std::unique_ptr<OpusStreamDecoder> decoder;
+        // Null when the stream is already at the output sample rate
+        std::unique_ptr<PolyphaseResampler> resampler;
+        uint32_t last_used = 0;
+        int owner = 0;
+    };
+
+    struct Stats {
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t evictions;
+        size_t allocated_bytes;     // Heap taken by the last miss
+    };
+
+    explicit OpusDecoderCache(int output_sample_rate);
+
+    // Returns the pair for the format, creating it and evicting the least recently used one if needed
+    Entry& Get(int sample_rate, int frame_duration, int owner = 0);
+    // Forgets the stream history of the decoders of an owner
+    void ResetState(int owner);
+
+    Stats GetStats() const { return stats_; }
+
+private:
+    int output_sample_rate_;
+    Entry entries_[OPUS_DECODER_CACHE_SIZE];
+    uint32_t use_counter_ = 0;
+    Stats stats_ = {};
+};
+
+#endif // OPUS_DECODER_CACHE_H
@@ -0,0 +1,171 @@
+#include "opus_encoder_controller.h"
+
+#include <esp_log.h>
+#include <cJSON.h>
+#include <algorithm>
+
+#define TAG "EncoderController"
+
+// Bitrates for 16 kHz mono speech, the last one is where a session starts
+static const int kBitrates[] = { 6000, 8000, 10000, 12000, 16000 };
+static const int kBitrateCount = sizeof(kBitrates) / sizeof(kBitrates[0]);
+
+// Share of the frame time spent encoding, in percent
+#define CPU_LOAD_HIGH 40
+#define CPU_LOAD_LOW 15
+// Encode jobs waiting on the background task, including the running one
+#define CPU_BACKLOG_HIGH 3
+#define CPU_CALM_WINDOWS 5
+// Audio waiting in the send queue, in milliseconds
+#define NETWORK_QUEUE_HIGH_MS 300
+#define NETWORK_QUEUE_LOW_MS 120
+#define NETWORK_CLEAN_WINDOWS 10
+
+void OpusEncoderController::Reset(int frame_duration, int complexity, int max_complexity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    frame_duration_ = frame_duration;
+    max_complexity_ = max_complexity;
+    complexity_ = std::min(complexity, max_complexity);
+    bitrate_index_ = kBitrateCount - 1;
+    window_frames_ = 0;
+    window_encode_us_ = 0;
+    window_max_encode_us_ = 0;
+    window_max_backlog_ = 0;
+    window_send_failures_ = 0;
+    window_max_queue_depth_ = 0;
+    input_misses_valid_ = false;
+    calm_cpu_windows_ = 0;
+    clean_network_windows_ = 0;
+}
+
+void OpusEncoderController::ResetBitrate() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bitrate_index_ = kBitrateCount - 1;
+    window_send_failures_ = 0;
+    window_max_queue_depth_ = 0;
+    clean_network_windows_ = 0;
+}
+
+int OpusEncoderController::complexity() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return complexity_;
+}
+
+int OpusEncoderController::bitrate() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return kBitrates[bitrate_index_];
+}
+
+bool OpusEncoderController::OnFramesEncoded(int frames, int64_t elapsed_us, size_t backlog, uint32_t input_misses) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    window_frames_ += frames;
+    window_encode_us_ += elapsed_us;
+    window_max_encode_us_ = std::max(window_max_encode_us_, elapsed_us / frames);
+    window_max_backlog_ = std::max(window_max_backlog_, backlog);
+    total_frames_ += frames;
+    if (window_frames_ * frame_duration_ < ENCODER_CONTROLLER_WINDOW_MS) {
+        return false;
+    }
+    return Decide(input_misses);
+}
+
+void OpusEncoderController::OnPacketSent(bool success, size_t queue_depth) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!success) {
+        window_send_failures_++;
+        total_send_failures_++;
+    }
+    window_max_queue_depth_ = std::max(window_max_queue_depth_, queue_depth);
+}
+
+bool OpusEncoderController::Decide(uint32_t input_misses) {
+    int64_t frame_us = frame_duration_ * 1000;
+    int64_t avg_encode_us = window_encode_us_ / window_frames_;
+    int cpu_load = avg_encode_us * 100 / frame_us;
+    uint32_t new_input_misses = input_misses_valid_ ? input_misses - last_input_misses_ : 0;
+    last_input_misses_ = input_misses;
+    input_misses_valid_ = true;
+    int queue_ms = window_max_queue_depth_ * frame_duration_;
+
+    int old_complexity = complexity_;
+    int old_bitrate_index = bitrate_index_;
+    char cpu_reason[64] = "";
+    char network_reason[64] = "";
+
+    // CPU: back off fast, recover slowly
+    if (cpu_load > CPU_LOAD_HIGH || window_max_encode_us_ > frame_us / 2 || window_max_backlog_ > CPU_BACKLOG_HIGH || new_input_misses > 0) {
+        calm_cpu_windows_ = 0;
+        if (complexity_ > 0) {
+            complexity_ = std::max(complexity_ - 2, 0);
+            snprintf(cpu_reason, sizeof(cpu_reason), "cpu load %d%%, backlog %u, input misses %lu",
+                cpu_load, (unsigned)window_max_backlog_, new_input_misses);
+        }
+    } else if (cpu_load < CPU_LOAD_LOW && window_max_backlog_ <= 1) {
+        if (++calm_cpu_windows_ >= CPU_CALM_WINDOWS && complexity_ < max_complexity_) {
+            calm_cpu_windows_ = 0;
+            complexity_++;
+            snprintf(cpu_reason, sizeof(cpu_reason), "cpu load %d%% for %d windows", cpu_load, CPU_CALM_WINDOWS);
+        }
+    } else {
+        calm_cpu_windows_ = 0;
+    }
+
+    // Transport: one step at a time in both directions
+    if (window_send_failures_ > 0 || queue_ms >= NETWORK_QUEUE_HIGH_MS) {
+        clean_network_windows_ = 0;
+        if (bitrate_index_ > 0) {
+            bitrate_index_--;
+            snprintf(network_reason, sizeof(network_reason), "send failures %d, queue %dms", window_send_failures_, queue_ms);
+        }
+    } else if (queue_ms <= NETWORK_QUEUE_LOW_MS) {
+        if (++clean_network_windows_ >= NETWORK_CLEAN_WINDOWS && bitrate_index_ < kBitrateCount - 1) {
+            clean_network_windows_ = 0;
+            bitrate_index_++;
+            snprintf(network_reason, sizeof(network_reason), "queue %dms for %d windows", queue_ms, NETWORK_CLEAN_WINDOWS);
+        }
+    } else {
+        clean_network_windows_ = 0;
+    }
+
+    last_cpu_load_ = cpu_load;
+    last_avg_encode_us_ = avg_encode_us;
+    last_max_encode_us_ = window_max_encode_us_;
+    window_frames_ = 0;
+    window_encode_us_ = 0;
+    window_max_encode_us_ = 0;
+    window_max_backlog_ = 0;
+    window_send_failures_ = 0;
+    window_max_queue_depth_ = 0;
+
+    if (complexity_ == old_complexity && bitrate_index_ == old_bitrate_index) {
+        return false;
+    }
+    complexity_changes_ += complexity_ != old_complexity;
+    bitrate_changes_ += bitrate_index_ != old_bitrate_index;
+    last_decision_ = std::string(cpu_reason) + (cpu_reason[0] && network_reason[0] ? "; " : "") + network_reason;
+    ESP_LOGI(TAG, "Complexity %d -> %d, bitrate %d -> %d (%s)", old_complexity, complexity_,
+        kBitrates[old_bitrate_index], kBitrates[bitrate_index_], last_decision_.c_str());
+    return true;
+}
+
+std::string OpusEncoderController::GetMetricsJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "complexity", complexity_);
+    cJSON_AddNumberToObject(root, "max_complexity", max_complexity_);
+    cJSON_AddNumberToObject(root, "bitrate", kBitrates[bitrate_index_]);
+    cJSON_AddNumberToObject(root, "frame_duration", frame_duration_);
+    cJSON_AddNumberToObject(root, "cpu_load_percent", last_cpu_load_);
+    cJSON_AddNumberToObject(root, "avg_encode_us", last_avg_encode_us_);
+    cJSON_AddNumberToObject(root, "max_encode_us", last_max_encode_us_);
+    cJSON_AddNumberToObject(root, "frames", total_frames_);
+    cJSON_AddNumberToObject(root, "send_failures", total_send_failures_);
+    cJSON_AddNumberToObject(root, "complexity_changes", complexity_changes_);
+    cJSON_AddNumberToObject(root, "bitrate_changes", bitrate_changes_);
+    cJSON_AddStringToObject(root, "last_decision", last_decision_.c_str());
+    char* json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,72 @@
+#ifndef OPUS_ENCODER_CONTROLLER_H
+#define OPUS_ENCODER_CONTROLLER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+// Length of the window the inputs are aggregated over before a decision
+#define ENCODER_CONTROLLER_WINDOW_MS 1000
+
+/*
+ * Adjusts the uplink Opus complexity and bitrate at runtime.
+ *
+ * The complexity follows the CPU: it drops at once when encoding takes too large a share
+ * of the frame time, encode jobs pile up on the background task or the input task misses
+ * its deadline, and rises one step after several calm windows.
+ * The bitrate follows the transport: it drops one step when sends fail or packets wait in
+ * the send queue, and rises one step after a longer stretch of clean windows.
+ * The gap between the thresholds and the calm window counts keep it from oscillating.
+ */
+class OpusEncoderController {
+public:
+    // Starts over from the given complexity, the complexity never exceeds max_complexity
+    void Reset(int frame_duration, int complexity, int max_complexity);
+    // Starts the bitrate over for a new connection, the complexity keeps following the CPU
+    void ResetBitrate();
+
+    // Called from the encoding task after encoding frames, returns true if the settings changed
+    bool OnFramesEncoded(int frames, int64_t elapsed_us, size_t backlog, uint32_t input_misses);
+    // Called from the main loop for every uplink packet, queue_depth is what is still waiting
+    void OnPacketSent(bool success, size_t queue_depth);
+
+    int complexity();
+    int bitrate();
+    std::string GetMetricsJson();
+
+private:
+    std::mutex mutex_;
+    int frame_duration_ = 60;
+    int complexity_ = 0;
+    int max_complexity_ = 0;
+    int bitrate_index_ = 0;
+
+    // Current window
+    int window_frames_ = 0;
+    int64_t window_encode_us_ = 0;
+    int64_t window_max_encode_us_ = 0;
+    size_t window_max_backlog_ = 0;
+    int window_send_failures_ = 0;
+    size_t window_max_queue_depth_ = 0;
+    uint32_t last_input_misses_ = 0;
+    bool input_misses_valid_ = false;
+
+    // Hysteresis
+    int calm_cpu_windows_ = 0;
+    int clean_network_windows_ = 0;
+
+    // Metrics
+    int last_cpu_load_ = 0;
+    int64_t last_avg_encode_us_ = 0;
+    int64_t last_max_encode_us_ = 0;
+    uint32_t total_frames_ = 0;
+    uint32_t total_send_failures_ = 0;
+    uint32_t complexity_changes_ = 0;
+    uint32_t bitrate_changes_ = 0;
+    std::string last_decision_;
+
+    bool Decide(uint32_t input_misses);
+};
+
+#endif // OPUS_ENCODER_CONTROLLER_H
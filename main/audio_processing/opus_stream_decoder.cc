@@ -0,0 +1,72 @@
+#include "opus_stream_decoder.h"
+
+#include <esp_log.h>
+
+#define TAG "OpusStreamDecoder"
+
+OpusStreamDecoder::OpusStreamDecoder(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), duration_ms_(duration_ms) {
+    int error;
+    decoder_ = opus_decoder_create(sample_rate, channels, &error);
+    if (decoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio decoder, error code: %d", error);
+    }
+    frame_size_ = sample_rate / 1000 * channels * duration_ms;
+}
+
+OpusStreamDecoder::~OpusStreamDecoder() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (decoder_ != nullptr) {
+        opus_decoder_destroy(decoder_);
+    }
+}
+
+int OpusStreamDecoder::Decode(const uint8_t* opus, size_t size, int16_t* pcm) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (decoder_ == nullptr) {
+        return -1;
+    }
+
+    int ret = opus_decode(decoder_, opus, size, pcm, frame_size_, 0);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to decode audio, error code: %d", ret);
+        return -1;
+    }
+    return ret;
+}
+
+int OpusStreamDecoder::Conceal(int16_t* pcm) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (decoder_ == nullptr) {
+        return -1;
+    }
+
+    // A null payload asks libopus for packet loss concealment of one frame
+    int ret = opus_decode(decoder_, nullptr, 0, pcm, frame_size_, 0);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to conceal audio, error code: %d", ret);
+        return -1;
+    }
+    return ret;
+}
+
+int OpusStreamDecoder::DecodeFec(const uint8_t* next_opus, size_t size, int16_t* pcm) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (decoder_ == nullptr) {
+        return -1;
+    }
+
+    int ret = opus_decode(decoder_, next_opus, size, pcm, frame_size_, 1);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to decode FEC data, error code: %d", ret);
+        return -1;
+    }
+    return ret;
+}
+
+void OpusStreamDecoder::ResetState() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (decoder_ != nullptr) {
+        opus_decoder_ctl(decoder_, OPUS_RESET_STATE);
+    }
+}
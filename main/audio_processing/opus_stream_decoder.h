@@ -0,0 +1,43 @@
+#ifndef OPUS_STREAM_DECODER_H
+#define OPUS_STREAM_DECODER_H
+
+#include <opus.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+
+/*
+ * Opus decoder working on caller provided buffers.
+ * Unlike OpusDecoderWrapper it exposes packet loss concealment, so the jitter buffer
+ * can fill in frames that never arrived.
+ */
+class OpusStreamDecoder {
+public:
+    OpusStreamDecoder(int sample_rate, int channels, int duration_ms = 60);
+    ~OpusStreamDecoder();
+    OpusStreamDecoder(const OpusStreamDecoder&) = delete;
+    OpusStreamDecoder& operator=(const OpusStreamDecoder&) = delete;
+
+    // pcm must hold frame_size() samples, returns the number of decoded samples or -1 on error
+    int Decode(const uint8_t* opus, size_t size, int16_t* pcm);
+    // Synthesize one missing frame from the decoder state
+    int Conceal(int16_t* pcm);
+    // Restore one missing frame from the FEC data of the packet that follows it,
+    // libopus falls back to concealment when the packet carries none
+    int DecodeFec(const uint8_t* next_opus, size_t size, int16_t* pcm);
+    void ResetState();
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+    inline int frame_size() const { return frame_size_; }
+
+private:
+    std::mutex mutex_;
+    OpusDecoder* decoder_ = nullptr;
+    int sample_rate_;
+    int duration_ms_;
+    int frame_size_;
+};
+
+#endif // OPUS_STREAM_DECODER_H
@@ -0,0 +1,109 @@
+#include "opus_stream_encoder.h"
+
+#include <esp_log.h>
+
+#define TAG "OpusStreamEncoder"
+
+OpusStreamEncoder::OpusStreamEncoder(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), duration_ms_(duration_ms) {
+    int error;
+    encoder_ = opus_encoder_create(sample_rate, channels, OPUS_APPLICATION_VOIP, &error);
+    if (encoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", error);
+        return;
+    }
+    opus_encoder_ctl(encoder_, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+    opus_encoder_ctl(encoder_, OPUS_SET_COMPLEXITY(0));
+    frame_size_ = sample_rate / 1000 * channels * duration_ms;
+    in_buffer_.reserve(frame_size_ * 2);
+    out_buffer_.resize(MAX_OPUS_PACKET_SIZE);
+}
+
+OpusStreamEncoder::~OpusStreamEncoder() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ != nullptr) {
+        opus_encoder_destroy(encoder_);
+    }
+}
+
+void OpusStreamEncoder::Encode(const std::vector<int16_t>& pcm, std::function<void(const uint8_t* opus, size_t size)> handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ == nullptr) {
+        return;
+    }
+
+    in_buffer_.insert(in_buffer_.end(), pcm.begin(), pcm.end());
+    size_t offset = 0;
+    while (in_buffer_.size() - offset >= (size_t)frame_size_) {
+        int ret = opus_encode(encoder_, in_buffer_.data() + offset, frame_size_, out_buffer_.data(), out_buffer_.size());
+        offset += frame_size_;
+        if (ret < 0) {
+            ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+            continue;
+        }
+        if (handler != nullptr) {
+            handler(out_buffer_.data(), ret);
+        }
+    }
+    in_buffer_.erase(in_buffer_.begin(), in_buffer_.begin() + offset);
+}
+
+int OpusStreamEncoder::EncodeFrame(const int16_t* pcm, uint8_t* opus, size_t max_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ == nullptr) {
+        return OPUS_INVALID_STATE;
+    }
+    int ret = opus_encode(encoder_, pcm, frame_size_, opus, max_size);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+    }
+    return ret;
+}
+
+void OpusStreamEncoder::SetComplexity(int complexity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_SET_COMPLEXITY(complexity));
+    }
+}
+
+void OpusStreamEncoder::SetBitrate(int bitrate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_SET_BITRATE(bitrate));
+    }
+}
+
+void OpusStreamEncoder::SetDtx(bool enable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_SET_DTX(enable ? 1 : 0));
+    }
+}
+
+void OpusStreamEncoder::SetInbandFec(bool enable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_SET_INBAND_FEC(enable ? 1 : 0));
+    }
+}
+
+void OpusStreamEncoder::SetPacketLossPercent(int percent) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_SET_PACKET_LOSS_PERC(percent));
+    }
+}
+
+void OpusStreamEncoder::ResetState() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_RESET_STATE);
+    }
+    in_buffer_.clear();
+}
+
+size_t OpusStreamEncoder::buffered_samples() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_buffer_.size();
+}
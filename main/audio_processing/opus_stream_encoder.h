@@ -0,0 +1,56 @@
+#ifndef OPUS_STREAM_ENCODER_H
+#define OPUS_STREAM_ENCODER_H
+
+#include <opus.h>
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#define MAX_OPUS_PACKET_SIZE 1000
+
+/*
+ * Opus encoder for the uplink.
+ * Unlike OpusEncoderWrapper it exposes the bitrate, so the encoder controller can
+ * trade quality for CPU and bandwidth while a session is running.
+ */
+class OpusStreamEncoder {
+public:
+    OpusStreamEncoder(int sample_rate, int channels, int duration_ms = 60);
+    ~OpusStreamEncoder();
+    OpusStreamEncoder(const OpusStreamEncoder&) = delete;
+    OpusStreamEncoder& operator=(const OpusStreamEncoder&) = delete;
+
+    // Buffers pcm and calls handler once for every complete frame, the packet is only valid during the call
+    void Encode(const std::vector<int16_t>& pcm, std::function<void(const uint8_t* opus, size_t size)> handler);
+    // Encodes exactly frame_size() samples in caller owned buffers, bypassing the buffered input.
+    // Returns the packet size or a negative libopus error
+    int EncodeFrame(const int16_t* pcm, uint8_t* opus, size_t max_size);
+    void SetComplexity(int complexity);
+    // Bits per second, OPUS_AUTO lets libopus choose
+    void SetBitrate(int bitrate);
+    // Lets the encoder mark silent frames as not worth transmitting (2 bytes or less)
+    void SetDtx(bool enable);
+    // In-band FEC only costs bits once the expected packet loss is above zero
+    void SetInbandFec(bool enable);
+    void SetPacketLossPercent(int percent);
+    void ResetState();
+    // Samples waiting for the next frame, the next frame starts this many samples before the next pcm
+    size_t buffered_samples();
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+    inline int frame_size() const { return frame_size_; }
+
+private:
+    std::mutex mutex_;
+    OpusEncoder* encoder_ = nullptr;
+    int sample_rate_;
+    int duration_ms_;
+    int frame_size_;
+    std::vector<int16_t> in_buffer_;
+    std::vector<uint8_t> out_buffer_;
+};
+
+#endif // OPUS_STREAM_ENCODER_H
@@ -0,0 +1,168 @@
+#include "pcm_convert.h"
+
+#include <algorithm>
+
+static inline bool IsWordAligned(const void* p) {
+    return ((uintptr_t)p & 3) == 0;
+}
+
+void PcmDeinterleave2(const int16_t* input, int16_t* left, int16_t* right, size_t frames) {
+    size_t i = 0;
+    if (IsWordAligned(input) && IsWordAligned(left) && IsWordAligned(right)) {
+        // One 32-bit load per stereo frame and one 32-bit store per two mono samples (little endian)
+        auto in = (const uint32_t*)input;
+        auto l = (uint32_t*)left;
+        auto r = (uint32_t*)right;
+        for (; i + 4 <= frames; i += 4) {
+            uint32_t f0 = in[i], f1 = in[i + 1], f2 = in[i + 2], f3 = in[i + 3];
+            l[i / 2] = (f0 & 0xFFFF) | (f1 << 16);
+            r[i / 2] = (f0 >> 16) | (f1 & 0xFFFF0000);
+            l[i / 2 + 1] = (f2 & 0xFFFF) | (f3 << 16);
+            r[i / 2 + 1] = (f2 >> 16) | (f3 & 0xFFFF0000);
+        }
+    }
+    for (; i < frames; i++) {
+        left[i] = input[i * 2];
+        right[i] = input[i * 2 + 1];
+    }
+}
+
+void PcmInterleave2(const int16_t* left, const int16_t* right, int16_t* output, size_t frames) {
+    size_t i = 0;
+    if (IsWordAligned(output) && IsWordAligned(left) && IsWordAligned(right)) {
+        auto l = (const uint32_t*)left;
+        auto r = (const uint32_t*)right;
+        auto out = (uint32_t*)output;
+        for (; i + 4 <= frames; i += 4) {
+            uint32_t l0 = l[i / 2], r0 = r[i / 2], l1 = l[i / 2 + 1], r1 = r[i / 2 + 1];
+            out[i] = (l0 & 0xFFFF) | (r0 << 16);
+            out[i + 1] = (l0 >> 16) | (r0 & 0xFFFF0000);
+            out[i + 2] = (l1 & 0xFFFF) | (r1 << 16);
+            out[i + 3] = (l1 >> 16) | (r1 & 0xFFFF0000);
+        }
+    }
+    for (; i < frames; i++) {
+        output[i * 2] = left[i];
+        output[i * 2 + 1] = right[i];
+    }
+}
+
+void PcmExtractChannel(const int16_t* input, int16_t* output, size_t frames, int channels, int channel) {
+    if (channels == 1) {
+        std::copy(input, input + frames, output);
+        return;
+    }
+    const int16_t* in = input + channel;
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        output[i] = in[0];
+        output[i + 1] = in[channels];
+        output[i + 2] = in[channels * 2];
+        output[i + 3] = in[channels * 3];
+        in += channels * 4;
+    }
+    for (; i < frames; i++, in += channels) {
+        output[i] = *in;
+    }
+}
+
+int32_t PcmVolumeToGain(int volume) {
+    volume = std::clamp(volume, 0, 100);
+    // (volume / 100)^2 in Q16, without floating point
+    return (int32_t)((int64_t)volume * volume * 65536 / 10000);
+}
+
+static inline int16_t SaturateInt16(int32_t value) {
+    return (int16_t)std::clamp<int32_t>(value, INT16_MIN, INT16_MAX);
+}
+
+static inline int32_t SaturateSlot(int64_t value) {
+    return (int32_t)std::clamp<int64_t>(value, INT32_MIN, INT32_MAX);
+}
+
+void PcmApplyGain(const int16_t* input, int16_t* output, size_t samples, int32_t gain_q16) {
+    if (gain_q16 == 65536) {
+        if (output != input) {
+            std::copy(input, input + samples, output);
+        }
+        return;
+    }
+    size_t i = 0;
+    if (gain_q16 < 65536) {
+        // Attenuation cannot overflow, the product fits in 32 bits
+        for (; i + 4 <= samples; i += 4) {
+            output[i] = (int16_t)((input[i] * gain_q16) >> 16);
+            output[i + 1] = (int16_t)((input[i + 1] * gain_q16) >> 16);
+            output[i + 2] = (int16_t)((input[i + 2] * gain_q16) >> 16);
+            output[i + 3] = (int16_t)((input[i + 3] * gain_q16) >> 16);
+        }
+    }
+    for (; i < samples; i++) {
+        output[i] = SaturateInt16((int32_t)(((int64_t)input[i] * gain_q16) >> 16));
+    }
+}
+
+void PcmToSlot32(const int16_t* input, int32_t* output, size_t samples, int32_t gain_q16) {
+    size_t i = 0;
+    if (gain_q16 <= 65536) {
+        // |sample| * 65536 is at most 2^31, the 32-bit product cannot overflow
+        for (; i + 4 <= samples; i += 4) {
+            output[i] = input[i] * gain_q16;
+            output[i + 1] = input[i + 1] * gain_q16;
+            output[i + 2] = input[i + 2] * gain_q16;
+            output[i + 3] = input[i + 3] * gain_q16;
+        }
+    }
+    for (; i < samples; i++) {
+        output[i] = SaturateSlot((int64_t)input[i] * gain_q16);
+    }
+}
+
+void PcmToSlot32Dual(const int16_t* input, int32_t* output, size_t samples, int32_t gain_q16) {
+    size_t i = 0;
+    if (gain_q16 <= 65536) {
+        for (; i + 2 <= samples; i += 2) {
+            int32_t s0 = input[i] * gain_q16;
+            int32_t s1 = input[i + 1] * gain_q16;
+            output[i * 2] = s0;
+            output[i * 2 + 1] = s0;
+            output[i * 2 + 2] = s1;
+            output[i * 2 + 3] = s1;
+        }
+    }
+    for (; i < samples; i++) {
+        int32_t s = SaturateSlot((int64_t)input[i] * gain_q16);
+        output[i * 2] = s;
+        output[i * 2 + 1] = s;
+    }
+}
+
+void PcmFromSlot32(const int32_t* input, int16_t* output, size_t samples, int shift) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        output[i] = SaturateInt16(input[i] >> shift);
+        output[i + 1] = SaturateInt16(input[i + 1] >> shift);
+        output[i + 2] = SaturateInt16(input[i + 2] >> shift);
+        output[i + 3] = SaturateInt16(input[i + 3] >> shift);
+    }
+    for (; i < samples; i++) {
+        output[i] = SaturateInt16(input[i] >> shift);
+    }
+}
+
+void PcmByteSwap16(const int16_t* input, int16_t* output, size_t samples) {
+    size_t i = 0;
+    if (IsWordAligned(input) && IsWordAligned(output)) {
+        // Two samples per 32-bit word
+        auto in = (const uint32_t*)input;
+        auto out = (uint32_t*)output;
+        for (; i + 2 <= samples; i += 2) {
+            uint32_t w = in[i / 2];
+            out[i / 2] = ((w & 0x00FF00FF) << 8) | ((w >> 8) & 0x00FF00FF);
+        }
+    }
+    for (; i < samples; i++) {
+        uint16_t v = (uint16_t)input[i];
+        output[i] = (int16_t)((v << 8) | (v >> 8));
+    }
+}
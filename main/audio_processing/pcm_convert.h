@@ -0,0 +1,40 @@
+#ifndef PCM_CONVERT_H
+#define PCM_CONVERT_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Sample layout kernels for the capture and playback paths.
+ * They work on caller owned buffers and never allocate. They are plain scalar loops,
+ * unrolled or word-wise where that saves loads and stores; there is no SIMD code yet.
+ */
+
+// Split interleaved stereo (L R L R ...) into two mono buffers
+void PcmDeinterleave2(const int16_t* input, int16_t* left, int16_t* right, size_t frames);
+
+// Merge two mono buffers into interleaved stereo
+void PcmInterleave2(const int16_t* left, const int16_t* right, int16_t* output, size_t frames);
+
+// Copy one channel out of interleaved frames
+void PcmExtractChannel(const int16_t* input, int16_t* output, size_t frames, int channels, int channel);
+
+// Q16 gain for an output volume of 0-100, on the quadratic curve of the I2S codecs (65536 at 100)
+int32_t PcmVolumeToGain(int volume);
+
+// Scale by a Q16 gain, saturating; output may be input
+void PcmApplyGain(const int16_t* input, int16_t* output, size_t samples, int32_t gain_q16);
+
+// Expand to 32-bit I2S slots scaled by a Q16 gain, saturating; 65536 puts the sample in the high half
+void PcmToSlot32(const int16_t* input, int32_t* output, size_t samples, int32_t gain_q16);
+
+// Same, writing each sample to both slots of a stereo frame, output holds 2 * samples
+void PcmToSlot32Dual(const int16_t* input, int32_t* output, size_t samples, int32_t gain_q16);
+
+// Narrow 32-bit I2S slots to 16 bits by an arithmetic right shift, saturating
+void PcmFromSlot32(const int32_t* input, int16_t* output, size_t samples, int shift);
+
+// Swap the two bytes of every 16-bit word, for big endian slots and RGB565 pixels; output may be input
+void PcmByteSwap16(const int16_t* input, int16_t* output, size_t samples);
+
+#endif // PCM_CONVERT_H
@@ -0,0 +1,181 @@
+#include "polyphase_resampler.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S3
+#include <dsps_dotprod.h>
+#define POLYPHASE_RESAMPLER_USE_DSP 1
+#endif
+
+#define TAG "PolyphaseResampler"
+
+// Kaiser window shape, about 60 dB of stopband attenuation
+#define KAISER_BETA 6.0f
+// Passband edge as a share of the lower Nyquist frequency
+#define PASSBAND_RATIO 0.92f
+
+PolyphaseResampler::~PolyphaseResampler() {
+    Release();
+}
+
+void PolyphaseResampler::Release() {
+    heap_caps_free(coefficients_);
+    heap_caps_free(buffer_);
+    heap_caps_free(odd_buffer_);
+    coefficients_ = nullptr;
+    buffer_ = nullptr;
+    odd_buffer_ = nullptr;
+    buffer_capacity_ = 0;
+    fallback_.reset();
+}
+
+void PolyphaseResampler::Configure(int input_sample_rate, int output_sample_rate) {
+    Release();
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+    int divisor = std::gcd(input_sample_rate, output_sample_rate);
+    up_ = output_sample_rate / divisor;
+    down_ = input_sample_rate / divisor;
+
+    if (up_ > POLYPHASE_RESAMPLER_MAX_PHASES) {
+        ESP_LOGW(TAG, "No polyphase filter for %d -> %d, using OpusResampler", input_sample_rate, output_sample_rate);
+        fallback_ = std::make_unique<OpusResampler>();
+        fallback_->Configure(input_sample_rate, output_sample_rate);
+        return;
+    }
+
+    // Decimation narrows the passband relative to the input, keep the transition band as sharp with more taps
+    taps_ = 24 * ((down_ + up_ - 1) / up_);
+    coefficients_ = (int16_t*)heap_caps_aligned_alloc(16, up_ * taps_ * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (coefficients_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %d coefficients", up_ * taps_);
+        return;
+    }
+    DesignFilter();
+    Reset();
+}
+
+void PolyphaseResampler::DesignFilter() {
+    // Prototype low pass at the upsampled rate, L * taps long, with a gain of L to make up for the zero stuffing
+    int length = up_ * taps_;
+    float center = (length - 1) / 2.0f;
+    float cutoff = PASSBAND_RATIO * std::min(input_sample_rate_, output_sample_rate_) / 2.0f / (input_sample_rate_ * (float)up_);
+    auto bessel_i0 = [](float x) {
+        float sum = 1.0f, term = 1.0f;
+        for (int k = 1; k < 20; k++) {
+            term *= (x / (2.0f * k)) * (x / (2.0f * k));
+            sum += term;
+        }
+        return sum;
+    };
+    float window_norm = bessel_i0(KAISER_BETA);
+
+    for (int n = 0; n < length; n++) {
+        float t = n - center;
+        float sinc = t == 0 ? 2.0f * cutoff : sinf(2.0f * (float)M_PI * cutoff * t) / ((float)M_PI * t);
+        float r = 2.0f * n / (length - 1) - 1.0f;
+        float window = bessel_i0(KAISER_BETA * sqrtf(std::max(0.0f, 1.0f - r * r))) / window_norm;
+        // Stored at half gain so that overshoot cannot wrap the 16-bit dot product, the kernel doubles it back
+        float value = sinc * window * up_ * 0.5f * 32768.0f;
+        int phase = n % up_;
+        int tap = n / up_;
+        coefficients_[phase * taps_ + (taps_ - 1 - tap)] = (int16_t)std::clamp<long>(lroundf(value), -32768, 32767);
+    }
+}
+
+void PolyphaseResampler::Reset() {
+    phase_ = 0;
+    next_index_ = 0;
+    if (buffer_ != nullptr) {
+        memset(buffer_, 0, (taps_ - 1) * sizeof(int16_t));
+    }
+}
+
+bool PolyphaseResampler::ReserveBuffer(size_t samples) {
+    size_t needed = taps_ - 1 + samples;
+    if (needed <= buffer_capacity_) {
+        return true;
+    }
+    auto buffer = (int16_t*)heap_caps_aligned_alloc(16, needed * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (buffer == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u samples", needed);
+        return false;
+    }
+#if POLYPHASE_RESAMPLER_USE_DSP
+    auto odd_buffer = (int16_t*)heap_caps_aligned_alloc(16, needed * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (odd_buffer == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u samples", needed);
+        heap_caps_free(buffer);
+        return false;
+    }
+    heap_caps_free(odd_buffer_);
+    odd_buffer_ = odd_buffer;
+#endif
+    if (buffer_ != nullptr) {
+        memcpy(buffer, buffer_, (taps_ - 1) * sizeof(int16_t));
+        heap_caps_free(buffer_);
+    } else {
+        memset(buffer, 0, (taps_ - 1) * sizeof(int16_t));
+    }
+    buffer_ = buffer;
+    buffer_capacity_ = needed;
+    return true;
+}
+
+int PolyphaseResampler::GetOutputSamples(int input_samples) const {
+    return (int64_t)input_samples * output_sample_rate_ / input_sample_rate_;
+}
+
+// Q15 dot product with the esp-dsp rounding: (0x7fff + sum) >> 15, then doubled back to full gain
+static inline int16_t DotProduct(const int16_t* coefficients, const int16_t* window, int taps) {
+    int16_t half;
+#if POLYPHASE_RESAMPLER_USE_DSP
+    dsps_dotprod_s16(coefficients, window, &half, taps, 0);
+#else
+    int64_t acc = 0x7fff;
+    for (int i = 0; i < taps; i++) {
+        acc += (int32_t)coefficients[i] * window[i];
+    }
+    half = (int16_t)(acc >> 15);
+#endif
+    return (int16_t)std::clamp(half * 2, -32768, 32767);
+}
+
+int PolyphaseResampler::Process(const int16_t* input, int samples, int16_t* output) {
+    if (fallback_) {
+        fallback_->Process(input, samples, output);
+        return GetOutputSamples(samples);
+    }
+    if (coefficients_ == nullptr || !ReserveBuffer(samples)) {
+        return 0;
+    }
+
+    int history = taps_ - 1;
+    memcpy(buffer_ + history, input, samples * sizeof(int16_t));
+#if POLYPHASE_RESAMPLER_USE_DSP
+    // buffer_ + next_index_ is only 2-byte aligned for odd indexes, those windows are read from the shifted copy
+    memcpy(odd_buffer_, buffer_ + 1, (history + samples - 1) * sizeof(int16_t));
+#endif
+
+    // Output k uses input floor(k * M / L) as its newest sample and phase (k * M) mod L
+    int written = 0;
+    while (next_index_ < samples) {
+#if POLYPHASE_RESAMPLER_USE_DSP
+        const int16_t* window = (next_index_ & 1) ? odd_buffer_ + next_index_ - 1 : buffer_ + next_index_;
+#else
+        const int16_t* window = buffer_ + next_index_;
+#endif
+        output[written++] = DotProduct(coefficients_ + phase_ * taps_, window, taps_);
+        phase_ += down_;
+        next_index_ += phase_ / up_;
+        phase_ %= up_;
+    }
+    next_index_ -= samples;
+    memmove(buffer_, buffer_ + samples, history * sizeof(int16_t));
+    return written;
+}
@@ -0,0 +1,60 @@
+#ifndef POLYPHASE_RESAMPLER_H
+#define POLYPHASE_RESAMPLER_H
+
+#include <opus_resampler.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+// Ratios with more phases than this go through OpusResampler
+#define POLYPHASE_RESAMPLER_MAX_PHASES 16
+
+/*
+ * Fixed-point polyphase FIR resampler for rational ratios such as 16k <-> 24k <-> 48k.
+ * The Kaiser windowed sinc is designed in Configure() and stored per phase as Q15,
+ * each output sample is then one dot product over a contiguous window of the input.
+ * On ESP32 and ESP32-S3 the dot product runs on the esp-dsp MAC kernel, which loads 32-bit words:
+ * coefficient rows and windows are always word aligned and taps_ is a multiple of 8. The scalar kernel
+ * rounds like the esp-dsp reference kernel, boards/linux-sim/tests checks both builds
+ * bit for bit on the host; the assembly kernels themselves only run on the target.
+ *
+ * Drop-in for OpusResampler, ratios it does not cover are handed over to one.
+ */
+class PolyphaseResampler {
+public:
+    PolyphaseResampler() = default;
+    ~PolyphaseResampler();
+    PolyphaseResampler(const PolyphaseResampler&) = delete;
+    PolyphaseResampler& operator=(const PolyphaseResampler&) = delete;
+
+    void Configure(int input_sample_rate, int output_sample_rate);
+    // Returns the number of samples written, GetOutputSamples(samples) when samples is a whole number of ratio periods
+    int Process(const int16_t* input, int samples, int16_t* output);
+    int GetOutputSamples(int input_samples) const;
+    // Forgets the input history, the next Process starts a new stream
+    void Reset();
+
+    inline int input_sample_rate() const { return input_sample_rate_; }
+    inline int output_sample_rate() const { return output_sample_rate_; }
+
+private:
+    int input_sample_rate_ = 0;
+    int output_sample_rate_ = 0;
+    int up_ = 1;            // Interpolation factor L
+    int down_ = 1;          // Decimation factor M
+    int taps_ = 0;          // Taps per phase
+    int16_t* coefficients_ = nullptr;   // up_ rows of taps_, each row reversed for the dot product
+    int16_t* buffer_ = nullptr;         // taps_ - 1 samples of history followed by the input
+    int16_t* odd_buffer_ = nullptr;     // buffer_ one sample on, so odd windows start word aligned (esp-dsp only)
+    size_t buffer_capacity_ = 0;
+    int phase_ = 0;
+    int next_index_ = 0;
+    std::unique_ptr<OpusResampler> fallback_;
+
+    void Release();
+    void DesignFilter();
+    bool ReserveBuffer(size_t samples);
+};
+
+#endif // POLYPHASE_RESAMPLER_H
@@ -0,0 +1,69 @@
+#include "silence_gate.h"
+
+#include <esp_log.h>
+
+#define TAG "SilenceGate"
+
+SilenceGate::SilenceGate(int sample_rate, int hangover_ms, int pre_roll_ms)
+    : sample_rate_(sample_rate),
+      hangover_samples_(sample_rate / 1000 * hangover_ms),
+      pre_roll_samples_(sample_rate / 1000 * pre_roll_ms) {
+}
+
+void SilenceGate::Reset() {
+    if (total_samples_ > 0) {
+        ESP_LOGI(TAG, "Held back %llu of %llu ms", suppressed_samples_ * 1000 / sample_rate_,
+            total_samples_ * 1000 / sample_rate_);
+    }
+    open_ = true;
+    silent_samples_ = 0;
+    if (discard_callback_) {
+        for (auto& chunk : pre_roll_) {
+            discard_callback_(std::move(chunk.data));
+        }
+    }
+    pre_roll_.clear();
+    pre_roll_size_ = 0;
+    total_samples_ = 0;
+    suppressed_samples_ = 0;
+}
+
+void SilenceGate::Process(std::vector<int16_t>&& data, uint32_t timestamp,
+    const std::function<void(std::vector<int16_t>&& data, uint32_t timestamp, bool resumed)>& emit) {
+    total_samples_ += data.size();
+    if (speaking_) {
+        silent_samples_ = 0;
+        bool resumed = !open_;
+        if (!open_) {
+            open_ = true;
+            suppressed_samples_ -= pre_roll_size_;
+            for (auto& chunk : pre_roll_) {
+                emit(std::move(chunk.data), chunk.timestamp, resumed);
+                resumed = false;
+            }
+            pre_roll_.clear();
+            pre_roll_size_ = 0;
+        }
+        emit(std::move(data), timestamp, resumed);
+        return;
+    }
+
+    silent_samples_ += data.size();
+    if (open_ && silent_samples_ <= hangover_samples_) {
+        emit(std::move(data), timestamp, false);
+        return;
+    }
+
+    // Keep only the most recent audio for the pre-roll
+    open_ = false;
+    suppressed_samples_ += data.size();
+    pre_roll_size_ += data.size();
+    pre_roll_.push_back(Chunk{std::move(data), timestamp});
+    while (!pre_roll_.empty() && pre_roll_size_ - pre_roll_.front().data.size() >= pre_roll_samples_) {
+        pre_roll_size_ -= pre_roll_.front().data.size();
+        if (discard_callback_) {
+            discard_callback_(std::move(pre_roll_.front().data));
+        }
+        pre_roll_.pop_front();
+    }
+}
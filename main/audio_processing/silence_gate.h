@@ -0,0 +1,50 @@
+#ifndef SILENCE_GATE_H
+#define SILENCE_GATE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <vector>
+
+/*
+ * Holds back the microphone audio of silent stretches so it is neither encoded nor sent.
+ * Audio keeps flowing for a hangover after the VAD reports silence, and the last pre-roll
+ * of held back audio is released ahead of the speech that ends the silence, so neither
+ * word endings nor onsets are clipped.
+ * Process and SetSpeaking are called from the audio processor task.
+ */
+class SilenceGate {
+public:
+    SilenceGate(int sample_rate, int hangover_ms, int pre_roll_ms);
+
+    // Opens the gate for a new session, the speaking state is kept
+    void Reset();
+    void SetSpeaking(bool speaking) { speaking_ = speaking; }
+    // Receives the held back audio that is dropped, so its buffer can be reused
+    void OnDiscard(std::function<void(std::vector<int16_t>&& data)> callback) { discard_callback_ = callback; }
+    // Calls emit with the audio that passes: nothing, data, or the pre-roll followed by data.
+    // The timestamp travels with its audio, it is the AEC reference of the first sample.
+    // resumed is set on the first chunk after the gate was closed, it does not follow the audio emitted before
+    void Process(std::vector<int16_t>&& data, uint32_t timestamp,
+        const std::function<void(std::vector<int16_t>&& data, uint32_t timestamp, bool resumed)>& emit);
+
+private:
+    int sample_rate_;
+    size_t hangover_samples_;
+    size_t pre_roll_samples_;
+    bool speaking_ = false;
+    bool open_ = true;
+    size_t silent_samples_ = 0;
+    struct Chunk {
+        std::vector<int16_t> data;
+        uint32_t timestamp;
+    };
+    std::deque<Chunk> pre_roll_;
+    std::function<void(std::vector<int16_t>&& data)> discard_callback_;
+    size_t pre_roll_size_ = 0;
+    uint64_t total_samples_ = 0;
+    uint64_t suppressed_samples_ = 0;
+};
+
+#endif // SILENCE_GATE_H
@@ -18,7 +18,7 @@ public:
     virtual void StopDetection() = 0;
     virtual bool IsDetectionRunning() = 0;
     virtual size_t GetFeedSize() = 0;
-    virtual void EncodeWakeWordData() = 0;
+    virtual void EncodeWakeWordData(int frame_duration) = 0;
     virtual bool GetWakeWordOpus(std::vector<uint8_t>& opus) = 0;
     virtual const std::string& GetLastDetectedWakeWord() const = 0;
 };
@@ -15,6 +15,8 @@ public:
 
     void Schedule(std::function<void()> callback);
     void WaitForCompletion();
+    // Callbacks scheduled and not finished yet, including the running one
+    size_t pending_tasks() const { return active_tasks_; }
 
 private:
     std::mutex mutex_;
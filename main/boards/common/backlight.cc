@@ -2,7 +2,9 @@
 #include "settings.h"
 
 #include <esp_log.h>
+#if !CONFIG_IDF_TARGET_LINUX
 #include <driver/ledc.h>
+#endif
 
 #define TAG "Backlight"
 
@@ -81,6 +83,7 @@ void Backlight::OnTransitionTimer() {
     }
 }
 
+#if !CONFIG_IDF_TARGET_LINUX
 PwmBacklight::PwmBacklight(gpio_num_t pin, bool output_invert) : Backlight() {
     const ledc_timer_config_t backlight_timer = {
         .speed_mode = LEDC_LOW_SPEED_MODE,
@@ -118,4 +121,4 @@ void PwmBacklight::SetBrightnessImpl(uint8_t brightness) {
     ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, duty_cycle);
     ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
 }
-
+#endif
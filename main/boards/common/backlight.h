@@ -3,8 +3,11 @@
 #include <cstdint>
 #include <functional>
 
-#include <driver/gpio.h>
+#include <sdkconfig.h>
 #include <esp_timer.h>
+#if !CONFIG_IDF_TARGET_LINUX
+#include <driver/gpio.h>
+#endif
 
 
 class Backlight {
@@ -27,6 +30,7 @@ protected:
 };
 
 
+#if !CONFIG_IDF_TARGET_LINUX
 class PwmBacklight : public Backlight {
 public:
     PwmBacklight(gpio_num_t pin, bool output_invert = false);
@@ -34,3 +38,4 @@ public:
 
     void SetBrightnessImpl(uint8_t brightness) override;
 };
+#endif
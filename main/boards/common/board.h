@@ -1,10 +1,19 @@
 #ifndef BOARD_H
 #define BOARD_H
 
+#include <sdkconfig.h>
+#if CONFIG_IDF_TARGET_LINUX
+// esp-ml307 is not built for the linux target, boards there have no network transports
+class Http;
+class WebSocket;
+class Mqtt;
+class Udp;
+#else
 #include <http.h>
 #include <web_socket.h>
 #include <mqtt.h>
 #include <udp.h>
+#endif
 #include <string>
 
 #include "led/led.h"
@@ -3,6 +3,7 @@
 #include "display.h"
 #include "board.h"
 #include "system_info.h"
+#include "pcm_convert.h"
 
 #include <esp_log.h>
 #include <esp_heap_caps.h>
@@ -115,13 +116,8 @@ bool Esp32Camera::Capture() {
     // 显示预览图片
     auto display = Board::GetInstance().GetDisplay();
     if (display != nullptr) {
-        auto src = (uint16_t*)fb_->buf;
-        auto dst = (uint16_t*)preview_image_.data;
-        size_t pixel_count = fb_->len / 2;
-        for (size_t i = 0; i < pixel_count; i++) {
-            // 交换每个16位字内的字节
-            dst[i] = __builtin_bswap16(src[i]);
-        }
+        // 交换每个16位字内的字节
+        PcmByteSwap16((const int16_t*)fb_->buf, (int16_t*)preview_image_.data, fb_->len / 2);
         display->SetPreviewImage(&preview_image_);
     }
     return true;
@@ -1,9 +1,9 @@
 #include "k10_audio_codec.h"
+#include "pcm_convert.h"
 
 #include <esp_log.h>
 #include <driver/i2c_master.h>
 #include <driver/i2s_tdm.h>
-#include <cmath>
 
 static const char TAG[] = "K10AudioCodec";
 
@@ -200,27 +200,27 @@ int K10AudioCodec::Read(int16_t* dest, int samples) {
 
 int K10AudioCodec::Write(const int16_t* data, int samples) {
     if (output_enabled_) {
-        std::vector<int32_t> buffer(samples * 2);  // Allocate buffer for 2x samples
-
-        // Apply volume adjustment (same as before)
-        int32_t volume_factor = pow(double(output_volume_) / 100.0, 2) * 65536;
-        for (int i = 0; i < samples; i++) {
-            int64_t temp = int64_t(data[i]) * volume_factor;
-            if (temp > INT32_MAX) {
-            buffer[i * 2] = INT32_MAX;
-            } else if (temp < INT32_MIN) {
-            buffer[i * 2] = INT32_MIN;
-            } else {
-            buffer[i * 2] = static_cast<int32_t>(temp);
-            }
-
-            // Repeat each sample for slow playback (assuming mono audio)
-            buffer[i * 2 + 1] = buffer[i * 2];
+        // Repeat each sample in both slots (assuming mono audio)
+        if (output_slots_.size() < (size_t)samples * 2) {
+            output_slots_.resize(samples * 2);
         }
+        PcmToSlot32Dual(data, output_slots_.data(), samples, PcmVolumeToGain(output_volume_));
 
         size_t bytes_written;
-        ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, buffer.data(), samples * 2 * sizeof(int32_t), &bytes_written, portMAX_DELAY));
+        ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, output_slots_.data(), samples * 2 * sizeof(int32_t), &bytes_written, portMAX_DELAY));
         return bytes_written / sizeof(int32_t);
     }
     return samples;
 }
+
+int K10AudioCodec::Preload(const int16_t* data, int samples) {
+    // Same duplicated 32-bit slots and volume scaling as Write()
+    if (output_slots_.size() < (size_t)samples * 2) {
+        output_slots_.resize(samples * 2);
+    }
+    PcmToSlot32Dual(data, output_slots_.data(), samples, PcmVolumeToGain(output_volume_));
+
+    size_t bytes_loaded = 0;
+    ESP_ERROR_CHECK_WITHOUT_ABORT(i2s_channel_preload_data(tx_handle_, output_slots_.data(), samples * 2 * sizeof(int32_t), &bytes_loaded));
+    return bytes_loaded / (2 * sizeof(int32_t));
+}
@@ -5,6 +5,7 @@
 
 #include <esp_codec_dev.h>
 #include <esp_codec_dev_defaults.h>
+#include <vector>
 
 class K10AudioCodec : public AudioCodec {
 private:
@@ -17,11 +18,13 @@ private:
 
     esp_codec_dev_handle_t output_dev_ = nullptr;
     esp_codec_dev_handle_t input_dev_ = nullptr;
+    std::vector<int32_t> output_slots_;     // Stereo 32-bit slots for Write and Preload, kept across calls
 
     void CreateDuplexChannels(gpio_num_t mclk, gpio_num_t bclk, gpio_num_t ws, gpio_num_t dout, gpio_num_t din);
 
     virtual int Read(int16_t* dest, int samples) override;
     virtual int Write(const int16_t* data, int samples) override;
+    virtual int Preload(const int16_t* data, int samples) override;
 
 public:
     K10AudioCodec(void* i2c_master_handle, int input_sample_rate, int output_sample_rate,
@@ -5,6 +5,7 @@
 #include <driver/i2s_tdm.h>
 
 #include "config.h"
+#include "pcm_convert.h"
 
 static const char TAG[] = "Tcircles3AudioCodec";
 
@@ -107,11 +108,6 @@ void Tcircles3AudioCodec::CreateVoiceHardware(gpio_num_t mic_bclk, gpio_num_t mi
     ESP_LOGI(TAG, "Voice hardware created");
 }
 
-void Tcircles3AudioCodec::SetOutputVolume(int volume) {
-    volume_ = volume;
-    AudioCodec::SetOutputVolume(volume);
-}
-
 void Tcircles3AudioCodec::EnableInput(bool enable) {
     AudioCodec::EnableInput(enable);
 }
@@ -135,13 +131,21 @@ int Tcircles3AudioCodec::Read(int16_t *dest, int samples){
 
 int Tcircles3AudioCodec::Write(const int16_t *data, int samples){
     if (output_enabled_){
-        size_t bytes_read;
-        auto output_data = (int16_t *)malloc(samples * sizeof(int16_t));
-        for (size_t i = 0; i < samples; i++){
-            output_data[i] = (float)data[i] * (float)(volume_ / 100.0);
+        if (output_buffer_.size() < (size_t)samples) {
+            output_buffer_.resize(samples);
         }
-        i2s_channel_write(tx_handle_, output_data, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY);
-        free(output_data);
+        PcmApplyGain(data, output_buffer_.data(), samples, PcmVolumeToGain(output_volume_));
+        size_t bytes_written;
+        i2s_channel_write(tx_handle_, output_buffer_.data(), samples * sizeof(int16_t), &bytes_written, portMAX_DELAY);
     }
     return samples;
 }
+
+int Tcircles3AudioCodec::Preload(const int16_t *data, int samples) {
+    // Same volume scaling as Write()
+    if (output_buffer_.size() < (size_t)samples) {
+        output_buffer_.resize(samples);
+    }
+    PcmApplyGain(data, output_buffer_.data(), samples, PcmVolumeToGain(output_volume_));
+    return AudioCodec::Preload(output_buffer_.data(), samples);
+}
@@ -5,6 +5,7 @@
 
 #include <esp_codec_dev.h>
 #include <esp_codec_dev_defaults.h>
+#include <vector>
 
 class Tcircles3AudioCodec : public AudioCodec {
 private:
@@ -15,12 +16,13 @@ private:
     const audio_codec_if_t *in_codec_if_ = nullptr;
     const audio_codec_gpio_if_t *gpio_if_ = nullptr;
 
-    uint32_t volume_ = 70;
+    std::vector<int16_t> output_buffer_;    // Scaled output for Write and Preload, grows to the largest block
 
     void CreateVoiceHardware(gpio_num_t mic_bclk, gpio_num_t mic_ws, gpio_num_t mic_data,gpio_num_t spkr_bclk, gpio_num_t spkr_lrclk, gpio_num_t spkr_data);
 
     virtual int Read(int16_t *dest, int samples) override;
     virtual int Write(const int16_t *data, int samples) override;
+    virtual int Preload(const int16_t *data, int samples) override;
 
 public:
     Tcircles3AudioCodec(int input_sample_rate, int output_sample_rate,
@@ -29,7 +31,6 @@ public:
         bool input_reference);
     virtual ~Tcircles3AudioCodec();
 
-    virtual void SetOutputVolume(int volume) override;
     virtual void EnableInput(bool enable) override;
     virtual void EnableOutput(bool enable) override;
 };
@@ -6,6 +6,7 @@
 #include <driver/i2s_pdm.h>
 
 #include "config.h"
+#include "pcm_convert.h"
 
 static const char TAG[] = "Tdisplays3promvsrloraAudioCodec";
 
@@ -110,11 +111,6 @@ void Tdisplays3promvsrloraAudioCodec::CreateVoiceHardware(gpio_num_t mic_bclk, g
     ESP_LOGI(TAG, "Voice hardware created");
 }
 
-void Tdisplays3promvsrloraAudioCodec::SetOutputVolume(int volume) {
-    volume_ = volume;
-    AudioCodec::SetOutputVolume(volume);
-}
-
 void Tdisplays3promvsrloraAudioCodec::EnableInput(bool enable) {
     gpio_set_level(AUDIO_MIC_ENABLE, !enable);
     AudioCodec::EnableInput(enable);
@@ -138,13 +134,21 @@ int Tdisplays3promvsrloraAudioCodec::Read(int16_t *dest, int samples){
 
 int Tdisplays3promvsrloraAudioCodec::Write(const int16_t *data, int samples){
     if (output_enabled_){
-        size_t bytes_read;
-        auto output_data = (int16_t *)malloc(samples * sizeof(int16_t));
-        for (size_t i = 0; i < samples; i++){
-            output_data[i] = (float)data[i] * (float)(volume_ / 100.0);
+        if (output_buffer_.size() < (size_t)samples) {
+            output_buffer_.resize(samples);
         }
-        i2s_channel_write(tx_handle_, output_data, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY);
-        free(output_data);
+        PcmApplyGain(data, output_buffer_.data(), samples, PcmVolumeToGain(output_volume_));
+        size_t bytes_written;
+        i2s_channel_write(tx_handle_, output_buffer_.data(), samples * sizeof(int16_t), &bytes_written, portMAX_DELAY);
     }
     return samples;
 }
+
+int Tdisplays3promvsrloraAudioCodec::Preload(const int16_t *data, int samples) {
+    // Same volume scaling as Write()
+    if (output_buffer_.size() < (size_t)samples) {
+        output_buffer_.resize(samples);
+    }
+    PcmApplyGain(data, output_buffer_.data(), samples, PcmVolumeToGain(output_volume_));
+    return AudioCodec::Preload(output_buffer_.data(), samples);
+}
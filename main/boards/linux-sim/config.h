@@ -0,0 +1,11 @@
+#ifndef _BOARD_CONFIG_H_
+#define _BOARD_CONFIG_H_
+
+#define AUDIO_INPUT_SAMPLE_RATE  16000
+#define AUDIO_OUTPUT_SAMPLE_RATE 24000
+
+// Paths on the host, relative to the working directory of the simulator
+#define AUDIO_INPUT_WAV_PATH     "input.wav"
+#define AUDIO_OUTPUT_PCM_PATH    "output.pcm"
+
+#endif // _BOARD_CONFIG_H_
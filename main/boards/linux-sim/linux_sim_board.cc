@@ -0,0 +1,65 @@
+#include "board.h"
+#include "audio_codecs/file_audio_codec.h"
+#include "config.h"
+
+#include <esp_log.h>
+
+#define TAG "LinuxSimBoard"
+
+/*
+ * Runs the application on the ESP-IDF linux target. Audio comes from and goes to files,
+ * the display is the default NoDisplay and the protocol is LoopbackProtocol, so no network is used.
+ */
+class LinuxSimBoard : public Board {
+public:
+    LinuxSimBoard() {
+        ESP_LOGI(TAG, "Input %s, output %s", AUDIO_INPUT_WAV_PATH, AUDIO_OUTPUT_PCM_PATH);
+    }
+
+    virtual std::string GetBoardType() override {
+        return "linux-sim";
+    }
+
+    virtual AudioCodec* GetAudioCodec() override {
+        static FileAudioCodec audio_codec(AUDIO_INPUT_WAV_PATH, AUDIO_OUTPUT_PCM_PATH,
+            AUDIO_INPUT_SAMPLE_RATE, AUDIO_OUTPUT_SAMPLE_RATE);
+        return &audio_codec;
+    }
+
+    virtual Http* CreateHttp() override {
+        return nullptr;
+    }
+
+    virtual WebSocket* CreateWebSocket() override {
+        return nullptr;
+    }
+
+    virtual Mqtt* CreateMqtt() override {
+        return nullptr;
+    }
+
+    virtual Udp* CreateUdp() override {
+        return nullptr;
+    }
+
+    virtual void StartNetwork() override {
+    }
+
+    virtual const char* GetNetworkStateIcon() override {
+        return "";
+    }
+
+    virtual void SetPowerSaveMode(bool enabled) override {
+    }
+
+    virtual std::string GetBoardJson() override {
+        return std::string("{\"type\":\"" BOARD_TYPE "\",\"name\":\"" BOARD_NAME "\"}");
+    }
+
+    virtual std::string GetDeviceStatusJson() override {
+        auto codec = GetAudioCodec();
+        return "{\"audio_speaker\":{\"volume\":" + std::to_string(codec->output_volume()) + "}}";
+    }
+};
+
+DECLARE_BOARD(LinuxSimBoard);
@@ -0,0 +1,32 @@
+#ifndef HOST_TEST_ALLOC_COUNTER_H
+#define HOST_TEST_ALLOC_COUNTER_H
+
+// Counts the operator new calls of the test process, include in exactly one source file
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<long> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+static inline long Allocations() {
+    return g_allocations.load(std::memory_order_relaxed);
+}
+
+#endif // HOST_TEST_ALLOC_COUNTER_H
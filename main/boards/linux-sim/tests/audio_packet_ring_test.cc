@@ -0,0 +1,169 @@
+// Stress test of AudioPacketRing between two threads, and its cost against the std::list queue it replaced
+#include "audio_packet_ring.h"
+#include "alloc_counter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <thread>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+#define PACKETS 200000
+#define CAPACITY 40
+
+static size_t PayloadSize(uint32_t sequence) {
+    return 1 + sequence * 7919 % AUDIO_PACKET_MAX_PAYLOAD_SIZE;
+}
+
+static void FillPacket(AudioStreamPacket& packet, uint32_t sequence) {
+    packet.sample_rate = 16000;
+    packet.frame_duration = 60;
+    packet.timestamp = sequence * 60;
+    packet.sequence = sequence;
+    packet.payload.assign(PayloadSize(sequence), (uint8_t)sequence);
+}
+
+static bool CheckPacket(const AudioStreamPacket& packet, uint32_t sequence) {
+    CHECK(packet.sequence == sequence);
+    CHECK(packet.timestamp == sequence * 60);
+    CHECK(packet.payload.size() == PayloadSize(sequence));
+    for (auto byte : packet.payload) {
+        CHECK(byte == (uint8_t)sequence);
+    }
+    return true;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Every packet arrives once, in order and intact, and the steady state never touches the heap
+static bool TestTwoThreads() {
+    AudioPacketRing ring(CAPACITY);
+    AudioStreamPacket produced, consumed;
+    produced.payload.reserve(AUDIO_PACKET_MAX_PAYLOAD_SIZE);
+    consumed.payload.reserve(AUDIO_PACKET_MAX_PAYLOAD_SIZE);
+
+    long allocations = Allocations();
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([&]() {
+        for (uint32_t sequence = 1; sequence <= PACKETS; sequence++) {
+            FillPacket(produced, sequence);
+            while (!ring.Push(produced)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    bool ok = true;
+    for (uint32_t sequence = 1; sequence <= PACKETS && ok; sequence++) {
+        while (!ring.Pop(consumed)) {
+            std::this_thread::yield();
+        }
+        ok = CheckPacket(consumed, sequence);
+    }
+    producer.join();
+    double seconds = Seconds(start);
+    printf("ring, 2 threads: %.0f packets/s, %ld allocations in %d packets\n",
+        PACKETS / seconds, Allocations() - allocations, PACKETS);
+    CHECK(ok);
+    // std::thread allocates its state once, the packets themselves allocate nothing
+    CHECK(Allocations() - allocations <= 1);
+    CHECK(ring.empty());
+    return true;
+}
+
+static bool TestClear() {
+    AudioPacketRing ring(4);
+    AudioStreamPacket packet;
+    for (uint32_t sequence = 1; sequence <= 4; sequence++) {
+        FillPacket(packet, sequence);
+        CHECK(ring.Push(packet));
+    }
+    CHECK(ring.full());
+    FillPacket(packet, 5);
+    CHECK(!ring.Push(packet));
+    CHECK(ring.dropped() == 1);
+
+    ring.Clear();
+    CHECK(ring.empty());
+    // The consumer has not moved past the slots yet, they are released by its next Pop
+    CHECK(!ring.Pop(packet));
+    FillPacket(packet, 6);
+    CHECK(ring.Push(packet));
+    CHECK(ring.Pop(packet));
+    CHECK(CheckPacket(packet, 6));
+
+    std::vector<uint8_t> large(AUDIO_PACKET_MAX_PAYLOAD_SIZE + 1);
+    CHECK(!ring.Push(16000, 60, 0, large.data(), large.size()));
+    return true;
+}
+
+// One thread, so both queues are timed without scheduler noise
+static bool TestAgainstList() {
+    AudioPacketRing ring(CAPACITY);
+    AudioStreamPacket produced, consumed;
+    produced.payload.reserve(AUDIO_PACKET_MAX_PAYLOAD_SIZE);
+    consumed.payload.reserve(AUDIO_PACKET_MAX_PAYLOAD_SIZE);
+
+    long allocations = Allocations();
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t sequence = 1; sequence <= PACKETS; sequence++) {
+        FillPacket(produced, sequence);
+        ring.Push(produced);
+        ring.Pop(consumed);
+    }
+    double ring_seconds = Seconds(start);
+    long ring_allocations = Allocations() - allocations;
+    CHECK(CheckPacket(consumed, PACKETS));
+
+    // The queue before the ring: a mutex guarded list of packets that own their payload
+    std::mutex mutex;
+    std::list<AudioStreamPacket> list;
+    allocations = Allocations();
+    start = std::chrono::steady_clock::now();
+    for (uint32_t sequence = 1; sequence <= PACKETS; sequence++) {
+        AudioStreamPacket packet;
+        FillPacket(packet, sequence);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            list.push_back(std::move(packet));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        consumed = std::move(list.front());
+        list.pop_front();
+    }
+    double list_seconds = Seconds(start);
+    long list_allocations = Allocations() - allocations;
+    CHECK(CheckPacket(consumed, PACKETS));
+
+    printf("ring: %.0f ns/packet, %.2f allocations/packet\n", ring_seconds * 1e9 / PACKETS, (double)ring_allocations / PACKETS);
+    printf("std::list: %.0f ns/packet, %.2f allocations/packet\n", list_seconds * 1e9 / PACKETS, (double)list_allocations / PACKETS);
+    CHECK(ring_allocations == 0);
+    CHECK(list_allocations >= 2 * PACKETS);
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"two threads", TestTwoThreads},
+        {"clear", TestClear},
+        {"against std::list", TestAgainstList},
+    };
+    int failed = 0;
+    for (auto& test : tests) {
+        bool passed = test.run();
+        printf("%s: %s\n", test.name, passed ? "ok" : "FAILED");
+        failed += !passed;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+// Writes position-valued samples into AudioPreRoll and checks what Copy() returns, also with a concurrent writer
+#include "audio_pre_roll.h"
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+#define SAMPLE_RATE 16000
+#define PRE_ROLL_MS 2000
+// One AFE fetch
+#define FETCH_SAMPLES 512
+
+// Every sample holds its own position, so any copy can be checked without a reference
+static void WriteFrom(AudioPreRoll& pre_roll, uint32_t& position, size_t samples) {
+    static std::vector<int16_t> block;
+    block.resize(samples);
+    for (size_t i = 0; i < samples; i++) {
+        block[i] = (int16_t)(position + i);
+    }
+    pre_roll.Write(block.data(), samples);
+    position += samples;
+}
+
+static bool Holds(const int16_t* data, uint32_t position, size_t samples) {
+    for (size_t i = 0; i < samples; i++) {
+        if (data[i] != (int16_t)(position + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool TestFillAndCopy() {
+    AudioPreRoll pre_roll(SAMPLE_RATE, PRE_ROLL_MS);
+    CHECK(pre_roll.capacity() == SAMPLE_RATE * PRE_ROLL_MS / 1000);
+    uint32_t position = 0;
+    WriteFrom(pre_roll, position, 1000);
+    CHECK(pre_roll.begin() == 0 && pre_roll.end() == 1000 && pre_roll.size() == 1000);
+
+    std::vector<int16_t> out(1000);
+    CHECK(pre_roll.Copy(0, out.data(), 1000));
+    CHECK(Holds(out.data(), 0, 1000));
+    CHECK(pre_roll.Copy(400, out.data(), 600));
+    CHECK(Holds(out.data(), 400, 600));
+    // Nothing past the end
+    CHECK(!pre_roll.Copy(400, out.data(), 601));
+    return true;
+}
+
+static bool TestOverwriteOldest() {
+    AudioPreRoll pre_roll(SAMPLE_RATE, PRE_ROLL_MS);
+    size_t capacity = pre_roll.capacity();
+    uint32_t position = 0;
+    // Several times around the power of two storage, in fetch sized writes
+    while (position < capacity * 5) {
+        WriteFrom(pre_roll, position, FETCH_SAMPLES);
+    }
+    CHECK(pre_roll.end() == position);
+    CHECK(pre_roll.size() == capacity);
+    CHECK(pre_roll.begin() == position - capacity);
+
+    std::vector<int16_t> out(capacity);
+    CHECK(pre_roll.Copy(pre_roll.begin(), out.data(), capacity));
+    CHECK(Holds(out.data(), pre_roll.begin(), capacity));
+    // The sample just before the ring is gone
+    CHECK(!pre_roll.Copy(pre_roll.begin() - 1, out.data(), 1));
+    return true;
+}
+
+static bool TestWriteLargerThanRing() {
+    AudioPreRoll pre_roll(SAMPLE_RATE, 100);
+    size_t capacity = pre_roll.capacity();
+    uint32_t position = 0;
+    WriteFrom(pre_roll, position, 7);
+    WriteFrom(pre_roll, position, capacity * 3 + 5);
+    // Only the newest samples are kept, still addressed by their position
+    CHECK(pre_roll.end() == position && pre_roll.size() == capacity);
+    std::vector<int16_t> out(capacity);
+    CHECK(pre_roll.Copy(position - capacity, out.data(), capacity));
+    CHECK(Holds(out.data(), position - capacity, capacity));
+    return true;
+}
+
+static bool TestClear() {
+    AudioPreRoll pre_roll(SAMPLE_RATE, PRE_ROLL_MS);
+    uint32_t position = 0;
+    WriteFrom(pre_roll, position, 3000);
+    pre_roll.Clear();
+    CHECK(pre_roll.size() == 0 && pre_roll.begin() == position);
+    int16_t out[FETCH_SAMPLES];
+    CHECK(!pre_roll.Copy(0, out, 1));
+
+    // Positions keep counting after a clear
+    WriteFrom(pre_roll, position, FETCH_SAMPLES);
+    CHECK(pre_roll.size() == FETCH_SAMPLES);
+    CHECK(pre_roll.Copy(3000, out, FETCH_SAMPLES));
+    CHECK(Holds(out, 3000, FETCH_SAMPLES));
+    return true;
+}
+
+static bool TestIdleDoesNotAllocate() {
+    AudioPreRoll pre_roll(SAMPLE_RATE, PRE_ROLL_MS);
+    std::vector<int16_t> block(FETCH_SAMPLES, 1);
+    long allocations = Allocations();
+    // A minute of detection
+    for (int i = 0; i < SAMPLE_RATE * 60 / FETCH_SAMPLES; i++) {
+        pre_roll.Write(block.data(), block.size());
+    }
+    CHECK(Allocations() == allocations);
+
+    // The storage is the pre-roll rounded up to a power of two
+    size_t storage = 1;
+    while (storage < pre_roll.capacity()) {
+        storage <<= 1;
+    }
+    printf("pre-roll %d ms: %u samples in %u bytes\n", PRE_ROLL_MS, (unsigned)pre_roll.capacity(),
+        (unsigned)(storage * sizeof(int16_t)));
+    return true;
+}
+
+static bool TestReadBehindWriter() {
+    // A short ring so the reader falls behind now and then, the way the encode task trails the fetch task
+    AudioPreRoll pre_roll(SAMPLE_RATE, 100);
+    std::atomic<bool> stop{false};
+    std::thread writer([&pre_roll, &stop]() {
+        uint32_t position = 0;
+        std::vector<int16_t> block(FETCH_SAMPLES / 4);
+        while (!stop.load(std::memory_order_relaxed)) {
+            for (size_t i = 0; i < block.size(); i++) {
+                block[i] = (int16_t)(position + i);
+            }
+            pre_roll.Write(block.data(), block.size());
+            position += block.size();
+            std::this_thread::yield();
+        }
+    });
+
+    // Read frames in order, skipping ahead when the writer overwrote them first
+    uint32_t next = 0;
+    int copied = 0, overruns = 0;
+    std::vector<int16_t> frame(SAMPLE_RATE / 1000 * 20);
+    bool torn = false;
+    while (copied < 20000 && !torn) {
+        if ((int32_t)(pre_roll.end() - next) < (int32_t)frame.size()) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (!pre_roll.Copy(next, frame.data(), frame.size())) {
+            overruns++;
+            next = pre_roll.begin();
+            continue;
+        }
+        // A successful copy is never torn
+        torn = !Holds(frame.data(), next, frame.size());
+        copied++;
+        next += frame.size();
+        // Now and then the encoder stalls long enough for the writer to lap it
+        if (copied % 1000 == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    stop.store(true);
+    writer.join();
+    printf("read behind writer: %d frames copied, %d overruns detected\n", copied, overruns);
+    CHECK(!torn);
+    CHECK(overruns > 0);
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"fill_and_copy", TestFillAndCopy},
+        {"overwrite_oldest", TestOverwriteOldest},
+        {"write_larger_than_ring", TestWriteLargerThanRing},
+        {"clear", TestClear},
+        {"idle_does_not_allocate", TestIdleDoesNotAllocate},
+        {"read_behind_writer", TestReadBehindWriter},
+    };
+    int failures = 0;
+    for (auto& test : tests) {
+        bool ok = test.run();
+        printf("%s: %s\n", test.name, ok ? "ok" : "FAILED");
+        failures += ok ? 0 : 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
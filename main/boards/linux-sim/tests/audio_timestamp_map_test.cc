@@ -0,0 +1,119 @@
+// Marks playback spans in AudioTimestampMap and checks the server timestamps looked up at capture positions
+#include "audio_timestamp_map.h"
+
+#include <cstdio>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+#define SAMPLE_RATE 16000
+#define FRAMES_PER_MS (SAMPLE_RATE / 1000)
+#define BLOCK_FRAMES (FRAMES_PER_MS * 20)
+
+static bool TestLookupInsideSpan() {
+    AudioTimestampMap map(SAMPLE_RATE);
+    map.Mark(1000, BLOCK_FRAMES, 5000);
+    CHECK(map.Lookup(1000) == 5000);
+    // One millisecond of timestamp per millisecond of frames, rounded down
+    CHECK(map.Lookup(1000 + FRAMES_PER_MS) == 5001);
+    CHECK(map.Lookup(1000 + FRAMES_PER_MS * 19 + FRAMES_PER_MS - 1) == 5019);
+    // Outside the span there is no reference
+    CHECK(map.Lookup(999) == 0);
+    CHECK(map.Lookup(1000 + BLOCK_FRAMES) == 0);
+    return true;
+}
+
+static bool TestContinuousPlayback() {
+    AudioTimestampMap map(SAMPLE_RATE);
+    // Back to back blocks of one stream, the way the mixer marks them
+    uint32_t position = 0;
+    for (uint32_t timestamp = 100; timestamp < 100 + 20 * 30; timestamp += 20) {
+        map.Mark(position, BLOCK_FRAMES, timestamp);
+        position += BLOCK_FRAMES;
+    }
+    for (uint32_t ms = 0; ms < 20 * 30; ms += 7) {
+        CHECK(map.Lookup(ms * FRAMES_PER_MS) == 100 + ms);
+    }
+    return true;
+}
+
+static bool TestZeroTimestampHasNoReference() {
+    AudioTimestampMap map(SAMPLE_RATE);
+    map.Mark(0, BLOCK_FRAMES, 3000);
+    // A prompt mixed in afterwards, marked without a server timestamp, hides the older span
+    map.Mark(0, BLOCK_FRAMES, 0);
+    CHECK(map.Lookup(FRAMES_PER_MS * 5) == 0);
+    return true;
+}
+
+static bool TestNewerSpanWins() {
+    AudioTimestampMap map(SAMPLE_RATE);
+    map.Mark(0, BLOCK_FRAMES * 2, 1000);
+    // Playback restarted halfway through with a new stream
+    map.Mark(BLOCK_FRAMES, BLOCK_FRAMES, 9000);
+    CHECK(map.Lookup(FRAMES_PER_MS * 10) == 1010);
+    CHECK(map.Lookup(BLOCK_FRAMES + FRAMES_PER_MS * 10) == 9010);
+    return true;
+}
+
+static bool TestPositionWrapAround() {
+    AudioTimestampMap map(SAMPLE_RATE);
+    uint32_t start = UINT32_MAX - FRAMES_PER_MS * 5 + 1;
+    map.Mark(start, BLOCK_FRAMES, 7000);
+    CHECK(map.Lookup(start) == 7000);
+    // Positions past the wrap are still inside the span
+    CHECK(map.Lookup(0) == 7005);
+    CHECK(map.Lookup(FRAMES_PER_MS * 10) == 7015);
+    CHECK(map.Lookup(FRAMES_PER_MS * 15) == 0);
+    return true;
+}
+
+static bool TestOldSpansForgotten() {
+    AudioTimestampMap map(SAMPLE_RATE);
+    uint32_t position = 0;
+    for (int i = 0; i < AUDIO_TIMESTAMP_MAP_SIZE + 1; i++) {
+        map.Mark(position, BLOCK_FRAMES, 1 + i * 20);
+        position += BLOCK_FRAMES;
+    }
+    // The first span was overwritten, the second is the oldest one kept
+    CHECK(map.Lookup(0) == 0);
+    CHECK(map.Lookup(BLOCK_FRAMES) == 21);
+    CHECK(map.Lookup(position - 1) == 1 + AUDIO_TIMESTAMP_MAP_SIZE * 20 + 19);
+    return true;
+}
+
+static bool TestClear() {
+    AudioTimestampMap map(SAMPLE_RATE);
+    map.Mark(0, BLOCK_FRAMES, 1000);
+    map.Clear();
+    CHECK(map.Lookup(0) == 0);
+    map.Mark(0, BLOCK_FRAMES, 2000);
+    CHECK(map.Lookup(0) == 2000);
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"lookup_inside_span", TestLookupInsideSpan},
+        {"continuous_playback", TestContinuousPlayback},
+        {"zero_timestamp_has_no_reference", TestZeroTimestampHasNoReference},
+        {"newer_span_wins", TestNewerSpanWins},
+        {"position_wrap_around", TestPositionWrapAround},
+        {"old_spans_forgotten", TestOldSpansForgotten},
+        {"clear", TestClear},
+    };
+    int failures = 0;
+    for (auto& test : tests) {
+        bool ok = test.run();
+        printf("%s: %s\n", test.name, ok ? "ok" : "FAILED");
+        failures += ok ? 0 : 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+// Times the stereo branch of Application::ReadAudio, the old code against the one with scratch buffers.
+// Both use the same resampler, so the difference is the allocations and the channel kernels.
+#include "pcm_convert.h"
+#include "polyphase_resampler.h"
+#include "alloc_counter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+// A 24 kHz mic + reference codec feeding the 16 kHz pipeline, 30 ms per read
+#define CODEC_SAMPLE_RATE 24000
+#define SAMPLE_RATE 16000
+#define READ_SAMPLES (SAMPLE_RATE / 1000 * 30)
+#define FRAMES 20000
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void FillInput(std::vector<int16_t>& raw, int frame) {
+    for (size_t i = 0; i < raw.size(); i++) {
+        raw[i] = (int16_t)((frame * 977 + i * 131) & 0x3fff);
+    }
+}
+
+// The stereo branch of ReadAudio before the scratch buffers
+static void ReadOld(const std::vector<int16_t>& input, std::vector<int16_t>& data,
+    PolyphaseResampler& mic_resampler, PolyphaseResampler& reference_resampler) {
+    data = input;
+    auto mic_channel = std::vector<int16_t>(data.size() / 2);
+    auto reference_channel = std::vector<int16_t>(data.size() / 2);
+    for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
+        mic_channel[i] = data[j];
+        reference_channel[i] = data[j + 1];
+    }
+    auto resampled_mic = std::vector<int16_t>(mic_resampler.GetOutputSamples(mic_channel.size()));
+    auto resampled_reference = std::vector<int16_t>(reference_resampler.GetOutputSamples(reference_channel.size()));
+    mic_resampler.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
+    reference_resampler.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
+    data.resize(resampled_mic.size() + resampled_reference.size());
+    for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
+        data[j] = resampled_mic[i];
+        data[j + 1] = resampled_reference[i];
+    }
+}
+
+struct Scratch {
+    std::vector<int16_t> raw;
+    std::vector<int16_t> mic;
+    std::vector<int16_t> reference;
+    std::vector<int16_t> resampled_mic;
+    std::vector<int16_t> resampled_reference;
+};
+
+// The stereo branch of ReadAudio now
+static void ReadNew(const std::vector<int16_t>& input, std::vector<int16_t>& data, Scratch& scratch,
+    PolyphaseResampler& mic_resampler, PolyphaseResampler& reference_resampler) {
+    scratch.raw.resize(input.size());
+    std::copy(input.begin(), input.end(), scratch.raw.begin());
+    size_t frames = scratch.raw.size() / 2;
+    size_t output_frames = mic_resampler.GetOutputSamples(frames);
+    scratch.mic.resize(frames);
+    scratch.reference.resize(frames);
+    scratch.resampled_mic.resize(output_frames);
+    scratch.resampled_reference.resize(output_frames);
+    PcmDeinterleave2(scratch.raw.data(), scratch.mic.data(), scratch.reference.data(), frames);
+    mic_resampler.Process(scratch.mic.data(), frames, scratch.resampled_mic.data());
+    reference_resampler.Process(scratch.reference.data(), frames, scratch.resampled_reference.data());
+    data.resize(output_frames * 2);
+    PcmInterleave2(scratch.resampled_mic.data(), scratch.resampled_reference.data(), data.data(), output_frames);
+}
+
+static bool TestSameOutput() {
+    PolyphaseResampler old_mic, old_reference, new_mic, new_reference;
+    for (auto* resampler : { &old_mic, &old_reference, &new_mic, &new_reference }) {
+        resampler->Configure(CODEC_SAMPLE_RATE, SAMPLE_RATE);
+    }
+    std::vector<int16_t> input(READ_SAMPLES * CODEC_SAMPLE_RATE / SAMPLE_RATE * 2);
+    std::vector<int16_t> old_data, new_data;
+    Scratch scratch;
+    for (int frame = 0; frame < 50; frame++) {
+        FillInput(input, frame);
+        ReadOld(input, old_data, old_mic, old_reference);
+        ReadNew(input, new_data, scratch, new_mic, new_reference);
+        CHECK(old_data == new_data);
+        CHECK(new_data.size() == READ_SAMPLES * 2);
+    }
+    return true;
+}
+
+static bool TestCyclesPerFrame() {
+    std::vector<int16_t> input(READ_SAMPLES * CODEC_SAMPLE_RATE / SAMPLE_RATE * 2);
+    FillInput(input, 1);
+    std::vector<int16_t> data;
+    data.reserve(input.size());
+
+    PolyphaseResampler mic, reference;
+    mic.Configure(CODEC_SAMPLE_RATE, SAMPLE_RATE);
+    reference.Configure(CODEC_SAMPLE_RATE, SAMPLE_RATE);
+    long allocations = Allocations();
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        ReadOld(input, data, mic, reference);
+    }
+    double old_seconds = Seconds(start);
+    long old_allocations = Allocations() - allocations;
+
+    Scratch scratch;
+    ReadNew(input, data, scratch, mic, reference);
+    allocations = Allocations();
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        ReadNew(input, data, scratch, mic, reference);
+    }
+    double new_seconds = Seconds(start);
+    long new_allocations = Allocations() - allocations;
+
+    // The channel kernels alone, on buffers that already exist
+    size_t frames = input.size() / 2;
+    std::vector<int16_t> left(frames), right(frames), merged(input.size());
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        for (size_t i = 0, j = 0; i < frames; ++i, j += 2) {
+            left[i] = input[j];
+            right[i] = input[j + 1];
+        }
+        for (size_t i = 0, j = 0; i < frames; ++i, j += 2) {
+            merged[j] = left[i];
+            merged[j + 1] = right[i];
+        }
+        // Keep the compiler from dropping the loops
+        input[frame % input.size()] ^= merged[(frame * 7) % merged.size()] & 1;
+    }
+    double loop_seconds = Seconds(start);
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        PcmDeinterleave2(input.data(), left.data(), right.data(), frames);
+        PcmInterleave2(left.data(), right.data(), merged.data(), frames);
+        input[frame % input.size()] ^= merged[(frame * 7) % merged.size()] & 1;
+    }
+    double kernel_seconds = Seconds(start);
+
+    printf("ReadAudio stereo %d->%d Hz, %d ms reads:\n", CODEC_SAMPLE_RATE, SAMPLE_RATE, READ_SAMPLES * 1000 / SAMPLE_RATE);
+    printf("  old: %.0f ns/frame, %.2f allocations/frame\n", old_seconds * 1e9 / FRAMES, (double)old_allocations / FRAMES);
+    printf("  new: %.0f ns/frame, %.2f allocations/frame\n", new_seconds * 1e9 / FRAMES, (double)new_allocations / FRAMES);
+    printf("  split + merge, per-sample loops: %.0f ns/frame\n", loop_seconds * 1e9 / FRAMES);
+    printf("  split + merge, PcmDeinterleave2/PcmInterleave2: %.0f ns/frame\n", kernel_seconds * 1e9 / FRAMES);
+    CHECK(new_allocations == 0);
+    CHECK(old_allocations >= 4 * FRAMES);
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"same_output", TestSameOutput},
+        {"cycles_per_frame", TestCyclesPerFrame},
+    };
+    int failures = 0;
+    for (auto& test : tests) {
+        bool ok = test.run();
+        printf("%s: %s\n", test.name, ok ? "ok" : "FAILED");
+        failures += ok ? 0 : 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
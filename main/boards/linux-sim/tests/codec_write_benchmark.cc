@@ -0,0 +1,151 @@
+// Times the volume scaling in the codec Write paths, the old per-call buffers against the persistent ones.
+// The I2S write itself is left out, only the work done before it is measured. On a plain x86-64 build the
+// float loops vectorize with SSE2 while the 32-bit integer multiply has no SSE2 instruction, so the host
+// numbers favour the old code; they say nothing about the Xtensa and RISC-V targets.
+#include "pcm_convert.h"
+#include "alloc_counter.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+// One 60 ms frame decoded at 24 kHz, the usual output block
+#define WRITE_SAMPLES (24000 / 1000 * 60)
+#define FRAMES 20000
+#define VOLUME 70
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void FillInput(std::vector<int16_t>& data) {
+    uint32_t seed = 11;
+    for (auto& sample : data) {
+        seed = seed * 1103515245 + 12345;
+        sample = (int16_t)(seed >> 16);
+    }
+}
+
+// Stands in for i2s_channel_write(), so the compiler has to produce every scaled sample
+static void I2sWrite(const void* data, size_t bytes) {
+    asm volatile("" : : "r"(data), "r"(bytes) : "memory");
+}
+
+// The lilygo codecs before: malloc per call and a float multiply per sample
+static void WriteOldFloat(const int16_t* data, int samples, int volume) {
+    auto output_data = (int16_t*)malloc(samples * sizeof(int16_t));
+    for (int i = 0; i < samples; i++) {
+        output_data[i] = (float)data[i] * (float)(volume / 100.0);
+    }
+    I2sWrite(output_data, samples * sizeof(int16_t));
+    free(output_data);
+}
+
+// NoAudioCodec before: a vector per call, pow() per call and int64 saturation per sample
+static void WriteOldSlots(const int16_t* data, int samples, int volume, int32_t* last = nullptr) {
+    std::vector<int32_t> buffer(samples);
+    int32_t volume_factor = pow(double(volume) / 100.0, 2) * 65536;
+    for (int i = 0; i < samples; i++) {
+        int64_t temp = int64_t(data[i]) * volume_factor;
+        if (temp > INT32_MAX) {
+            buffer[i] = INT32_MAX;
+        } else if (temp < INT32_MIN) {
+            buffer[i] = INT32_MIN;
+        } else {
+            buffer[i] = static_cast<int32_t>(temp);
+        }
+    }
+    I2sWrite(buffer.data(), samples * sizeof(int32_t));
+    if (last != nullptr) {
+        *last = buffer[samples / 2];
+    }
+}
+
+static bool TestSameSlots() {
+    std::vector<int16_t> input(WRITE_SAMPLES);
+    FillInput(input);
+    std::vector<int32_t> slots(WRITE_SAMPLES);
+    for (int volume = 0; volume <= 100; volume += 10) {
+        // Both compute the same Q16 gain, the integer one without pow()
+        CHECK(PcmVolumeToGain(volume) == (int32_t)(pow(double(volume) / 100.0, 2) * 65536));
+        PcmToSlot32(input.data(), slots.data(), input.size(), PcmVolumeToGain(volume));
+        int32_t old_slot = 0;
+        WriteOldSlots(input.data(), input.size(), volume, &old_slot);
+        CHECK(slots[WRITE_SAMPLES / 2] == old_slot);
+    }
+    return true;
+}
+
+static bool TestCyclesPerFrame() {
+    std::vector<int16_t> input(WRITE_SAMPLES);
+    FillInput(input);
+
+    long allocations = Allocations();
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        WriteOldFloat(input.data(), input.size(), VOLUME);
+    }
+    double old_float_seconds = Seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        WriteOldSlots(input.data(), input.size(), VOLUME);
+    }
+    double old_slots_seconds = Seconds(start);
+    long old_allocations = Allocations() - allocations;
+
+    std::vector<int16_t> output_buffer(WRITE_SAMPLES);
+    std::vector<int32_t> write_slots(WRITE_SAMPLES);
+    allocations = Allocations();
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        PcmApplyGain(input.data(), output_buffer.data(), input.size(), PcmVolumeToGain(VOLUME));
+        I2sWrite(output_buffer.data(), output_buffer.size() * sizeof(int16_t));
+    }
+    double new_gain_seconds = Seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        PcmToSlot32(input.data(), write_slots.data(), input.size(), PcmVolumeToGain(VOLUME));
+        I2sWrite(write_slots.data(), write_slots.size() * sizeof(int32_t));
+    }
+    double new_slots_seconds = Seconds(start);
+    long new_allocations = Allocations() - allocations;
+
+    printf("codec Write scaling, %d samples at volume %d:\n", WRITE_SAMPLES, VOLUME);
+    printf("  16-bit, old malloc + float: %.0f ns/frame\n", old_float_seconds * 1e9 / FRAMES);
+    printf("  16-bit, PcmApplyGain into a persistent buffer: %.0f ns/frame\n", new_gain_seconds * 1e9 / FRAMES);
+    printf("  32-bit slots, old vector + pow(): %.0f ns/frame\n", old_slots_seconds * 1e9 / FRAMES);
+    printf("  32-bit slots, PcmToSlot32 into a persistent buffer: %.0f ns/frame\n", new_slots_seconds * 1e9 / FRAMES);
+    printf("  allocations/frame: old %.2f, new %.2f\n", (double)old_allocations / FRAMES, (double)new_allocations / FRAMES);
+    CHECK(new_allocations == 0);
+    // malloc() is not counted, only the vector of the slot path
+    CHECK(old_allocations >= FRAMES);
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"same_slots", TestSameSlots},
+        {"cycles_per_frame", TestCyclesPerFrame},
+    };
+    int failures = 0;
+    for (auto& test : tests) {
+        bool ok = test.run();
+        printf("%s: %s\n", test.name, ok ? "ok" : "FAILED");
+        failures += ok ? 0 : 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+// Plays a server stream with a clock offset through a simulated playback pipeline and checks that
+// DriftCompensator learns the offset
+#include "drift_compensator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+#define SAMPLE_RATE 16000
+#define FRAME_MS 60
+#define FRAME_SAMPLES (SAMPLE_RATE / 1000 * FRAME_MS)
+// The server sends the first frames of a stream in a burst
+#define START_BURST_FRAMES 5
+// Mirrors the application: 4 blocks in the stream ring, 6 DMA buffers of 240 frames, written in 20 ms blocks
+#define RING_BLOCKS 4
+#define DMA_SAMPLES (6 * 240)
+#define MIXER_SAMPLES (SAMPLE_RATE / 1000 * 20)
+
+struct SimulationResult {
+    double average_ppm;     // Over the last SETTLED_MINUTES
+    int max_queued_frames;  // In the jitter buffer, once playing
+    int underruns;
+};
+
+#define SETTLED_MINUTES 10
+
+// offset_ppm is how much faster the server clock runs than the DAC, jitter_ms the most a packet is delayed by
+static SimulationResult Simulate(DriftCompensator& compensator, int offset_ppm, int jitter_ms, int minutes) {
+    SimulationResult result = {};
+    std::deque<int> ring;       // Samples left in each block
+    std::vector<int16_t> input(FRAME_SAMPLES, 0);
+    std::vector<int16_t> output(FRAME_SAMPLES + DRIFT_COMPENSATOR_MAX_EXTRA_SAMPLES);
+    uint32_t seed = 42;
+    double next_arrival_ms = 0;
+    uint32_t sent = 0;
+    int queued_frames = 0;
+    int dma = 0;
+    bool playing = false;
+    double ppm_sum = 0;
+    int ppm_count = 0;
+    const int64_t duration_ms = (int64_t)minutes * 60000;
+
+    compensator.Reset();
+    for (int64_t now_ms = 0; now_ms < duration_ms; now_ms++) {
+        // The server clock sends a frame every FRAME_MS of its own time
+        while (next_arrival_ms <= now_ms) {
+            queued_frames++;
+            sent++;
+            int64_t server_ms = sent < START_BURST_FRAMES ? 0 : (int64_t)(sent - START_BURST_FRAMES + 1) * FRAME_MS;
+            seed = seed * 1103515245 + 12345;
+            double arrival_ms = server_ms / (1 + offset_ppm * 1e-6) + (seed >> 16) % (jitter_ms + 1);
+            next_arrival_ms = std::max(next_arrival_ms, arrival_ms);
+        }
+
+        // Decode task: keeps the ring full from the jitter buffer
+        while ((int)ring.size() < RING_BLOCKS && queued_frames > 0) {
+            playing = true;
+            queued_frames--;
+            int queued_ms = queued_frames * FRAME_MS + (int)ring.size() * FRAME_MS + dma * 1000 / SAMPLE_RATE;
+            compensator.UpdateFill(queued_ms);
+            ring.push_back(compensator.Process(input.data(), FRAME_SAMPLES, output.data()));
+        }
+        if (playing) {
+            result.max_queued_frames = std::max(result.max_queued_frames, queued_frames);
+        }
+
+        // Output task: tops the DMA up in mixer blocks
+        while (!ring.empty() && dma + MIXER_SAMPLES <= DMA_SAMPLES) {
+            int take = std::min(MIXER_SAMPLES, ring.front());
+            dma += take;
+            ring.front() -= take;
+            if (ring.front() == 0) {
+                ring.pop_front();
+            }
+        }
+
+        // DAC
+        int played = SAMPLE_RATE / 1000;
+        if (dma < played && playing) {
+            result.underruns++;
+        }
+        dma = std::max(0, dma - played);
+
+        if (now_ms >= duration_ms - SETTLED_MINUTES * 60000) {
+            ppm_sum += compensator.ppm();
+            ppm_count++;
+        }
+    }
+    result.average_ppm = ppm_sum / ppm_count;
+    return result;
+}
+
+#define SETTLE_MINUTES 30
+
+static bool CheckSettles(int offset_ppm, int jitter_ms) {
+    DriftCompensator compensator;
+    auto result = Simulate(compensator, offset_ppm, jitter_ms, SETTLE_MINUTES);
+    CHECK(std::abs(result.average_ppm - offset_ppm) <= 10);
+    CHECK(result.underruns == 0);
+    // The excess of a fast server is played out, it does not pile up in the jitter buffer
+    CHECK(result.max_queued_frames <= 2);
+    return true;
+}
+
+static bool TestNoOffset() {
+    return CheckSettles(0, 0) && CheckSettles(0, 40);
+}
+
+static bool TestFastServer() {
+    return CheckSettles(100, 0) && CheckSettles(300, 40);
+}
+
+static bool TestSlowServer() {
+    return CheckSettles(-100, 0) && CheckSettles(-300, 40);
+}
+
+static bool TestKeptAcrossStreams() {
+    DriftCompensator compensator;
+    Simulate(compensator, 200, 0, SETTLE_MINUTES);
+    // The next stream starts out at the learned offset
+    auto result = Simulate(compensator, 200, 0, SETTLED_MINUTES);
+    CHECK(std::abs(result.average_ppm - 200) <= 10);
+    CHECK(result.underruns == 0);
+    return true;
+}
+
+// Drives the controller to the edge of its range, the setpoint is latched at setpoint_ms
+static void DriveTo(DriftCompensator& compensator, int setpoint_ms, int queued_ms) {
+    compensator.Reset();
+    for (int i = 0; i < 100 && std::abs(compensator.ppm()) < DRIFT_COMPENSATOR_MAX_PPM; i++) {
+        compensator.UpdateFill(i < 12 ? setpoint_ms : queued_ms);
+    }
+}
+
+// The integer Catmull-Rom against the same curve in double precision
+static bool CheckInterpolation(DriftCompensator& compensator) {
+    std::vector<int16_t> stream(FRAME_SAMPLES * 20);
+    for (size_t n = 0; n < stream.size(); n++) {
+        stream[n] = (int16_t)lround(30000 * sin(2 * M_PI * 3111.0 * n / SAMPLE_RATE));
+    }
+    // Samples before the stream are the zeroed history
+    auto at = [&](int64_t n) -> double {
+        return n < 0 ? 0 : stream[n];
+    };
+    int64_t step_q32 = (1LL << 32) + ((int64_t)compensator.ppm() << 32) / 1000000;
+    // The first output lands two samples before the stream starts
+    int64_t position_q32 = -(2LL << 32);
+    std::vector<int16_t> output(FRAME_SAMPLES + DRIFT_COMPENSATOR_MAX_EXTRA_SAMPLES);
+    int max_error = 0;
+    for (size_t offset = 0; offset < stream.size(); offset += FRAME_SAMPLES) {
+        int written = compensator.Process(stream.data() + offset, FRAME_SAMPLES, output.data());
+        for (int k = 0; k < written; k++) {
+            int64_t i = position_q32 >> 32;
+            double t = (uint32_t)position_q32 / 4294967296.0;
+            double xm1 = at(i - 1), x0 = at(i), x1 = at(i + 1), x2 = at(i + 2);
+            double y = x0 + 0.5 * t * (x1 - xm1 + t * (2 * xm1 - 5 * x0 + 4 * x1 - x2 + t * (3 * (x0 - x1) + x2 - xm1)));
+            max_error = std::max(max_error, (int)std::abs(output[k] - lround(std::clamp(y, -32768.0, 32767.0))));
+            position_q32 += step_q32;
+        }
+    }
+    printf("  %+d ppm: largest difference from the double precision curve %d\n", compensator.ppm(), max_error);
+    CHECK(max_error <= 1);
+    return true;
+}
+
+static bool TestInterpolation() {
+    DriftCompensator compensator;
+    compensator.Reset();
+    if (!CheckInterpolation(compensator)) {
+        return false;
+    }
+    DriveTo(compensator, 0, 1000);
+    CHECK(compensator.ppm() == DRIFT_COMPENSATOR_MAX_PPM);
+    if (!CheckInterpolation(compensator)) {
+        return false;
+    }
+    // A new compensator, the learned offset would hold the other one back
+    DriftCompensator slow;
+    DriveTo(slow, 1000, 0);
+    CHECK(slow.ppm() == -DRIFT_COMPENSATOR_MAX_PPM);
+    return CheckInterpolation(slow);
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"no offset", TestNoOffset},
+        {"fast server", TestFastServer},
+        {"slow server", TestSlowServer},
+        {"kept across streams", TestKeptAcrossStreams},
+        {"interpolation", TestInterpolation},
+    };
+    int failed = 0;
+    for (auto& test : tests) {
+        bool passed = test.run();
+        printf("%s: %s\n", test.name, passed ? "ok" : "FAILED");
+        failed += !passed;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+// Feeds synthetic utterances through Endpointer with the VAD flag of a well behaved AFE
+#include "endpointer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+#define SAMPLE_RATE 16000
+// The AFE fetches 512 samples at a time
+#define FRAME_SAMPLES 512
+#define FRAME_MS (FRAME_SAMPLES * 1000 / SAMPLE_RATE)
+#define HANGOVER_MS 700
+#define MIN_SPEECH_MS 300
+#define MAX_UTTERANCE_MS 20000
+
+struct Segment {
+    int duration_ms;
+    bool speech;        // A loud tone, room noise otherwise
+    bool vad;           // What the AFE VAD reports
+};
+
+struct Outcome {
+    EndpointerEvent event = kEndpointerNone;
+    int event_ms = -1;  // End of the frame that returned the event
+};
+
+static Outcome Run(Endpointer& endpointer, const std::vector<Segment>& segments) {
+    Outcome outcome;
+    std::vector<int16_t> frame(FRAME_SAMPLES);
+    uint32_t seed = 3;
+    int64_t position = 0;
+    int64_t segment_end = 0;
+    for (auto& segment : segments) {
+        segment_end += (int64_t)segment.duration_ms * SAMPLE_RATE / 1000;
+        endpointer.SetSpeaking(segment.vad);
+        for (; position + FRAME_SAMPLES <= segment_end; position += FRAME_SAMPLES) {
+            for (int i = 0; i < FRAME_SAMPLES; i++) {
+                seed = seed * 1103515245 + 12345;
+                int noise = (int)((seed >> 16) % 201) - 100;
+                double tone = segment.speech ? 6000 * sin(2 * M_PI * 220 * (position + i) / SAMPLE_RATE) : 0;
+                frame[i] = (int16_t)(tone + noise);
+            }
+            auto event = endpointer.Process(frame.data(), frame.size());
+            if (event != kEndpointerNone && outcome.event == kEndpointerNone) {
+                outcome.event = event;
+                outcome.event_ms = (position + FRAME_SAMPLES) * 1000 / SAMPLE_RATE;
+            }
+        }
+    }
+    return outcome;
+}
+
+// Segments do not end on frame boundaries, the frame across one may count for either side
+static bool Near(int event_ms, int expected_ms) {
+    return event_ms >= expected_ms - FRAME_MS && event_ms <= expected_ms + FRAME_MS;
+}
+
+static bool EndsNear(const Outcome& outcome, int expected_ms) {
+    CHECK(outcome.event == kEndpointerSpeechEnd);
+    CHECK(Near(outcome.event_ms, expected_ms));
+    return true;
+}
+
+static bool TestUtterance() {
+    Endpointer endpointer(SAMPLE_RATE, HANGOVER_MS, MIN_SPEECH_MS, MAX_UTTERANCE_MS);
+    auto outcome = Run(endpointer, {
+        {500, false, false},
+        {1500, true, true},
+        {2000, false, false},
+    });
+    CHECK(EndsNear(outcome, 500 + 1500 + HANGOVER_MS));
+    CHECK(endpointer.ended());
+    CHECK(Near(endpointer.speech_ms(), 1500));
+    return true;
+}
+
+static bool TestShortBurst() {
+    Endpointer endpointer(SAMPLE_RATE, HANGOVER_MS, MIN_SPEECH_MS, MAX_UTTERANCE_MS);
+    // A cough is not an utterance, the turn goes on and the next utterance ends it
+    auto outcome = Run(endpointer, {
+        {500, false, false},
+        {150, true, true},
+        {2000, false, false},
+        {1500, true, true},
+        {2000, false, false},
+    });
+    CHECK(EndsNear(outcome, 500 + 150 + 2000 + 1500 + HANGOVER_MS));
+    return true;
+}
+
+static bool TestPause() {
+    Endpointer endpointer(SAMPLE_RATE, HANGOVER_MS, MIN_SPEECH_MS, MAX_UTTERANCE_MS);
+    // A pause between words is shorter than the hangover
+    auto outcome = Run(endpointer, {
+        {500, false, false},
+        {700, true, true},
+        {400, false, false},
+        {800, true, true},
+        {2000, false, false},
+    });
+    CHECK(EndsNear(outcome, 500 + 700 + 400 + 800 + HANGOVER_MS));
+    return true;
+}
+
+static bool TestSpeechFirst() {
+    Endpointer endpointer(SAMPLE_RATE, HANGOVER_MS, MIN_SPEECH_MS, MAX_UTTERANCE_MS);
+    // The user talks from the first frame, no noise was measured before
+    auto outcome = Run(endpointer, {
+        {1500, true, true},
+        {2000, false, false},
+    });
+    CHECK(EndsNear(outcome, 1500 + HANGOVER_MS));
+    return true;
+}
+
+static bool TestNextTurn() {
+    Endpointer endpointer(SAMPLE_RATE, HANGOVER_MS, MIN_SPEECH_MS, MAX_UTTERANCE_MS);
+    Run(endpointer, {
+        {500, false, false},
+        {1500, true, true},
+        {2000, false, false},
+    });
+    CHECK(endpointer.ended());
+    endpointer.Reset();
+    CHECK(!endpointer.ended());
+    auto outcome = Run(endpointer, {
+        {1500, true, true},
+        {2000, false, false},
+    });
+    CHECK(EndsNear(outcome, 1500 + HANGOVER_MS));
+    return true;
+}
+
+static bool TestVadLatched() {
+    Endpointer endpointer(SAMPLE_RATE, HANGOVER_MS, MIN_SPEECH_MS, MAX_UTTERANCE_MS);
+    // The VAD keeps reporting speech on room noise, the energy ends the utterance
+    auto outcome = Run(endpointer, {
+        {500, false, false},
+        {1500, true, true},
+        {3000, false, true},
+    });
+    CHECK(EndsNear(outcome, 500 + 1500 + HANGOVER_MS));
+    return true;
+}
+
+static bool TestMaxUtterance() {
+    Endpointer endpointer(SAMPLE_RATE, HANGOVER_MS, MIN_SPEECH_MS, MAX_UTTERANCE_MS);
+    auto outcome = Run(endpointer, {
+        {500, false, false},
+        {MAX_UTTERANCE_MS + 2000, true, true},
+    });
+    CHECK(outcome.event == kEndpointerMaxUtterance);
+    CHECK(Near(outcome.event_ms, 500 + MAX_UTTERANCE_MS));
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"1.5 s utterance", TestUtterance},
+        {"150 ms burst", TestShortBurst},
+        {"400 ms pause", TestPause},
+        {"speech first", TestSpeechFirst},
+        {"next turn", TestNextTurn},
+        {"vad latched", TestVadLatched},
+        {"max utterance", TestMaxUtterance},
+    };
+    int failed = 0;
+    for (auto& test : tests) {
+        bool passed = test.run();
+        printf("%s: %s\n", test.name, passed ? "ok" : "FAILED");
+        failed += !passed;
+    }
+    return failed == 0 ? 0 : 1;
+}
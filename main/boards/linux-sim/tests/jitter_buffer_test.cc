@@ -0,0 +1,207 @@
+// Replays packet arrival traces through AudioJitterBuffer against a simulated playout clock
+#include "audio_jitter_buffer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+#define FRAME_MS 60
+#define TICK_MS 10
+// The decode task fills the stream ring and the TX DMA ahead of the DAC
+#define PLAYOUT_CAPACITY_MS (4 * FRAME_MS + 60)
+// The server sends the first frames of a sentence in a burst
+#define START_BURST_FRAMES 5
+
+struct Arrival {
+    int64_t time_ms;
+    uint32_t sequence;
+};
+
+struct Playout {
+    uint32_t sequence;
+    AudioJitterResult result;
+};
+
+struct TraceResult {
+    std::vector<Playout> played;
+    AudioJitterStats stats;
+    int starved_ms;     // Time the DAC ran dry between the first and the last frame
+};
+
+static int64_t NominalArrivalMs(uint32_t sequence) {
+    return std::max<int64_t>(0, ((int64_t)sequence - START_BURST_FRAMES) * FRAME_MS);
+}
+
+static std::vector<Arrival> MakeTrace(uint32_t frames) {
+    std::vector<Arrival> trace;
+    for (uint32_t sequence = 1; sequence <= frames; sequence++) {
+        trace.push_back({NominalArrivalMs(sequence), sequence});
+    }
+    return trace;
+}
+
+static TraceResult Run(std::vector<Arrival> trace, uint32_t frames) {
+    std::stable_sort(trace.begin(), trace.end(), [](const Arrival& a, const Arrival& b) {
+        return a.time_ms < b.time_ms;
+    });
+
+    AudioJitterBuffer jitter_buffer;
+    TraceResult result = {};
+    AudioStreamPacket packet;
+    size_t next_arrival = 0;
+    int playout_ms = 0;
+    for (int64_t now_ms = 0; now_ms < (int64_t)frames * FRAME_MS + 2000; now_ms += TICK_MS) {
+        while (next_arrival < trace.size() && trace[next_arrival].time_ms <= now_ms) {
+            AudioStreamPacket incoming;
+            incoming.sample_rate = 24000;
+            incoming.frame_duration = FRAME_MS;
+            incoming.sequence = trace[next_arrival].sequence;
+            incoming.payload.assign(8, (uint8_t)incoming.sequence);
+            jitter_buffer.Put(incoming, now_ms * 1000);
+            next_arrival++;
+        }
+
+        while (playout_ms + FRAME_MS <= PLAYOUT_CAPACITY_MS) {
+            auto status = jitter_buffer.Get(packet, now_ms * 1000, playout_ms);
+            if (status == kJitterEmpty) {
+                break;
+            }
+            result.played.push_back({packet.sequence, status});
+            playout_ms += FRAME_MS;
+        }
+
+        bool streaming = !result.played.empty() && result.played.back().sequence < frames;
+        if (streaming && playout_ms < TICK_MS) {
+            result.starved_ms += TICK_MS - playout_ms;
+        }
+        playout_ms = std::max(0, playout_ms - TICK_MS);
+    }
+    result.stats = jitter_buffer.GetStats();
+    return result;
+}
+
+// Every frame is heard once, in order, whatever happened to its packet
+static bool CheckContinuous(const TraceResult& result, uint32_t frames) {
+    uint32_t expected = 1;
+    for (auto& playout : result.played) {
+        CHECK(playout.sequence >= expected);
+        expected = playout.sequence + 1;
+    }
+    CHECK(expected == frames + 1);
+    return true;
+}
+
+static bool TestReorderByOne() {
+    const uint32_t frames = 50;
+    auto trace = MakeTrace(frames);
+    // Packets 20 and 21 swap places, 20 comes 20 ms after 21
+    trace[19].time_ms = trace[20].time_ms + 20;
+    auto result = Run(trace, frames);
+
+    CHECK(CheckContinuous(result, frames));
+    CHECK(result.played.size() == frames);
+    for (auto& playout : result.played) {
+        CHECK(playout.result == kJitterPacket);
+    }
+    CHECK(result.stats.late == 0);
+    CHECK(result.stats.concealed == 0);
+    CHECK(result.stats.recovered == 0);
+    CHECK(result.starved_ms == 0);
+    return true;
+}
+
+static std::vector<Arrival> DropFrames(uint32_t frames, uint32_t first_lost, uint32_t last_lost) {
+    std::vector<Arrival> trace;
+    for (auto& arrival : MakeTrace(frames)) {
+        if (arrival.sequence < first_lost || arrival.sequence > last_lost) {
+            trace.push_back(arrival);
+        }
+    }
+    return trace;
+}
+
+static bool TestBurstLoss() {
+    const uint32_t frames = 60;
+    auto result = Run(DropFrames(frames, 20, 22), frames);
+
+    CHECK(CheckContinuous(result, frames));
+    CHECK(result.played.size() == frames);
+    CHECK(result.played[19].sequence == 20 && result.played[19].result == kJitterConceal);
+    CHECK(result.played[20].sequence == 21 && result.played[20].result == kJitterConceal);
+    CHECK(result.played[21].sequence == 22 && result.played[21].result == kJitterRecover);
+    CHECK(result.played[22].sequence == 23 && result.played[22].result == kJitterPacket);
+    CHECK(result.stats.concealed == 2);
+    CHECK(result.stats.recovered == 1);
+    CHECK(result.stats.late == 0);
+    // The gap is filled at its deadline, the DAC keeps playing through it
+    CHECK(result.starved_ms == 0);
+    return true;
+}
+
+static bool TestLongLoss() {
+    const uint32_t frames = 60;
+    // Longer than the audio queued ahead, playback stalls and resumes with the next packet
+    auto result = Run(DropFrames(frames, 20, 27), frames);
+
+    CHECK(CheckContinuous(result, frames));
+    CHECK(result.played[19].sequence == 28 && result.played[19].result == kJitterPacket);
+    CHECK(result.stats.concealed == 0);
+    CHECK(result.stats.recovered == 0);
+    CHECK(result.stats.skipped == 8);
+    CHECK(result.stats.late == 0);
+    CHECK(result.starved_ms > 0);
+    return true;
+}
+
+static bool TestJitter() {
+    const uint32_t frames = 500;
+    auto trace = MakeTrace(frames);
+    // Up to 70 ms of delay on every packet after the first burst, neighbours often arrive out of order
+    uint32_t seed = 12345;
+    int reordered = 0;
+    for (auto& arrival : trace) {
+        seed = seed * 1103515245 + 12345;
+        if (arrival.sequence > START_BURST_FRAMES) {
+            arrival.time_ms += (seed >> 16) % 71;
+        }
+    }
+    for (size_t i = 1; i < trace.size(); i++) {
+        reordered += trace[i].time_ms < trace[i - 1].time_ms;
+    }
+    CHECK(reordered > 0);
+    auto result = Run(trace, frames);
+
+    CHECK(CheckContinuous(result, frames));
+    CHECK(result.played.size() == frames);
+    CHECK(result.stats.late == 0);
+    CHECK(result.stats.concealed == 0);
+    CHECK(result.stats.recovered == 0);
+    CHECK(result.starved_ms == 0);
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"reorder by one", TestReorderByOne},
+        {"burst loss", TestBurstLoss},
+        {"long loss", TestLongLoss},
+        {"jitter", TestJitter},
+    };
+    int failed = 0;
+    for (auto& test : tests) {
+        bool passed = test.run();
+        printf("%s: %s\n", test.name, passed ? "ok" : "FAILED");
+        failed += !passed;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+// Checks the hits, evictions and owner separation of OpusDecoderCache against a stub libopus
+#include "opus_decoder_cache.h"
+
+#include <cstdio>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+#define OUTPUT_SAMPLE_RATE 24000
+
+static bool TestHitReusesPair() {
+    OpusDecoderCache cache(OUTPUT_SAMPLE_RATE);
+    auto& first = cache.Get(16000, 60);
+    CHECK(first.decoder && first.decoder->sample_rate() == 16000 && first.decoder->duration_ms() == 60);
+    CHECK(first.resampler && first.resampler->input_sample_rate() == 16000);
+    CHECK(first.resampler->output_sample_rate() == OUTPUT_SAMPLE_RATE);
+    auto& second = cache.Get(16000, 60);
+    CHECK(&first == &second);
+
+    // A stream at the output rate needs no resampler, a different frame duration is a different format
+    auto& native = cache.Get(OUTPUT_SAMPLE_RATE, 60);
+    CHECK(native.decoder && !native.resampler);
+    auto& short_frames = cache.Get(16000, 20);
+    CHECK(&short_frames != &first && short_frames.decoder->frame_size() == 16000 / 1000 * 20);
+
+    auto stats = cache.GetStats();
+    CHECK(stats.hits == 1 && stats.misses == 3 && stats.evictions == 0);
+    CHECK(g_opus_decoders_alive == 3);
+    return true;
+}
+
+static bool TestEvictsLeastRecentlyUsed() {
+    OpusDecoderCache cache(OUTPUT_SAMPLE_RATE);
+    auto* a = cache.Get(16000, 60).decoder.get();
+    cache.Get(24000, 60);
+    auto* c = cache.Get(16000, 20).decoder.get();
+    // Touch the oldest so the second one becomes the least recently used
+    CHECK(cache.Get(16000, 60).decoder.get() == a);
+    cache.Get(8000, 60);
+    auto stats = cache.GetStats();
+    CHECK(stats.misses == 4 && stats.evictions == 1);
+    CHECK(g_opus_decoders_alive == OPUS_DECODER_CACHE_SIZE);
+
+    // The survivors still hit, the evicted format misses and pushes out the next oldest
+    CHECK(cache.Get(16000, 60).decoder.get() == a);
+    CHECK(cache.Get(16000, 20).decoder.get() == c);
+    cache.Get(24000, 60);
+    stats = cache.GetStats();
+    CHECK(stats.hits == 3 && stats.misses == 5 && stats.evictions == 2);
+    CHECK(cache.Get(16000, 60).decoder.get() == a);
+    CHECK(cache.Get(16000, 20).decoder.get() == c);
+    CHECK(cache.GetStats().misses == 5);
+    return true;
+}
+
+static bool TestOwnersDoNotShare() {
+    OpusDecoderCache cache(OUTPUT_SAMPLE_RATE);
+    auto& tts = cache.Get(16000, 60, 0);
+    auto& prompt = cache.Get(16000, 60, 1);
+    CHECK(&tts != &prompt);
+    CHECK(&cache.Get(16000, 60, 0) == &tts);
+    CHECK(&cache.Get(16000, 60, 1) == &prompt);
+    return true;
+}
+
+static bool TestResetStateOfOwner() {
+    OpusDecoderCache cache(OUTPUT_SAMPLE_RATE);
+    auto& tts = cache.Get(16000, 60, 0);
+    cache.Get(OUTPUT_SAMPLE_RATE, 60, 0);
+    cache.Get(16000, 60, 1);
+    int16_t pcm[16000 / 1000 * 60];
+    const uint8_t packet[] = { 0xf8 };
+    CHECK(tts.decoder->Decode(packet, sizeof(packet), pcm) == 16000 / 1000 * 60);
+
+    // Only the decoders of the owner forget their history
+    int resets = g_opus_decoder_resets;
+    cache.ResetState(0);
+    CHECK(g_opus_decoder_resets == resets + 2);
+    cache.ResetState(1);
+    CHECK(g_opus_decoder_resets == resets + 3);
+    cache.ResetState(2);
+    CHECK(g_opus_decoder_resets == resets + 3);
+    // Resetting keeps the pairs
+    CHECK(&cache.Get(16000, 60, 0) == &tts);
+    CHECK(cache.GetStats().misses == 3);
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"hit_reuses_pair", TestHitReusesPair},
+        {"evicts_least_recently_used", TestEvictsLeastRecentlyUsed},
+        {"owners_do_not_share", TestOwnersDoNotShare},
+        {"reset_state_of_owner", TestResetStateOfOwner},
+    };
+    int failures = 0;
+    for (auto& test : tests) {
+        bool ok = test.run();
+        printf("%s: %s\n", test.name, ok ? "ok" : "FAILED");
+        failures += ok ? 0 : 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
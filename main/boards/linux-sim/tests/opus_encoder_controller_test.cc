@@ -0,0 +1,239 @@
+// Drives OpusEncoderController with synthetic CPU and transport windows and checks its decisions
+#include "opus_encoder_controller.h"
+
+#include <cstdio>
+#include <string>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+#define FRAME_MS 60
+#define MAX_COMPLEXITY 5
+#define TOP_BITRATE 16000
+
+struct Window {
+    int64_t encode_us = 3000;   // per frame, 5% of a 60 ms frame
+    size_t backlog = 1;
+    uint32_t input_misses = 0;
+    int send_failures = 0;
+    size_t queue_depth = 0;     // in packets
+};
+
+// Feeds frames until a window closes, returns true if that changed the settings
+static bool Run(OpusEncoderController& controller, const Window& window, int frame_ms = FRAME_MS) {
+    int frames = (ENCODER_CONTROLLER_WINDOW_MS + frame_ms - 1) / frame_ms;
+    for (int i = 0; i < frames; i++) {
+        controller.OnPacketSent(i >= window.send_failures, window.queue_depth);
+    }
+    bool changed = false;
+    for (int i = 0; i < frames; i++) {
+        changed = controller.OnFramesEncoded(1, window.encode_us, window.backlog, window.input_misses);
+    }
+    return changed;
+}
+
+static bool TestStartsAtTopBitrate() {
+    OpusEncoderController controller;
+    controller.Reset(FRAME_MS, 3, MAX_COMPLEXITY);
+    CHECK(controller.complexity() == 3);
+    CHECK(controller.bitrate() == TOP_BITRATE);
+    // The requested complexity is capped
+    controller.Reset(FRAME_MS, 9, MAX_COMPLEXITY);
+    CHECK(controller.complexity() == MAX_COMPLEXITY);
+    return true;
+}
+
+static bool TestComplexityRisesSlowly() {
+    OpusEncoderController controller;
+    controller.Reset(FRAME_MS, 0, MAX_COMPLEXITY);
+    Window calm;
+    // One step per five calm windows, never above the cap
+    for (int i = 0; i < 4; i++) {
+        CHECK(!Run(controller, calm));
+    }
+    CHECK(Run(controller, calm));
+    CHECK(controller.complexity() == 1);
+    for (int i = 0; i < 50; i++) {
+        Run(controller, calm);
+    }
+    CHECK(controller.complexity() == MAX_COMPLEXITY);
+    return true;
+}
+
+static bool TestComplexityDropsAtOnce() {
+    OpusEncoderController controller;
+    controller.Reset(FRAME_MS, MAX_COMPLEXITY, MAX_COMPLEXITY);
+
+    Window loaded;
+    loaded.encode_us = FRAME_MS * 1000 / 2;
+    CHECK(Run(controller, loaded));
+    CHECK(controller.complexity() == MAX_COMPLEXITY - 2);
+
+    // A pile-up on the encoding task is enough on its own
+    Window backlog;
+    backlog.backlog = 4;
+    CHECK(Run(controller, backlog));
+    CHECK(controller.complexity() == MAX_COMPLEXITY - 4);
+
+    // So is a missed input deadline, the counter is cumulative so only new misses count
+    Window misses;
+    misses.input_misses = 1;
+    CHECK(Run(controller, misses));
+    CHECK(controller.complexity() == 0);
+    CHECK(!Run(controller, misses));
+    // Nothing below zero
+    CHECK(!Run(controller, loaded));
+    CHECK(controller.complexity() == 0);
+
+    // After a reset the first window only latches the counter
+    controller.Reset(FRAME_MS, MAX_COMPLEXITY, MAX_COMPLEXITY);
+    misses.input_misses = 50;
+    CHECK(!Run(controller, misses));
+    misses.input_misses = 51;
+    CHECK(Run(controller, misses));
+    CHECK(controller.complexity() == MAX_COMPLEXITY - 2);
+    return true;
+}
+
+static bool TestMiddleLoadHolds() {
+    OpusEncoderController controller;
+    controller.Reset(FRAME_MS, 2, MAX_COMPLEXITY);
+    // Between the thresholds nothing moves, and the calm count starts over
+    Window middle;
+    middle.encode_us = FRAME_MS * 1000 / 4;
+    Window calm;
+    for (int i = 0; i < 20; i++) {
+        CHECK(!Run(controller, i % 4 == 3 ? middle : calm));
+    }
+    CHECK(controller.complexity() == 2);
+    return true;
+}
+
+static bool TestBitrateFollowsTransport() {
+    OpusEncoderController controller;
+    controller.Reset(FRAME_MS, 0, 0);
+
+    Window failing;
+    failing.send_failures = 1;
+    for (int i = 0; i < 10; i++) {
+        Run(controller, failing);
+    }
+    CHECK(controller.bitrate() == 6000);
+
+    // A queue of 300 ms or more counts as congestion
+    controller.ResetBitrate();
+    Window queued;
+    queued.queue_depth = 300 / FRAME_MS;
+    CHECK(Run(controller, queued));
+    CHECK(controller.bitrate() == 12000);
+
+    // Ten clean windows per step back up
+    Window clean;
+    for (int i = 0; i < 9; i++) {
+        CHECK(!Run(controller, clean));
+    }
+    CHECK(Run(controller, clean));
+    CHECK(controller.bitrate() == TOP_BITRATE);
+
+    // A queue between the thresholds holds the bitrate and resets the clean count
+    controller.ResetBitrate();
+    Run(controller, queued);
+    Window middle;
+    middle.queue_depth = 200 / FRAME_MS;
+    for (int i = 0; i < 30; i++) {
+        CHECK(!Run(controller, i % 5 == 4 ? middle : clean));
+    }
+    CHECK(controller.bitrate() == 12000);
+    return true;
+}
+
+static bool TestResetBitrateKeepsComplexity() {
+    OpusEncoderController controller;
+    controller.Reset(FRAME_MS, MAX_COMPLEXITY, MAX_COMPLEXITY);
+    Window bad;
+    bad.encode_us = FRAME_MS * 1000;
+    bad.send_failures = 1;
+    CHECK(Run(controller, bad));
+    CHECK(controller.complexity() == MAX_COMPLEXITY - 2);
+    CHECK(controller.bitrate() == 12000);
+
+    controller.ResetBitrate();
+    CHECK(controller.bitrate() == TOP_BITRATE);
+    CHECK(controller.complexity() == MAX_COMPLEXITY - 2);
+    return true;
+}
+
+static bool TestFrameDurations() {
+    static const int kFrameDurations[] = { 20, 40, 60 };
+    for (int frame_ms : kFrameDurations) {
+        // A window is a second of audio whatever the frame duration
+        OpusEncoderController controller;
+        controller.Reset(frame_ms, MAX_COMPLEXITY, MAX_COMPLEXITY);
+        int frames = (ENCODER_CONTROLLER_WINDOW_MS + frame_ms - 1) / frame_ms;
+        for (int i = 0; i < frames - 1; i++) {
+            CHECK(!controller.OnFramesEncoded(1, frame_ms * 1000, 1, 0));
+        }
+        CHECK(controller.OnFramesEncoded(1, frame_ms * 1000, 1, 0));
+
+        // The queue thresholds are in milliseconds, not packets
+        controller.Reset(frame_ms, 0, 0);
+        Window middle;
+        middle.queue_depth = 240 / frame_ms;
+        CHECK(!Run(controller, middle, frame_ms));
+        Window queued;
+        queued.queue_depth = (300 + frame_ms - 1) / frame_ms;
+        CHECK(Run(controller, queued, frame_ms));
+        CHECK(controller.bitrate() == 12000);
+
+        // The CPU share is of the frame time
+        controller.Reset(frame_ms, MAX_COMPLEXITY, MAX_COMPLEXITY);
+        Window light;
+        light.encode_us = frame_ms * 1000 / 10;
+        CHECK(!Run(controller, light, frame_ms));
+        Window heavy;
+        heavy.encode_us = frame_ms * 1000 / 2;
+        CHECK(Run(controller, heavy, frame_ms));
+    }
+    return true;
+}
+
+static bool TestMetrics() {
+    OpusEncoderController controller;
+    controller.Reset(FRAME_MS, MAX_COMPLEXITY, MAX_COMPLEXITY);
+    Window failing;
+    failing.send_failures = 2;
+    Run(controller, failing);
+    std::string json = controller.GetMetricsJson();
+    CHECK(json.find("\"bitrate\":12000") != std::string::npos);
+    CHECK(json.find("\"send_failures\":2") != std::string::npos);
+    CHECK(json.find("\"bitrate_changes\":1") != std::string::npos);
+    CHECK(json.find("send failures 2") != std::string::npos);
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"starts_at_top_bitrate", TestStartsAtTopBitrate},
+        {"complexity_rises_slowly", TestComplexityRisesSlowly},
+        {"complexity_drops_at_once", TestComplexityDropsAtOnce},
+        {"middle_load_holds", TestMiddleLoadHolds},
+        {"bitrate_follows_transport", TestBitrateFollowsTransport},
+        {"reset_bitrate_keeps_complexity", TestResetBitrateKeepsComplexity},
+        {"frame_durations", TestFrameDurations},
+        {"metrics", TestMetrics},
+    };
+    int failures = 0;
+    for (auto& test : tests) {
+        bool ok = test.run();
+        printf("%s: %s\n", test.name, ok ? "ok" : "FAILED");
+        failures += ok ? 0 : 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+// Feeds synthetic loss patterns through PacketLossMeter
+#include "packet_loss_meter.h"
+
+#include <cstdio>
+#include <functional>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+// Counts windows of PACKET_LOSS_WINDOW sequence numbers, lost decides which of them never arrive
+static void Feed(PacketLossMeter& meter, uint32_t& sequence, int windows, const std::function<bool(uint32_t)>& lost) {
+    for (int i = 0; i < windows * PACKET_LOSS_WINDOW; i++, sequence++) {
+        if (!lost(sequence)) {
+            meter.Count(sequence);
+        }
+    }
+}
+
+static bool NoLoss(uint32_t) {
+    return false;
+}
+
+// One packet in ten, spread evenly
+static bool TenPercent(uint32_t sequence) {
+    return sequence % 10 == 5;
+}
+
+static bool TestClean() {
+    PacketLossMeter meter;
+    uint32_t sequence = 1;
+    Feed(meter, sequence, 10, NoLoss);
+    CHECK(meter.percent() == 0);
+    return true;
+}
+
+static bool TestSteadyLoss() {
+    PacketLossMeter meter;
+    uint32_t sequence = 1;
+    Feed(meter, sequence, 10, TenPercent);
+    CHECK(meter.percent() == 10);
+    return true;
+}
+
+static bool TestSmallLoss() {
+    PacketLossMeter meter;
+    uint32_t sequence = 1;
+    // One packet in a hundred, every other window loses one of its 50
+    Feed(meter, sequence, 20, [](uint32_t sequence) { return sequence % 100 == 50; });
+    CHECK(meter.percent() >= 1 && meter.percent() <= 2);
+    return true;
+}
+
+static bool TestLossStops() {
+    PacketLossMeter meter;
+    uint32_t sequence = 1;
+    Feed(meter, sequence, 10, TenPercent);
+    CHECK(meter.percent() == 10);
+    Feed(meter, sequence, 10, NoLoss);
+    // The estimate has to come all the way down, the encoder keeps paying for FEC otherwise
+    CHECK(meter.percent() == 0);
+    return true;
+}
+
+static bool TestSingleBurst() {
+    PacketLossMeter meter;
+    uint32_t sequence = 1;
+    Feed(meter, sequence, 5, NoLoss);
+    uint32_t burst_start = sequence + 10;
+    Feed(meter, sequence, 1, [burst_start](uint32_t sequence) {
+        return sequence >= burst_start && sequence < burst_start + 10;
+    });
+    // 20% in one window is halved by the average
+    CHECK(meter.percent() == 10);
+    Feed(meter, sequence, 1, NoLoss);
+    CHECK(meter.percent() == 5);
+    Feed(meter, sequence, 8, NoLoss);
+    CHECK(meter.percent() == 0);
+    return true;
+}
+
+static bool TestReorder() {
+    PacketLossMeter meter;
+    uint32_t sequence = 1;
+    // Neighbours swap places, nothing is lost. Only a swap across the end of a window
+    // is counted, one packet in PACKET_LOSS_WINDOW
+    for (int i = 0; i < 10 * PACKET_LOSS_WINDOW; i += 2, sequence += 2) {
+        meter.Count(sequence + 1);
+        meter.Count(sequence);
+    }
+    CHECK(meter.percent() <= 100 / PACKET_LOSS_WINDOW);
+    return true;
+}
+
+static bool TestReset() {
+    PacketLossMeter meter;
+    uint32_t sequence = 1;
+    Feed(meter, sequence, 10, TenPercent);
+    meter.Reset();
+    CHECK(meter.percent() == 0);
+    // A new channel numbers its packets from 1 again
+    sequence = 1;
+    Feed(meter, sequence, 1, NoLoss);
+    CHECK(meter.percent() == 0);
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"clean", TestClean},
+        {"steady loss", TestSteadyLoss},
+        {"small loss", TestSmallLoss},
+        {"loss stops", TestLossStops},
+        {"single burst", TestSingleBurst},
+        {"reorder", TestReorder},
+        {"reset", TestReset},
+    };
+    int failed = 0;
+    for (auto& test : tests) {
+        bool passed = test.run();
+        printf("%s: %s\n", test.name, passed ? "ok" : "FAILED");
+        failed += !passed;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+// Checks the word-wise and unrolled paths of the PCM kernels against one sample at a time
+#include "pcm_convert.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+// Odd lengths leave a tail after the unrolled loops, odd offsets break the word alignment
+static const size_t kLengths[] = {0, 1, 3, 4, 7, 64, 241};
+static const size_t kOffsets[] = {0, 1};
+
+static std::vector<int16_t> MakeSamples(size_t count) {
+    std::vector<int16_t> samples(count);
+    uint32_t seed = 7;
+    for (auto& sample : samples) {
+        seed = seed * 1103515245 + 12345;
+        sample = (int16_t)(seed >> 16);
+    }
+    if (count > 1) {
+        samples[0] = INT16_MIN;
+        samples[1] = INT16_MAX;
+    }
+    return samples;
+}
+
+static int32_t Saturate32(int64_t value) {
+    return (int32_t)std::clamp<int64_t>(value, INT32_MIN, INT32_MAX);
+}
+
+static bool TestInterleave() {
+    for (size_t frames : kLengths) {
+        for (size_t offset : kOffsets) {
+            auto input = MakeSamples(frames * 2 + offset);
+            std::vector<int16_t> left(frames + offset), right(frames + offset), output(frames * 2 + offset);
+            PcmDeinterleave2(input.data() + offset, left.data() + offset, right.data() + offset, frames);
+            for (size_t i = 0; i < frames; i++) {
+                CHECK(left[offset + i] == input[offset + i * 2]);
+                CHECK(right[offset + i] == input[offset + i * 2 + 1]);
+            }
+            PcmInterleave2(left.data() + offset, right.data() + offset, output.data() + offset, frames);
+            CHECK(std::equal(input.begin() + offset, input.end(), output.begin() + offset));
+        }
+    }
+    return true;
+}
+
+static bool TestVolumeToGain() {
+    CHECK(PcmVolumeToGain(0) == 0);
+    CHECK(PcmVolumeToGain(50) == 16384);
+    CHECK(PcmVolumeToGain(100) == 65536);
+    CHECK(PcmVolumeToGain(150) == 65536);
+    CHECK(PcmVolumeToGain(-5) == 0);
+    return true;
+}
+
+static bool TestToSlot32() {
+    // Attenuating gains take the 32-bit path, larger ones the saturating path
+    for (int32_t gain : {0, 1000, 65536, 70000, 200000}) {
+        for (size_t samples : kLengths) {
+            auto input = MakeSamples(samples);
+            std::vector<int32_t> mono(samples), dual(samples * 2);
+            PcmToSlot32(input.data(), mono.data(), samples, gain);
+            PcmToSlot32Dual(input.data(), dual.data(), samples, gain);
+            for (size_t i = 0; i < samples; i++) {
+                int32_t expected = Saturate32((int64_t)input[i] * gain);
+                CHECK(mono[i] == expected);
+                CHECK(dual[i * 2] == expected && dual[i * 2 + 1] == expected);
+            }
+        }
+    }
+    return true;
+}
+
+static bool TestFromSlot32() {
+    for (int shift : {8, 16}) {
+        for (size_t samples : kLengths) {
+            std::vector<int32_t> input(samples);
+            for (size_t i = 0; i < samples; i++) {
+                input[i] = (int32_t)(i * 2654435761u);
+            }
+            std::vector<int16_t> output(samples);
+            PcmFromSlot32(input.data(), output.data(), samples, shift);
+            for (size_t i = 0; i < samples; i++) {
+                CHECK(output[i] == (int16_t)std::clamp<int32_t>(input[i] >> shift, INT16_MIN, INT16_MAX));
+            }
+        }
+    }
+    // Full gain expands and narrows back to the same samples
+    auto input = MakeSamples(241);
+    std::vector<int32_t> slots(input.size());
+    std::vector<int16_t> output(input.size());
+    PcmToSlot32(input.data(), slots.data(), input.size(), 65536);
+    PcmFromSlot32(slots.data(), output.data(), output.size(), 16);
+    CHECK(output == input);
+    return true;
+}
+
+static bool TestExtractChannel() {
+    for (int channels : {1, 2, 3, 4}) {
+        for (size_t frames : kLengths) {
+            auto input = MakeSamples(frames * channels);
+            for (int channel = 0; channel < channels; channel++) {
+                std::vector<int16_t> output(frames);
+                PcmExtractChannel(input.data(), output.data(), frames, channels, channel);
+                for (size_t i = 0; i < frames; i++) {
+                    CHECK(output[i] == input[i * channels + channel]);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static bool TestApplyGain() {
+    // Unity copies, attenuation takes the unrolled 32-bit path, boost the saturating one
+    for (int32_t gain : {0, 1000, PcmVolumeToGain(70), 65536, 70000, 200000}) {
+        for (size_t samples : kLengths) {
+            auto input = MakeSamples(samples);
+            std::vector<int16_t> output(samples);
+            PcmApplyGain(input.data(), output.data(), samples, gain);
+            for (size_t i = 0; i < samples; i++) {
+                int64_t expected = std::clamp<int64_t>(((int64_t)input[i] * gain) >> 16, INT16_MIN, INT16_MAX);
+                CHECK(output[i] == expected);
+            }
+            // In place gives the same samples
+            auto in_place = input;
+            PcmApplyGain(in_place.data(), in_place.data(), samples, gain);
+            CHECK(in_place == output);
+        }
+    }
+    return true;
+}
+
+static bool TestByteSwap16() {
+    for (size_t samples : kLengths) {
+        for (size_t offset : kOffsets) {
+            auto input = MakeSamples(samples + offset);
+            std::vector<int16_t> output(samples + offset);
+            PcmByteSwap16(input.data() + offset, output.data() + offset, samples);
+            for (size_t i = 0; i < samples; i++) {
+                uint16_t v = (uint16_t)input[offset + i];
+                CHECK((uint16_t)output[offset + i] == (uint16_t)((v << 8) | (v >> 8)));
+            }
+            // Swapping twice in place is the identity
+            PcmByteSwap16(output.data() + offset, output.data() + offset, samples);
+            CHECK(std::equal(input.begin() + offset, input.end(), output.begin() + offset));
+        }
+    }
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"interleave", TestInterleave},
+        {"volume to gain", TestVolumeToGain},
+        {"to slot32", TestToSlot32},
+        {"from slot32", TestFromSlot32},
+        {"extract channel", TestExtractChannel},
+        {"apply gain", TestApplyGain},
+        {"byte swap16", TestByteSwap16},
+    };
+    int failed = 0;
+    for (auto& test : tests) {
+        bool passed = test.run();
+        printf("%s: %s\n", test.name, passed ? "ok" : "FAILED");
+        failed += !passed;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,5 @@
+// PolyphaseResampler built a second time as on ESP32-S3, with the dot product on the esp-dsp kernel.
+// The class is renamed so the test links both builds
+#define CONFIG_IDF_TARGET_ESP32S3 1
+#define PolyphaseResampler PolyphaseResamplerDsp
+#include "polyphase_resampler.cc"
@@ -0,0 +1,176 @@
+// Measures PolyphaseResampler per ratio: THD+N of a passband tone, rejection of images and aliases, time per frame.
+// OpusResampler is the libopus silk resampler and libopus is not built on the host, so there is no timing to
+// compare against here; both have to be timed on the device.
+#include "polyphase_resampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+#define CHUNK_MS 20
+#define DURATION_MS 1200
+// Skipped at the start of the output, longer than the filter delay of every ratio
+#define SETTLE_MS 100
+// Half of full scale, so the overshoot of the filter cannot clip
+#define AMPLITUDE 16384.0
+#define FRAMES 5000
+
+// Every test tone makes a whole number of cycles in this many milliseconds at every rate used here
+#define PERIOD_MS 5
+
+struct Ratio {
+    int input_rate;
+    int output_rate;
+};
+
+static const Ratio kRatios[] = {
+    {16000, 24000},
+    {24000, 16000},
+    {16000, 48000},
+    {48000, 16000},
+    {24000, 48000},
+    {48000, 24000},
+};
+
+static std::vector<int16_t> Resample(const Ratio& ratio, double frequency) {
+    PolyphaseResampler resampler;
+    resampler.Configure(ratio.input_rate, ratio.output_rate);
+    int chunk = ratio.input_rate / 1000 * CHUNK_MS;
+    std::vector<int16_t> input(chunk);
+    std::vector<int16_t> block(resampler.GetOutputSamples(chunk) + 1);
+    std::vector<int16_t> output;
+    for (int n = 0; n < ratio.input_rate / 1000 * DURATION_MS; n += chunk) {
+        for (int i = 0; i < chunk; i++) {
+            input[i] = (int16_t)lround(AMPLITUDE * sin(2 * M_PI * frequency * (n + i) / ratio.input_rate));
+        }
+        int written = resampler.Process(input.data(), chunk, block.data());
+        output.insert(output.end(), block.begin(), block.begin() + written);
+    }
+    // Drop the start and keep whole tone periods
+    int settle = ratio.output_rate / 1000 * SETTLE_MS;
+    int period = ratio.output_rate / 1000 * PERIOD_MS;
+    int length = (output.size() - settle) / period * period;
+    return std::vector<int16_t>(output.begin() + settle, output.begin() + settle + length);
+}
+
+// Fits the tone at frequency over the output, returns its amplitude and the power of what is left
+static void FitTone(const std::vector<int16_t>& output, int sample_rate, double frequency,
+    double& amplitude, double& residual_power) {
+    double s = 0, c = 0;
+    for (size_t i = 0; i < output.size(); i++) {
+        double phase = 2 * M_PI * frequency * i / sample_rate;
+        s += output[i] * sin(phase);
+        c += output[i] * cos(phase);
+    }
+    s = s * 2 / output.size();
+    c = c * 2 / output.size();
+    amplitude = sqrt(s * s + c * c);
+    residual_power = 0;
+    for (size_t i = 0; i < output.size(); i++) {
+        double phase = 2 * M_PI * frequency * i / sample_rate;
+        double error = output[i] - s * sin(phase) - c * cos(phase);
+        residual_power += error * error;
+    }
+    residual_power /= output.size();
+}
+
+static double Decibels(double power_ratio) {
+    return 10 * log10(power_ratio);
+}
+
+static bool TestThdPlusNoise() {
+    for (auto& ratio : kRatios) {
+        double amplitude, residual_power;
+        auto output = Resample(ratio, 1000);
+        FitTone(output, ratio.output_rate, 1000, amplitude, residual_power);
+        double gain = 20 * log10(amplitude / AMPLITUDE);
+        double snr = Decibels(amplitude * amplitude / 2 / residual_power);
+        printf("  %d -> %d: 1 kHz gain %+.3f dB, THD+N %.1f dB below the tone\n",
+            ratio.input_rate, ratio.output_rate, gain, snr);
+        CHECK(fabs(gain) < 0.1);
+        CHECK(snr > 70);
+    }
+    return true;
+}
+
+static bool TestStopband() {
+    for (auto& ratio : kRatios) {
+        double rejection;
+        if (ratio.input_rate > ratio.output_rate) {
+            // A tone above the output Nyquist folds back, all of the output is alias
+            double frequency = ratio.output_rate * 0.6;
+            auto output = Resample(ratio, frequency);
+            double power = 0;
+            for (auto sample : output) {
+                power += (double)sample * sample;
+            }
+            // An all zero output is counted as the noise of one LSB of rounding
+            power = std::max(power / output.size(), 1.0 / 12);
+            rejection = Decibels(AMPLITUDE * AMPLITUDE / 2 / power);
+            printf("  %d -> %d: %.0f Hz alias %.1f dB below the input\n",
+                ratio.input_rate, ratio.output_rate, frequency, rejection);
+        } else {
+            // A tone near the input Nyquist leaves images above it, everything but the tone is image
+            double frequency = ratio.input_rate * 0.4;
+            double amplitude, residual_power;
+            auto output = Resample(ratio, frequency);
+            FitTone(output, ratio.output_rate, frequency, amplitude, residual_power);
+            rejection = Decibels(amplitude * amplitude / 2 / residual_power);
+            printf("  %d -> %d: %.0f Hz images %.1f dB below the tone\n",
+                ratio.input_rate, ratio.output_rate, frequency, rejection);
+        }
+        CHECK(rejection > 55);
+    }
+    return true;
+}
+
+static bool TestCyclesPerFrame() {
+    for (auto& ratio : kRatios) {
+        PolyphaseResampler resampler;
+        resampler.Configure(ratio.input_rate, ratio.output_rate);
+        int chunk = ratio.input_rate / 1000 * CHUNK_MS;
+        std::vector<int16_t> input(chunk);
+        for (int i = 0; i < chunk; i++) {
+            input[i] = (int16_t)(i * 977);
+        }
+        std::vector<int16_t> output(resampler.GetOutputSamples(chunk));
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < FRAMES; frame++) {
+            resampler.Process(input.data(), chunk, output.data());
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        // Taps per output as Configure() sizes them
+        int taps = 24 * ((ratio.input_rate + ratio.output_rate - 1) / ratio.output_rate);
+        printf("  %d -> %d: %.0f ns per %d ms frame, %d multiply-accumulates\n", ratio.input_rate, ratio.output_rate,
+            seconds * 1e9 / FRAMES, CHUNK_MS, taps * (int)output.size());
+    }
+    printf("  OpusResampler: not on the host, time it on the device\n");
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"thd_plus_noise", TestThdPlusNoise},
+        {"stopband", TestStopband},
+        {"cycles_per_frame", TestCyclesPerFrame},
+    };
+    int failures = 0;
+    for (auto& test : tests) {
+        bool ok = test.run();
+        printf("%s: %s\n", test.name, ok ? "ok" : "FAILED");
+        failures += ok ? 0 : 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+// Checks that the scalar dot product of PolyphaseResampler matches the esp-dsp kernel bit for bit
+#include "polyphase_resampler.h"
+
+// The esp-dsp build from polyphase_resampler_dsp.cc, under its own name
+#undef POLYPHASE_RESAMPLER_H
+#define PolyphaseResampler PolyphaseResamplerDsp
+#include "polyphase_resampler.h"
+#undef PolyphaseResampler
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+#define CHUNK_MS 20
+#define DURATION_MS 2000
+
+// A sweep at full scale, square edges that make the filter overshoot, then noise
+static std::vector<int16_t> MakeInput(int sample_rate) {
+    std::vector<int16_t> input(sample_rate / 1000 * DURATION_MS);
+    uint32_t seed = 1;
+    double phase = 0;
+    for (size_t i = 0; i < input.size(); i++) {
+        size_t part = i * 3 / input.size();
+        if (part == 0) {
+            phase += 2 * M_PI * (100.0 + (sample_rate / 2.0 - 100.0) * i * 3 / input.size()) / sample_rate;
+            input[i] = (int16_t)lround(32767 * sin(phase));
+        } else if (part == 1) {
+            input[i] = (i / 37) % 2 ? 32767 : -32768;
+        } else {
+            seed = seed * 1103515245 + 12345;
+            input[i] = (int16_t)(seed >> 16);
+        }
+    }
+    return input;
+}
+
+template <class Resampler>
+static std::vector<int16_t> Resample(const std::vector<int16_t>& input, int input_rate, int output_rate) {
+    Resampler resampler;
+    resampler.Configure(input_rate, output_rate);
+    int chunk = input_rate / 1000 * CHUNK_MS;
+    std::vector<int16_t> output;
+    std::vector<int16_t> block(resampler.GetOutputSamples(chunk) + 1);
+    for (size_t offset = 0; offset + chunk <= input.size(); offset += chunk) {
+        int written = resampler.Process(input.data() + offset, chunk, block.data());
+        output.insert(output.end(), block.begin(), block.begin() + written);
+    }
+    return output;
+}
+
+static bool CheckRatio(int input_rate, int output_rate) {
+    auto input = MakeInput(input_rate);
+    auto scalar = Resample<PolyphaseResampler>(input, input_rate, output_rate);
+    auto dsp = Resample<PolyphaseResamplerDsp>(input, input_rate, output_rate);
+
+    CHECK(scalar.size() == (size_t)output_rate / 1000 * DURATION_MS);
+    CHECK(scalar.size() == dsp.size());
+    for (size_t i = 0; i < scalar.size(); i++) {
+        if (scalar[i] != dsp[i]) {
+            fprintf(stderr, "%d -> %d: sample %zu is %d, the esp-dsp kernel gives %d\n",
+                input_rate, output_rate, i, scalar[i], dsp[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    struct {
+        int input_rate;
+        int output_rate;
+    } ratios[] = {
+        {16000, 24000},
+        {24000, 16000},
+        {16000, 48000},
+        {48000, 16000},
+        {24000, 48000},
+        {48000, 24000},
+    };
+    int failed = 0;
+    for (auto& ratio : ratios) {
+        bool passed = CheckRatio(ratio.input_rate, ratio.output_rate);
+        printf("%d -> %d: %s\n", ratio.input_rate, ratio.output_rate, passed ? "ok" : "FAILED");
+        failed += !passed;
+    }
+    return failed == 0 ? 0 : 1;
+}
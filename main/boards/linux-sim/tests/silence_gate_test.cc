@@ -0,0 +1,105 @@
+// Feeds VAD patterns through SilenceGate and checks what reaches the encoder
+#include "silence_gate.h"
+
+#include <cstdio>
+#include <vector>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+#define SAMPLE_RATE 16000
+#define CHUNK_MS 20
+#define HANGOVER_MS 100
+#define PRE_ROLL_MS 60
+
+struct Emitted {
+    uint32_t timestamp;
+    bool resumed;
+};
+
+// Feeds chunks of CHUNK_MS, each one timestamped with its start in ms
+static void Feed(SilenceGate& gate, bool speaking, int chunks, uint32_t& now_ms, std::vector<Emitted>& emitted) {
+    gate.SetSpeaking(speaking);
+    for (int i = 0; i < chunks; i++) {
+        std::vector<int16_t> data(SAMPLE_RATE / 1000 * CHUNK_MS, 0);
+        gate.Process(std::move(data), now_ms, [&emitted](std::vector<int16_t>&& data, uint32_t timestamp, bool resumed) {
+            emitted.push_back({timestamp, resumed});
+        });
+        now_ms += CHUNK_MS;
+    }
+}
+
+static bool TestOpenAtStart() {
+    SilenceGate gate(SAMPLE_RATE, HANGOVER_MS, PRE_ROLL_MS);
+    std::vector<Emitted> emitted;
+    uint32_t now_ms = 1000;
+    Feed(gate, true, 10, now_ms, emitted);
+
+    // The gate starts open, there is no gap in front of the first speech
+    CHECK(emitted.size() == 10);
+    for (auto& chunk : emitted) {
+        CHECK(!chunk.resumed);
+    }
+    return true;
+}
+
+static bool TestResumeAfterSilence() {
+    SilenceGate gate(SAMPLE_RATE, HANGOVER_MS, PRE_ROLL_MS);
+    std::vector<Emitted> emitted;
+    uint32_t now_ms = 1000;
+    Feed(gate, true, 10, now_ms, emitted);
+    Feed(gate, false, 30, now_ms, emitted);
+    // Speech and hangover pass, the rest of the silence is held back
+    CHECK(emitted.size() == 10 + HANGOVER_MS / CHUNK_MS);
+    size_t resume_index = emitted.size();
+    uint32_t onset_ms = now_ms;
+    Feed(gate, true, 5, now_ms, emitted);
+
+    // The pre-roll comes first, in order, and only its first chunk reports the gap
+    CHECK(emitted.size() == resume_index + PRE_ROLL_MS / CHUNK_MS + 5);
+    CHECK(emitted[resume_index].resumed);
+    CHECK(emitted[resume_index].timestamp == onset_ms - PRE_ROLL_MS);
+    for (size_t i = resume_index + 1; i < emitted.size(); i++) {
+        CHECK(!emitted[i].resumed);
+        CHECK(emitted[i].timestamp == emitted[i - 1].timestamp + CHUNK_MS);
+    }
+    return true;
+}
+
+static bool TestShortPause() {
+    SilenceGate gate(SAMPLE_RATE, HANGOVER_MS, PRE_ROLL_MS);
+    std::vector<Emitted> emitted;
+    uint32_t now_ms = 1000;
+    Feed(gate, true, 10, now_ms, emitted);
+    Feed(gate, false, HANGOVER_MS / CHUNK_MS, now_ms, emitted);
+    Feed(gate, true, 10, now_ms, emitted);
+
+    // A pause within the hangover never closes the gate
+    CHECK(emitted.size() == 20 + HANGOVER_MS / CHUNK_MS);
+    for (auto& chunk : emitted) {
+        CHECK(!chunk.resumed);
+    }
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"open at start", TestOpenAtStart},
+        {"resume after silence", TestResumeAfterSilence},
+        {"short pause", TestShortPause},
+    };
+    int failed = 0;
+    for (auto& test : tests) {
+        bool passed = test.run();
+        printf("%s: %s\n", test.name, passed ? "ok" : "FAILED");
+        failed += !passed;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,49 @@
+#ifndef HOST_STUB_CJSON_H
+#define HOST_STUB_CJSON_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Just enough of cJSON to build a flat object and print it, nothing is ever parsed
+struct cJSON {
+    std::string members;
+};
+
+inline cJSON* cJSON_CreateObject() {
+    return new cJSON();
+}
+
+inline void cJSON_Delete(cJSON* item) {
+    delete item;
+}
+
+inline void cJSON_AddRawMember(cJSON* object, const char* name, const std::string& value) {
+    if (!object->members.empty()) {
+        object->members += ",";
+    }
+    object->members += std::string("\"") + name + "\":" + value;
+}
+
+inline cJSON* cJSON_AddNumberToObject(cJSON* object, const char* name, double number) {
+    char value[32];
+    snprintf(value, sizeof(value), "%g", number);
+    cJSON_AddRawMember(object, name, value);
+    return object;
+}
+
+inline cJSON* cJSON_AddStringToObject(cJSON* object, const char* name, const char* string) {
+    cJSON_AddRawMember(object, name, std::string("\"") + string + "\"");
+    return object;
+}
+
+inline char* cJSON_PrintUnformatted(const cJSON* item) {
+    return strdup(("{" + item->members + "}").c_str());
+}
+
+inline void cJSON_free(void* object) {
+    free(object);
+}
+
+#endif // HOST_STUB_CJSON_H
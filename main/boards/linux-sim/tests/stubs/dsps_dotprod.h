@@ -0,0 +1,31 @@
+#ifndef HOST_STUB_DSPS_DOTPROD_H
+#define HOST_STUB_DSPS_DOTPROD_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+// The esp-dsp reference kernel, dsps_dotprod_s16_ansi, which its ESP32 and ESP32-S3 assembly kernels are tested against
+// The assembly kernels load 32-bit words, so the inputs are checked for word alignment here
+inline int dsps_dotprod_s16(const int16_t* src1, const int16_t* src2, int16_t* dest, int len, int8_t shift) {
+    if (((uintptr_t)src1 & 3) != 0 || ((uintptr_t)src2 & 3) != 0) {
+        fprintf(stderr, "dsps_dotprod_s16: %p or %p is not word aligned\n", (const void*)src1, (const void*)src2);
+        abort();
+    }
+    if (shift > 15) {
+        shift = 15;
+    }
+    long long acc = 0x7fff >> shift;
+    for (int i = 0; i < len; i++) {
+        acc += (int32_t)src1[i] * (int32_t)src2[i];
+    }
+    int final_shift = shift - 15;
+    if (final_shift > 0) {
+        *dest = (acc << final_shift);
+    } else {
+        *dest = (acc >> (-final_shift));
+    }
+    return 0;
+}
+
+#endif // HOST_STUB_DSPS_DOTPROD_H
@@ -0,0 +1,19 @@
+#ifndef HOST_STUB_ESP_HEAP_CAPS_H
+#define HOST_STUB_ESP_HEAP_CAPS_H
+
+#include <cstdlib>
+
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+inline void* heap_caps_malloc(size_t size, int caps) { return malloc(size); }
+inline void* heap_caps_calloc(size_t n, size_t size, int caps) { return calloc(n, size); }
+inline void* heap_caps_aligned_alloc(size_t alignment, size_t size, int caps) {
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+inline void heap_caps_free(void* ptr) { free(ptr); }
+// There is no heap accounting on the host, allocations never show up here
+inline size_t heap_caps_get_free_size(int caps) { return 0; }
+
+#endif // HOST_STUB_ESP_HEAP_CAPS_H
@@ -0,0 +1,11 @@
+#ifndef HOST_STUB_ESP_LOG_H
+#define HOST_STUB_ESP_LOG_H
+
+#include <cstdio>
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) do {} while (0)
+#define ESP_LOGD(tag, format, ...) do {} while (0)
+
+#endif // HOST_STUB_ESP_LOG_H
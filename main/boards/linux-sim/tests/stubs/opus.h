@@ -0,0 +1,47 @@
+#ifndef HOST_STUB_OPUS_H
+#define HOST_STUB_OPUS_H
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstring>
+
+// A stand-in for the libopus decoder API: it decodes every packet to silence and
+// counts what was done to it, so tests can see decoders being created and reset
+#define OPUS_OK 0
+#define OPUS_RESET_STATE 4028
+
+typedef int16_t opus_int16;
+typedef int32_t opus_int32;
+
+struct OpusDecoder {
+    int sample_rate;
+    int channels;
+};
+
+inline int g_opus_decoders_alive = 0;
+inline int g_opus_decoder_resets = 0;
+
+inline OpusDecoder* opus_decoder_create(opus_int32 sample_rate, int channels, int* error) {
+    *error = OPUS_OK;
+    g_opus_decoders_alive++;
+    return new OpusDecoder{sample_rate, channels};
+}
+
+inline void opus_decoder_destroy(OpusDecoder* decoder) {
+    g_opus_decoders_alive--;
+    delete decoder;
+}
+
+inline int opus_decode(OpusDecoder* decoder, const unsigned char* data, opus_int32 size, opus_int16* pcm, int frame_size, int decode_fec) {
+    memset(pcm, 0, frame_size * decoder->channels * sizeof(opus_int16));
+    return frame_size;
+}
+
+inline int opus_decoder_ctl(OpusDecoder* decoder, int request, ...) {
+    if (request == OPUS_RESET_STATE) {
+        g_opus_decoder_resets++;
+    }
+    return OPUS_OK;
+}
+
+#endif // HOST_STUB_OPUS_H
@@ -0,0 +1,13 @@
+#ifndef HOST_STUB_OPUS_RESAMPLER_H
+#define HOST_STUB_OPUS_RESAMPLER_H
+
+#include <cstdint>
+
+// Only the ratios PolyphaseResampler hands over use it, the host tests do not
+class OpusResampler {
+public:
+    void Configure(int input_sample_rate, int output_sample_rate) {}
+    void Process(const int16_t* input, int samples, int16_t* output) {}
+};
+
+#endif // HOST_STUB_OPUS_RESAMPLER_H
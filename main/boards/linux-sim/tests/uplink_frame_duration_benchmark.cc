@@ -0,0 +1,104 @@
+// Uplink bytes on the wire at each negotiable frame duration, for every transport the firmware speaks.
+// The Opus payload is the average at the bitrate, everything else is header bytes per packet, so the
+// numbers are exact for the framing and only as good as the bitrate for the payload.
+#include "protocol.h"
+
+#include <cstdio>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    } \
+} while (0)
+
+// Client to server websocket frames are masked, payloads of 126 bytes or more take a longer length
+#define WEBSOCKET_HEADER(payload) ((payload) < 126 ? 2 + 4 : 4 + 4)
+// TLS 1.2 AES-GCM record: header, explicit nonce and tag
+#define TLS_RECORD_OVERHEAD (5 + 8 + 16)
+#define TCP_IPV4_OVERHEAD (20 + 20)
+#define UDP_IPV4_OVERHEAD (8 + 20)
+// MqttProtocol prefixes every UDP packet with the 16 byte AES-CTR nonce
+#define MQTT_UDP_NONCE 16
+
+struct Transport {
+    const char* name;
+    int (*overhead)(int payload);
+};
+
+static const Transport kTransports[] = {
+    {"wss v1", [](int payload) {
+        return WEBSOCKET_HEADER(payload) + TLS_RECORD_OVERHEAD + TCP_IPV4_OVERHEAD;
+    }},
+    {"wss v2", [](int payload) {
+        int frame = (int)sizeof(BinaryProtocol2) + payload;
+        return (int)sizeof(BinaryProtocol2) + WEBSOCKET_HEADER(frame) + TLS_RECORD_OVERHEAD + TCP_IPV4_OVERHEAD;
+    }},
+    {"wss v3", [](int payload) {
+        int frame = (int)sizeof(BinaryProtocol3) + payload;
+        return (int)sizeof(BinaryProtocol3) + WEBSOCKET_HEADER(frame) + TLS_RECORD_OVERHEAD + TCP_IPV4_OVERHEAD;
+    }},
+    {"mqtt+udp", [](int payload) {
+        return MQTT_UDP_NONCE + UDP_IPV4_OVERHEAD;
+    }},
+};
+
+static const int kFrameDurations[] = { 20, 40, 60 };
+static const int kBitrates[] = { 6000, 16000 };
+
+// Bytes per second on the wire
+static int WireRate(const Transport& transport, int bitrate, int frame_ms) {
+    int payload = bitrate * frame_ms / 8000;
+    return bitrate / 8 + transport.overhead(payload) * 1000 / frame_ms;
+}
+
+static bool TestOverheadTable() {
+    printf("%-10s %8s %6s %10s %10s %9s\n", "transport", "bitrate", "frame", "payload/s", "wire/s", "overhead");
+    for (auto& transport : kTransports) {
+        for (int bitrate : kBitrates) {
+            for (int frame_ms : kFrameDurations) {
+                int payload_rate = bitrate / 8;
+                int wire_rate = WireRate(transport, bitrate, frame_ms);
+                printf("%-10s %8d %4dms %10d %10d %8d%%\n", transport.name, bitrate, frame_ms,
+                    payload_rate, wire_rate, (wire_rate - payload_rate) * 100 / wire_rate);
+            }
+        }
+    }
+    return true;
+}
+
+static bool TestShorterFramesCostHeaders() {
+    for (auto& transport : kTransports) {
+        for (int bitrate : kBitrates) {
+            int rate_20 = WireRate(transport, bitrate, 20);
+            int rate_40 = WireRate(transport, bitrate, 40);
+            int rate_60 = WireRate(transport, bitrate, 60);
+            CHECK(rate_20 > rate_40 && rate_40 > rate_60);
+            // Headers scale with the packet rate, 20 ms frames pay close to three times the header bytes of 60 ms
+            int headers_20 = rate_20 - bitrate / 8;
+            int headers_60 = rate_60 - bitrate / 8;
+            CHECK(headers_20 > headers_60 * 5 / 2);
+        }
+    }
+    // At the lowest bitrate 20 ms frames over TLS spend more on headers than on audio
+    int wire = WireRate(kTransports[2], 6000, 20);
+    CHECK(wire - 6000 / 8 > 6000 / 8);
+    return true;
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"overhead_table", TestOverheadTable},
+        {"shorter_frames_cost_headers", TestShorterFramesCostHeaders},
+    };
+    int failures = 0;
+    for (auto& test : tests) {
+        bool ok = test.run();
+        printf("%s: %s\n", test.name, ok ? "ok" : "FAILED");
+        failures += ok ? 0 : 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+#include "latency_tracer.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cJSON.h>
+#include <algorithm>
+#include <vector>
+
+#define TAG "LatencyTracer"
+
+// Print the percentiles of every milestone once every this many turns
+#define LATENCY_PRINT_INTERVAL_TURNS 10
+
+static const char* const kMilestoneNames[kLatencyMilestoneCount] = {
+    "wake_word",
+    "wake_beep",
+    "channel_open",
+    "channel_opened",
+    "first_audio_sent",
+    "listen_stop",
+    "stt",
+    "tts_start",
+    "first_audio_received",
+    "first_sample_played",
+    "tts_stop",
+};
+
+static const uint32_t kBucketBoundsMs[] = {100, 200, 500, 1000, 2000, 5000};
+
+void LatencyTracer::Mark(LatencyMilestone milestone) {
+    // Most calls come from per packet paths after the milestone is already marked, skip them without locking
+    bool starts_turn = milestone == kLatencyWakeWordDetected || milestone == kLatencyChannelOpenRequested;
+    if (!starts_turn && marks_[milestone].load(std::memory_order_relaxed) != 0) {
+        return;
+    }
+
+    auto now = esp_timer_get_time();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (start_time_ != 0) {
+        // A channel open request belongs to the turn in progress only if that turn was started by the wake word
+        // and has not opened a channel yet, otherwise the turn in progress was left without a tts stop
+        if (milestone == kLatencyWakeWordDetected ||
+            (milestone == kLatencyChannelOpenRequested &&
+                (marks_[kLatencyWakeWordDetected] == 0 || marks_[kLatencyChannelOpenRequested] != 0))) {
+            FinishTurn();
+        }
+    }
+    if (start_time_ == 0) {
+        if (milestone != kLatencyWakeWordDetected && milestone != kLatencyChannelOpenRequested &&
+            milestone != kLatencyFirstAudioSent) {
+            return;
+        }
+        start_time_ = now;
+    }
+    if (marks_[milestone] != 0) {
+        return;
+    }
+    marks_[milestone] = now;
+    if (milestone == kLatencyTtsStop) {
+        FinishTurn();
+    }
+}
+
+void LatencyTracer::EndTurn() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (start_time_ != 0) {
+        FinishTurn();
+    }
+}
+
+void LatencyTracer::FinishTurn() {
+    std::string line;
+    for (int i = 0; i < kLatencyMilestoneCount; i++) {
+        int64_t mark = marks_[i].exchange(0);
+        line += " ";
+        line += kMilestoneNames[i];
+        if (mark == 0) {
+            line += "=-";
+            continue;
+        }
+        uint32_t offset_ms = (mark - start_time_) / 1000;
+        auto& history = history_[i];
+        history.values_ms[history.count % LATENCY_HISTORY_SIZE] = offset_ms;
+        history.count++;
+        line += "=" + std::to_string(offset_ms);
+    }
+    start_time_ = 0;
+    turns_++;
+    ESP_LOGI(TAG, "Turn %lu (ms):%s", turns_, line.c_str());
+
+    if (turns_ % LATENCY_PRINT_INTERVAL_TURNS == 0) {
+        PrintStats();
+    }
+}
+
+// Returns the kept values of a milestone in ascending order
+static std::vector<uint32_t> SortedValues(const uint32_t* values, uint32_t count) {
+    std::vector<uint32_t> sorted(values, values + std::min<uint32_t>(count, LATENCY_HISTORY_SIZE));
+    std::sort(sorted.begin(), sorted.end());
+    return sorted;
+}
+
+static uint32_t Percentile(const std::vector<uint32_t>& sorted, int percent) {
+    return sorted[(sorted.size() - 1) * percent / 100];
+}
+
+void LatencyTracer::PrintStats() {
+    for (int i = 0; i < kLatencyMilestoneCount; i++) {
+        auto& history = history_[i];
+        if (history.count == 0) {
+            continue;
+        }
+        auto sorted = SortedValues(history.values_ms, history.count);
+        ESP_LOGI(TAG, "%s: p50 %lums, p90 %lums, max %lums over the last %u turns", kMilestoneNames[i],
+            Percentile(sorted, 50), Percentile(sorted, 90), sorted.back(), sorted.size());
+    }
+}
+
+std::string LatencyTracer::GetStatsJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "turns", turns_);
+
+    cJSON* bounds = cJSON_CreateArray();
+    for (auto bound : kBucketBoundsMs) {
+        cJSON_AddItemToArray(bounds, cJSON_CreateNumber(bound));
+    }
+    cJSON_AddItemToObject(root, "bucket_bounds_ms", bounds);
+
+    cJSON* milestones = cJSON_CreateObject();
+    for (int i = 0; i < kLatencyMilestoneCount; i++) {
+        auto& history = history_[i];
+        if (history.count == 0) {
+            continue;
+        }
+        auto sorted = SortedValues(history.values_ms, history.count);
+        cJSON* milestone = cJSON_CreateObject();
+        cJSON_AddNumberToObject(milestone, "count", sorted.size());
+        cJSON_AddNumberToObject(milestone, "p50", Percentile(sorted, 50));
+        cJSON_AddNumberToObject(milestone, "p90", Percentile(sorted, 90));
+        cJSON_AddNumberToObject(milestone, "max", sorted.back());
+
+        // The last bucket counts everything above the last bound
+        int buckets[sizeof(kBucketBoundsMs) / sizeof(kBucketBoundsMs[0]) + 1] = {};
+        for (auto value : sorted) {
+            int bucket = std::upper_bound(std::begin(kBucketBoundsMs), std::end(kBucketBoundsMs), value) - std::begin(kBucketBoundsMs);
+            buckets[bucket]++;
+        }
+        cJSON_AddItemToObject(milestone, "histogram", cJSON_CreateIntArray(buckets, sizeof(buckets) / sizeof(buckets[0])));
+        cJSON_AddItemToObject(milestones, kMilestoneNames[i], milestone);
+    }
+    cJSON_AddItemToObject(root, "milestones", milestones);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,66 @@
+#ifndef LATENCY_TRACER_H
+#define LATENCY_TRACER_H
+
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include <atomic>
+
+enum LatencyMilestone {
+    kLatencyWakeWordDetected,
+    kLatencyWakeBeep,
+    kLatencyChannelOpenRequested,
+    kLatencyChannelOpened,
+    kLatencyFirstAudioSent,
+    kLatencyListenStop,
+    kLatencySttReceived,
+    kLatencyTtsStart,
+    kLatencyFirstAudioReceived,
+    kLatencyFirstSampleOutput,
+    kLatencyTtsStop,
+    kLatencyMilestoneCount
+};
+
+#define LATENCY_HISTORY_SIZE 32
+
+/*
+ * Timestamps the milestones of a conversation turn and keeps the offset of each
+ * milestone from the start of the turn for the last LATENCY_HISTORY_SIZE turns.
+ *
+ * Only the first mark of a milestone counts. A turn is started by the wake word,
+ * a channel open request or the first audio sent, and ends with tts stop.
+ * A new wake word, a new channel open request or the channel closing ends the turn in progress.
+ */
+class LatencyTracer {
+public:
+    static LatencyTracer& GetInstance() {
+        static LatencyTracer instance;
+        return instance;
+    }
+    LatencyTracer(const LatencyTracer&) = delete;
+    LatencyTracer& operator=(const LatencyTracer&) = delete;
+
+    void Mark(LatencyMilestone milestone);
+    // Ends the turn in progress with the milestones it reached
+    void EndTurn();
+    std::string GetStatsJson();
+
+private:
+    LatencyTracer() = default;
+
+    struct History {
+        uint32_t values_ms[LATENCY_HISTORY_SIZE];
+        uint32_t count = 0;     // Total number of values, the last LATENCY_HISTORY_SIZE are kept
+    };
+
+    std::mutex mutex_;
+    std::atomic<int64_t> marks_[kLatencyMilestoneCount] = {};
+    int64_t start_time_ = 0;
+    uint32_t turns_ = 0;
+    History history_[kLatencyMilestoneCount];
+
+    void FinishTurn();
+    void PrintStats();
+};
+
+#endif // LATENCY_TRACER_H
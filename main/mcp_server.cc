@@ -13,6 +13,7 @@
 #include "application.h"
 #include "display.h"
 #include "board.h"
+#include "latency_tracer.h"
 
 #define TAG "MCP"
 
@@ -56,6 +57,27 @@ void McpServer::AddCommonTools() {
             return true;
         });
     
+    AddTool("self.get_encoder_stats",
+        "Provides the state of the adaptive uplink Opus encoder, for troubleshooting choppy or delayed uplink audio.\n"
+        "Returns the current complexity and bitrate, the encoding CPU load of the last window, "
+        "the send failures and how often and why the settings were changed. "
+        "`frame_pool` shows the processed microphone frames waiting for the encoder, "
+        "a growing `peak_in_use` or a non-zero `exhausted` means the encoder falls behind.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return Application::GetInstance().GetEncoderStatsJson();
+        });
+
+    AddTool("self.get_latency_stats",
+        "Provides the latency statistics of the recent conversation turns, for troubleshooting slow responses.\n"
+        "For each milestone (wake word, channel open, first audio sent, listen stop, stt, tts start, first audio received, "
+        "first sample played, tts stop) it returns the p50, p90 and max offset in milliseconds from the start of the turn, "
+        "and a histogram over `bucket_bounds_ms`.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return LatencyTracer::GetInstance().GetStatsJson();
+        });
+
     auto backlight = board.GetBacklight();
     if (backlight) {
         AddTool("self.screen.set_brightness",
@@ -0,0 +1,167 @@
+#include "loopback_protocol.h"
+#include "application.h"
+#include "latency_tracer.h"
+
+#include <esp_log.h>
+#include <freertos/task.h>
+#include <cstring>
+
+#define TAG "LoopbackProtocol"
+
+// Longest turn the stand-in server records, auto and realtime mode end the turn here
+#define LOOPBACK_PROTOCOL_TURN_MS 5000
+
+LoopbackProtocol::LoopbackProtocol() {
+    event_group_handle_ = xEventGroupCreate();
+    // The uplink is echoed back, so the downlink has the uplink format
+    server_sample_rate_ = 16000;
+}
+
+LoopbackProtocol::~LoopbackProtocol() {
+    if (server_task_handle_ != nullptr) {
+        vTaskDelete(server_task_handle_);
+    }
+    vEventGroupDelete(event_group_handle_);
+}
+
+bool LoopbackProtocol::Start() {
+    xTaskCreate([](void* arg) {
+        auto protocol = (LoopbackProtocol*)arg;
+        protocol->ServerLoop();
+        vTaskDelete(NULL);
+    }, "loopback_server", 4096, this, 5, &server_task_handle_);
+    return true;
+}
+
+bool LoopbackProtocol::OpenAudioChannel() {
+    LatencyTracer::GetInstance().Mark(kLatencyChannelOpenRequested);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        channel_opened_ = true;
+        error_occurred_ = false;
+        session_id_ = "loopback";
+        uplink_frame_duration_ = preferred_uplink_frame_duration_;
+        server_frame_duration_ = uplink_frame_duration_;
+    }
+    last_incoming_time_ = std::chrono::steady_clock::now();
+
+    LatencyTracer::GetInstance().Mark(kLatencyChannelOpened);
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+    return true;
+}
+
+void LoopbackProtocol::CloseAudioChannel() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        channel_opened_ = false;
+        listening_ = false;
+        recording_.clear();
+    }
+    xEventGroupSetBits(event_group_handle_, LOOPBACK_PROTOCOL_ABORT_EVENT);
+    if (on_audio_channel_closed_ != nullptr) {
+        on_audio_channel_closed_();
+    }
+}
+
+bool LoopbackProtocol::IsAudioChannelOpened() const {
+    return channel_opened_ && !error_occurred_;
+}
+
+bool LoopbackProtocol::SendAudio(const AudioStreamPacket& packet) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!channel_opened_) {
+        return false;
+    }
+    if (!listening_) {
+        return true;
+    }
+    recording_.push_back(packet);
+    // Without a VAD the stand-in server ends an auto stop turn after a fixed duration
+    if (auto_stop_ && (int)recording_.size() * uplink_frame_duration_ >= LOOPBACK_PROTOCOL_TURN_MS) {
+        listening_ = false;
+        xEventGroupSetBits(event_group_handle_, LOOPBACK_PROTOCOL_REPLY_EVENT);
+    }
+    return true;
+}
+
+bool LoopbackProtocol::SendText(const std::string& text) {
+    auto root = cJSON_Parse(text.c_str());
+    if (root == nullptr) {
+        ESP_LOGE(TAG, "Failed to parse message: %s", text.c_str());
+        return false;
+    }
+
+    auto type = cJSON_GetObjectItem(root, "type");
+    auto state = cJSON_GetObjectItem(root, "state");
+    if (cJSON_IsString(type) && strcmp(type->valuestring, "listen") == 0 && cJSON_IsString(state)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (strcmp(state->valuestring, "start") == 0) {
+            auto mode = cJSON_GetObjectItem(root, "mode");
+            auto_stop_ = !cJSON_IsString(mode) || strcmp(mode->valuestring, "manual") != 0;
+            listening_ = true;
+            recording_.clear();
+        } else if (strcmp(state->valuestring, "stop") == 0 && listening_) {
+            listening_ = false;
+            xEventGroupSetBits(event_group_handle_, LOOPBACK_PROTOCOL_REPLY_EVENT);
+        }
+    } else if (cJSON_IsString(type) && strcmp(type->valuestring, "abort") == 0) {
+        xEventGroupSetBits(event_group_handle_, LOOPBACK_PROTOCOL_ABORT_EVENT);
+    }
+    cJSON_Delete(root);
+    return true;
+}
+
+void LoopbackProtocol::SendJson(const char* json) {
+    last_incoming_time_ = std::chrono::steady_clock::now();
+    auto root = cJSON_Parse(json);
+    if (on_incoming_json_ != nullptr) {
+        on_incoming_json_(root);
+    }
+    cJSON_Delete(root);
+}
+
+void LoopbackProtocol::ServerLoop() {
+    while (true) {
+        xEventGroupWaitBits(event_group_handle_, LOOPBACK_PROTOCOL_REPLY_EVENT, pdTRUE, pdFALSE, portMAX_DELAY);
+        xEventGroupClearBits(event_group_handle_, LOOPBACK_PROTOCOL_ABORT_EVENT);
+
+        std::vector<AudioStreamPacket> packets;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            packets.swap(recording_);
+        }
+        ESP_LOGI(TAG, "Replying with %u packets", packets.size());
+
+        std::string stt = "{\"type\":\"stt\",\"text\":\"" + std::to_string(packets.size() * server_frame_duration_) + " ms of audio\"}";
+        SendJson(stt.c_str());
+        SendJson("{\"type\":\"tts\",\"state\":\"start\"}");
+
+        // Let the tts start reach the main loop before the audio, as a real server round trip would
+        vTaskDelay(pdMS_TO_TICKS(server_frame_duration_));
+        auto next_time = xTaskGetTickCount();
+        uint32_t sequence = 0;
+        for (auto& packet : packets) {
+            if (xEventGroupGetBits(event_group_handle_) & LOOPBACK_PROTOCOL_ABORT_EVENT) {
+                ESP_LOGI(TAG, "Reply aborted");
+                break;
+            }
+            packet.sample_rate = server_sample_rate_;
+            packet.frame_duration = server_frame_duration_;
+            packet.sequence = ++sequence;
+            last_incoming_time_ = std::chrono::steady_clock::now();
+            if (on_incoming_audio_ != nullptr) {
+                on_incoming_audio_(std::move(packet));
+            }
+            vTaskDelayUntil(&next_time, pdMS_TO_TICKS(server_frame_duration_));
+        }
+        SendJson("{\"type\":\"tts\",\"state\":\"stop\"}");
+
+        // A realtime session keeps listening without a new listen start
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (channel_opened_ && auto_stop_) {
+            listening_ = true;
+        }
+    }
+}
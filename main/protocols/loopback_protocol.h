@@ -0,0 +1,45 @@
+#ifndef _LOOPBACK_PROTOCOL_H_
+#define _LOOPBACK_PROTOCOL_H_
+
+#include "protocol.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <mutex>
+#include <vector>
+
+#define LOOPBACK_PROTOCOL_REPLY_EVENT (1 << 0)
+#define LOOPBACK_PROTOCOL_ABORT_EVENT (1 << 1)
+
+/*
+ * An in-process stand-in for the server, for running the audio pipeline without a network.
+ * It records the audio sent while listening and, once listening stops, answers like a server:
+ * stt, tts start, the recorded packets played back at their frame rate, then tts stop.
+ * In auto and realtime mode it stops listening by itself after LOOPBACK_PROTOCOL_TURN_MS.
+ */
+class LoopbackProtocol : public Protocol {
+public:
+    LoopbackProtocol();
+    ~LoopbackProtocol();
+
+    bool Start() override;
+    bool SendAudio(const AudioStreamPacket& packet) override;
+    bool OpenAudioChannel() override;
+    void CloseAudioChannel() override;
+    bool IsAudioChannelOpened() const override;
+
+private:
+    EventGroupHandle_t event_group_handle_;
+    TaskHandle_t server_task_handle_ = nullptr;
+    std::mutex mutex_;
+    bool channel_opened_ = false;
+    bool listening_ = false;
+    bool auto_stop_ = false;
+    std::vector<AudioStreamPacket> recording_;
+
+    bool SendText(const std::string& text) override;
+    void ServerLoop();
+    void SendJson(const char* json);
+};
+
+#endif
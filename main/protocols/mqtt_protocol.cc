@@ -2,6 +2,7 @@
 #include "board.h"
 #include "application.h"
 #include "settings.h"
+#include "latency_tracer.h"
 
 #include <esp_log.h>
 #include <ml307_mqtt.h>
@@ -169,6 +170,7 @@ void MqttProtocol::CloseAudioChannel() {
 }
 
 bool MqttProtocol::OpenAudioChannel() {
+    LatencyTracer::GetInstance().Mark(kLatencyChannelOpenRequested);
     if (mqtt_ == nullptr || !mqtt_->IsConnected()) {
         ESP_LOGI(TAG, "MQTT is not connected, try to connect now");
         if (!StartMqttClient(true)) {
@@ -214,11 +216,10 @@ bool MqttProtocol::OpenAudioChannel() {
         }
         uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
         uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
-        if (sequence < remote_sequence_) {
-            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
-            return;
-        }
-        if (sequence != remote_sequence_ + 1) {
+        // Reordered packets are still delivered, the jitter buffer puts them back in order
+        if (sequence <= remote_sequence_) {
+            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
+        } else if (sequence != remote_sequence_ + 1) {
             ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
         }
 
@@ -227,25 +228,30 @@ bool MqttProtocol::OpenAudioChannel() {
         uint8_t stream_block[16] = {0};
         auto nonce = (uint8_t*)data.data();
         auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
-        AudioStreamPacket packet;
+        auto& packet = incoming_packet_;
         packet.sample_rate = server_sample_rate_;
         packet.frame_duration = server_frame_duration_;
         packet.timestamp = timestamp;
+        packet.sequence = sequence;
         packet.payload.resize(decrypted_size);
         int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)packet.payload.data());
         if (ret != 0) {
             ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
             return;
         }
+        CountIncomingSequence(sequence);
         if (on_incoming_audio_ != nullptr) {
             on_incoming_audio_(std::move(packet));
         }
-        remote_sequence_ = sequence;
+        if (sequence > remote_sequence_) {
+            remote_sequence_ = sequence;
+        }
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
     udp_->Connect(udp_server_, udp_port_);
 
+    LatencyTracer::GetInstance().Mark(kLatencyChannelOpened);
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
     }
@@ -264,13 +270,17 @@ std::string MqttProtocol::GetHelloMessage() {
 #endif
 #if CONFIG_IOT_PROTOCOL_MCP
     cJSON_AddBoolToObject(features, "mcp", true);
+#endif
+#if CONFIG_AUDIO_UPLINK_DTX
+    // Realtime listening leaves gaps in the uplink while the user is silent
+    cJSON_AddBoolToObject(features, "dtx", true);
 #endif
     cJSON_AddItemToObject(root, "features", features);
     cJSON* audio_params = cJSON_CreateObject();
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", preferred_uplink_frame_duration_);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -303,6 +313,7 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
         if (cJSON_IsNumber(frame_duration)) {
             server_frame_duration_ = frame_duration->valueint;
         }
+        ParseUplinkFrameDuration(audio_params);
     }
 
     auto udp = cJSON_GetObjectItem(root, "udp");
@@ -322,6 +333,7 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
     mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key).c_str(), 128);
     local_sequence_ = 0;
     remote_sequence_ = 0;
+    ResetPacketLoss();
     xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 }
 
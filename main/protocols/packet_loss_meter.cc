@@ -0,0 +1,37 @@
+#include "packet_loss_meter.h"
+
+#include <esp_log.h>
+
+#define TAG "PacketLossMeter"
+
+void PacketLossMeter::Reset() {
+    percent_ = 0;
+    loss_q8_ = 0;
+    window_start_ = 0;
+    window_received_ = 0;
+}
+
+void PacketLossMeter::Count(uint32_t sequence) {
+    if (window_start_ == 0) {
+        window_start_ = sequence;
+    } else if ((int32_t)(sequence - window_start_) < 0) {
+        // Reordered from the previous window, it was counted as lost there
+        return;
+    }
+    window_received_++;
+    uint32_t expected = sequence - window_start_ + 1;
+    if (expected < PACKET_LOSS_WINDOW) {
+        return;
+    }
+
+    int loss = expected > window_received_ ? (expected - window_received_) * 100 / expected : 0;
+    // Every window weighs half, the remainder below one Q8 step rounds away when reported
+    loss_q8_ += ((loss << 8) - loss_q8_) / 2;
+    int smoothed = (loss_q8_ + 128) >> 8;
+    if (smoothed != percent_) {
+        ESP_LOGI(TAG, "Packet loss: %d%% (last %lu packets: %d%%)", smoothed, expected, loss);
+        percent_ = smoothed;
+    }
+    window_start_ = sequence + 1;
+    window_received_ = 0;
+}
@@ -0,0 +1,28 @@
+#ifndef PACKET_LOSS_METER_H
+#define PACKET_LOSS_METER_H
+
+#include <cstdint>
+#include <atomic>
+
+#define PACKET_LOSS_WINDOW 50
+
+/*
+ * Measures the loss of a numbered packet stream over windows of PACKET_LOSS_WINDOW
+ * expected packets. The windows are averaged in Q8 so one burst does not swing the
+ * encoder, and the estimate falls back to 0 once the loss stops.
+ * Count and Reset are called from the receive task, percent() from any task.
+ */
+class PacketLossMeter {
+public:
+    void Reset();
+    void Count(uint32_t sequence);
+    inline int percent() const { return percent_; }
+
+private:
+    std::atomic<int> percent_{0};
+    int loss_q8_ = 0;
+    uint32_t window_start_ = 0;
+    uint32_t window_received_ = 0;
+};
+
+#endif // PACKET_LOSS_METER_H
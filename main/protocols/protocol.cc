@@ -1,4 +1,5 @@
 #include "protocol.h"
+#include "latency_tracer.h"
 
 #include <esp_log.h>
 
@@ -24,6 +25,26 @@ void Protocol::OnNetworkError(std::function<void(const std::string& message)> ca
     on_network_error_ = callback;
 }
 
+void Protocol::SetPreferredUplinkFrameDuration(int frame_duration) {
+    preferred_uplink_frame_duration_ = frame_duration;
+    uplink_frame_duration_ = frame_duration;
+}
+
+// The uplink queues are sized for the preferred duration, so the server may only ask for longer frames
+void Protocol::ParseUplinkFrameDuration(const cJSON* audio_params) {
+    uplink_frame_duration_ = preferred_uplink_frame_duration_;
+    auto uplink_frame_duration = cJSON_GetObjectItem(audio_params, "uplink_frame_duration");
+    if (!cJSON_IsNumber(uplink_frame_duration)) {
+        return;
+    }
+    int frame_duration = uplink_frame_duration->valueint;
+    if ((frame_duration == 20 || frame_duration == 40 || frame_duration == 60) && frame_duration >= preferred_uplink_frame_duration_) {
+        uplink_frame_duration_ = frame_duration;
+    } else {
+        ESP_LOGW(TAG, "Ignore uplink frame duration %d from server, keep %dms", frame_duration, uplink_frame_duration_);
+    }
+}
+
 void Protocol::SetError(const std::string& message) {
     error_occurred_ = true;
     if (on_network_error_ != nullptr) {
@@ -61,6 +82,7 @@ void Protocol::SendStartListening(ListeningMode mode) {
 }
 
 void Protocol::SendStopListening() {
+    LatencyTracer::GetInstance().Mark(kLatencyListenStop);
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"listen\",\"state\":\"stop\"}";
     SendText(message);
 }
@@ -130,3 +152,11 @@ bool Protocol::IsTimeout() const {
     }
     return timeout;
 }
+
+void Protocol::ResetPacketLoss() {
+    packet_loss_.Reset();
+}
+
+void Protocol::CountIncomingSequence(uint32_t sequence) {
+    packet_loss_.Count(sequence);
+}
@@ -6,11 +6,15 @@
 #include <functional>
 #include <chrono>
 #include <vector>
+#include <atomic>
+
+#include "packet_loss_meter.h"
 
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
+    uint32_t sequence = 0;  // 0 if the transport does not number its packets
     std::vector<uint8_t> payload;
 };
 
@@ -54,6 +58,16 @@ public:
     inline const std::string& session_id() const {
         return session_id_;
     }
+    inline int uplink_frame_duration() const {
+        return uplink_frame_duration_;
+    }
+    // Downlink packet loss measured from the sequence numbers, 0 on transports without them
+    inline int packet_loss_percent() const {
+        return packet_loss_.percent();
+    }
+
+    // Frame duration proposed in the hello message, the server may raise it in its hello
+    void SetPreferredUplinkFrameDuration(int frame_duration);
 
     void OnIncomingAudio(std::function<void(AudioStreamPacket&& packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
@@ -83,13 +97,21 @@ protected:
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
+    int preferred_uplink_frame_duration_ = 60;
+    int uplink_frame_duration_ = 60;
     bool error_occurred_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
+    // Reused for every incoming audio frame, the receive callback only reads from it
+    AudioStreamPacket incoming_packet_;
+    PacketLossMeter packet_loss_;
 
     virtual bool SendText(const std::string& text) = 0;
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
+    void ParseUplinkFrameDuration(const cJSON* audio_params);
+    void ResetPacketLoss();
+    void CountIncomingSequence(uint32_t sequence);
 };
 
 #endif // PROTOCOL_H
@@ -3,6 +3,7 @@
 #include "system_info.h"
 #include "application.h"
 #include "settings.h"
+#include "latency_tracer.h"
 
 #include <cstring>
 #include <cJSON.h>
@@ -86,6 +87,7 @@ void WebsocketProtocol::CloseAudioChannel() {
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
+    LatencyTracer::GetInstance().Mark(kLatencyChannelOpenRequested);
     if (websocket_ != nullptr) {
         delete websocket_;
     }
@@ -116,6 +118,10 @@ bool WebsocketProtocol::OpenAudioChannel() {
     websocket_->OnData([this](const char* data, size_t len, bool binary) {
         if (binary) {
             if (on_incoming_audio_ != nullptr) {
+                // Reuse the payload buffer of incoming_packet_ to avoid allocating per frame
+                auto& packet = incoming_packet_;
+                packet.sample_rate = server_sample_rate_;
+                packet.frame_duration = server_frame_duration_;
                 if (version_ == 2) {
                     BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
                     bp2->version = ntohs(bp2->version);
@@ -123,31 +129,20 @@ bool WebsocketProtocol::OpenAudioChannel() {
                     bp2->timestamp = ntohl(bp2->timestamp);
                     bp2->payload_size = ntohl(bp2->payload_size);
                     auto payload = (uint8_t*)bp2->payload;
-                    on_incoming_audio_(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
-                    });
+                    packet.timestamp = bp2->timestamp;
+                    packet.payload.assign(payload, payload + bp2->payload_size);
                 } else if (version_ == 3) {
                     BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
                     bp3->type = bp3->type;
                     bp3->payload_size = ntohs(bp3->payload_size);
                     auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    });
+                    packet.timestamp = 0;
+                    packet.payload.assign(payload, payload + bp3->payload_size);
                 } else {
-                    on_incoming_audio_(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
-                    });
+                    packet.timestamp = 0;
+                    packet.payload.assign((uint8_t*)data, (uint8_t*)data + len);
                 }
+                on_incoming_audio_(std::move(packet));
             }
         } else {
             // Parse JSON data
@@ -197,6 +192,7 @@ bool WebsocketProtocol::OpenAudioChannel() {
         return false;
     }
 
+    LatencyTracer::GetInstance().Mark(kLatencyChannelOpened);
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
     }
@@ -215,6 +211,10 @@ std::string WebsocketProtocol::GetHelloMessage() {
 #endif
 #if CONFIG_IOT_PROTOCOL_MCP
     cJSON_AddBoolToObject(features, "mcp", true);
+#endif
+#if CONFIG_AUDIO_UPLINK_DTX
+    // Realtime listening leaves gaps in the uplink while the user is silent
+    cJSON_AddBoolToObject(features, "dtx", true);
 #endif
     cJSON_AddItemToObject(root, "features", features);
     cJSON_AddStringToObject(root, "transport", "websocket");
@@ -222,7 +222,7 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", preferred_uplink_frame_duration_);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -254,6 +254,7 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         if (cJSON_IsNumber(frame_duration)) {
             server_frame_duration_ = frame_duration->valueint;
         }
+        ParseUplinkFrameDuration(audio_params);
     }
 
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
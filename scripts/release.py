@@ -78,6 +78,10 @@ def release(board_type, board_config):
         config = json.load(f)
     target = config["target"]
     builds = config["builds"]
+    if target == "linux":
+        # linux 目标需要 idf.py --preview，且只生成主机程序，没有可发布的固件
+        print(f"跳过 {board_type} 因为 linux 目标不生成固件")
+        return
     
     for build in builds:
         name = build["name"]